@@ -0,0 +1,803 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <limits.h>
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ic_impl.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <direct.h>
+#include <fcntl.h>
+#endif
+
+// a program with a single long expression of every kind the binary compiler queries operand types for
+static std::string generate_expr_program(int terms)
+{
+    static const char* ops[] = {" + ", " - ", " * "};
+    std::string src = "s32 main()\n{\n    s32 a = 3;\n    f64 f = 0.5;\n    s32 x = a";
+
+    for (int i = 1; i < terms; ++i)
+    {
+        src += ops[i % 3];
+        src += (i % 5 == 0) ? "(a - 1)" : "a";
+    }
+    src += ";\n    f64 y = f";
+
+    for (int i = 1; i < terms; ++i)
+    {
+        src += ops[i % 3];
+        src += (i % 2) ? "a" : "f";
+    }
+    src += ";\n    s32 z = 0;\n    z";
+
+    for (int i = 1; i < terms; ++i)
+        src += " += a";
+    src += ";\n    return x + (s32)y + z;\n}\n";
+    return src;
+}
+
+// a program with the given number of structs, global variables, functions and local variables of main
+static std::string generate_symbols_program(int symbols)
+{
+    std::string src;
+    char buf[256];
+
+    for (int i = 0; i < symbols; ++i)
+    {
+        snprintf(buf, sizeof(buf), "struct t%d { s32 a; };\nt%d gt%d;\ns32 g%d;\n", i, i, i, i);
+        src += buf;
+    }
+    src += "s32 fn0(s32 x) { return x + g0; }\n";
+
+    for (int i = 1; i < symbols; ++i)
+    {
+        snprintf(buf, sizeof(buf), "s32 fn%d(s32 x) { s32 v = x + g%d + gt%d.a; return fn%d(v); }\n", i, i, i, i - 1);
+        src += buf;
+    }
+    src += "s32 main()\n{\n    s32 l0 = 0;\n";
+
+    for (int i = 1; i < symbols; ++i)
+    {
+        snprintf(buf, sizeof(buf), "    s32 l%d = l%d + 1;\n", i, i - 1);
+        src += buf;
+    }
+    snprintf(buf, sizeof(buf), "    return fn%d(l%d);\n}\n", symbols - 1, symbols - 1);
+    src += buf;
+    return src;
+}
+
+// leaf functions called in groups of 64, main calls the first called_groups groups and has calls of the rest of groups
+// that are never executed; returns the value main() returns
+static std::string generate_stress_program(int functions, int called_groups, int* expected)
+{
+    const int group_size = 64;
+    std::string src;
+    char buf[256];
+    int x = 0;
+
+    for (int i = 0; i < functions; ++i)
+    {
+        snprintf(buf, sizeof(buf), "s32 fn%d(s32 x) { return (x * 31 + %d) %% 1000; }\n", i, i % 997);
+        src += buf;
+
+        if (i < called_groups * group_size)
+            x = (x * 31 + i % 997) % 1000;
+    }
+
+    for (int g = 0; g < functions / group_size; ++g)
+    {
+        snprintf(buf, sizeof(buf), "s32 group%d(s32 x)\n{\n", g);
+        src += buf;
+
+        for (int i = g * group_size; i < (g + 1) * group_size; ++i)
+        {
+            snprintf(buf, sizeof(buf), "    x = fn%d(x);\n", i);
+            src += buf;
+        }
+        src += "    return x;\n}\n";
+    }
+    src += "s32 main()\n{\n    s32 x = 0;\n";
+
+    for (int g = 0; g < functions / group_size; ++g)
+    {
+        snprintf(buf, sizeof(buf), g < called_groups ? "    x = group%d(x);\n" : "    if (x < 0)\n        x = group%d(x);\n", g);
+        src += buf;
+    }
+    src += "    return x;\n}\n";
+    *expected = x;
+    return src;
+}
+
+static long peak_rss_kb()
+{
+#ifndef _WIN32
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return -1;
+#endif
+}
+
+static int elapsed_us(std::chrono::high_resolution_clock::time_point t1)
+{
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return (int)std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+}
+
+// the time of a call to operation(), the best of runs calls
+template<typename T>
+static int time_us(int runs, T operation)
+{
+    int best_us = INT_MAX;
+
+    for (int i = 0; i < runs; ++i)
+    {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        operation();
+        int us = elapsed_us(t1);
+        best_us = us < best_us ? us : best_us;
+    }
+    return best_us;
+}
+
+// a generated program and the value its main() returns
+struct bench_source
+{
+    std::string text;
+    int expected;
+};
+
+// calls measure(size, source) with a source that generate(size) returns for every size from first_size to max_size,
+// doubling; a row that measure() prints is flushed, so a long benchmark shows progress
+template<typename G, typename M>
+static void bench_sizes(int first_size, int max_size, G generate, M measure)
+{
+    for (int size = first_size; size <= max_size; size *= 2)
+    {
+        auto source = generate(size);
+        measure(size, source);
+        fflush(stdout);
+    }
+}
+
+// a stress program that calls all of its functions
+static bench_source stress_source(int functions)
+{
+    bench_source source;
+    source.text = generate_stress_program(functions, functions / 64, &source.expected);
+    return source;
+}
+
+static int compilation_time_us(const std::string& src)
+{
+    ic_host_function functions[] = {nullptr};
+    ic_program program;
+    bool success = false;
+    int us = time_us(1, [&] { success = ic_program_init_compile(program, src.c_str(), IC_LIB_CORE, functions, nullptr, 0); });
+    assert(success);
+    ic_program_free(program);
+    return us;
+}
+
+static int run_program(ic_program& program)
+{
+    ic_vm vm;
+    ic_vm_init(vm);
+    int ret;
+    bool success = ic_vm_run(vm, program, ret);
+    assert(success);
+    ic_vm_free(vm);
+    return ret;
+}
+
+// compile time of expressions of a doubling size, every size should take about twice as long as the previous one
+void bench_expr(int max_terms)
+{
+    bench_sizes(8, max_terms, [](int terms) { return bench_source{generate_expr_program(terms), 0}; },
+        [](int terms, bench_source& source)
+        {
+            printf("terms: %6d  compilation time: %8d us\n", terms, compilation_time_us(source.text));
+        });
+}
+
+// compile time of programs with a doubling number of symbols of each kind
+void bench_symbols(int max_symbols)
+{
+    bench_sizes(256, max_symbols, [](int symbols) { return bench_source{generate_symbols_program(symbols), 0}; },
+        [](int symbols, bench_source& source)
+        {
+            printf("symbols: %6d  compilation time: %8d us\n", symbols, compilation_time_us(source.text));
+        });
+}
+
+// compiles, serializes, loads and runs programs with a doubling number of reachable functions (a multiple of 64);
+// peak memory is of the whole process, so it is the maximum over all sizes so far
+void bench_stress(int max_functions)
+{
+    ic_host_function functions[] = {nullptr};
+
+    bench_sizes(1024, max_functions, stress_source, [&](int size, bench_source& source)
+    {
+        ic_program program;
+        bool success = false;
+        int compile_us = time_us(1, [&]
+        {
+            success = ic_program_init_compile(program, source.text.c_str(), IC_LIB_CORE, functions, nullptr, IC_COMPILE_OPTIMIZE);
+        });
+        assert(success);
+        unsigned char* buf;
+        int buf_size;
+        ic_program_serialize(program, buf, buf_size);
+        ic_program_free(program);
+        int load_us = time_us(1, [&] { success = ic_program_init_load(program, buf, buf_size, IC_LIB_CORE, functions); });
+        assert(success);
+        ic_buf_free(buf);
+        bool ok = run_program(program) == source.expected;
+        ic_program_free(program);
+        printf("functions: %6d  bytecode: %8d B  compilation: %8d us  load: %6d us  peak memory: %7ld KB  %s\n", size, buf_size,
+            compile_us, load_us, peak_rss_kb(), ok ? "ok" : "WRONG RESULT");
+    });
+}
+
+// lexing throughput of a source replicated to at least 16 MB, the best of 5 runs
+void bench_lex(const char* source)
+{
+    std::string corpus;
+
+    while (corpus.size() < 16 * 1024 * 1024)
+    {
+        corpus += source;
+        corpus += "\n";
+    }
+    int best_us = -1;
+    int tokens = 0;
+
+    for (int run = 0; run < 5; ++run)
+    {
+        ic_memory memory;
+        memory.init();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        bool success = lex(corpus.c_str(), memory);
+        int us = elapsed_us(t1);
+        assert(success);
+        tokens = memory.token_types.size;
+        memory.free();
+        best_us = best_us == -1 || us < best_us ? us : best_us;
+    }
+    printf("bytes: %d  tokens: %d  lexing time: %d us  throughput: %.1f MB/s\n", (int)corpus.size(), tokens, best_us,
+        corpus.size() / (best_us / 1e6) / (1024 * 1024));
+}
+
+// a small script of the kind a host compiles many times per second
+static const char* _small_script = R"(
+struct vec2 { f32 x; f32 y; };
+
+f32 dot(vec2 a, vec2 b) { return a.x * b.x + a.y * b.y; }
+
+s32 main()
+{
+    vec2 v;
+    v.x = 1.0;
+    v.y = 2.0;
+    f32 sum = 0.0;
+
+    for (s32 i = 0; i < 10; i += 1)
+        sum += sqrt(dot(v, v)) + i;
+    return (s32)sum;
+}
+)";
+
+// compilations per second of a small script with a temporary context per compilation and with a single reused context
+void bench_context(int compiles)
+{
+    ic_host_function functions[] = {nullptr};
+    int temporary_us = time_us(1, [&]
+    {
+        for (int i = 0; i < compiles; ++i)
+        {
+            ic_program program;
+            bool success = ic_program_init_compile(program, _small_script, IC_LIB_CORE, functions, nullptr);
+            assert(success);
+            ic_program_free(program);
+        }
+    });
+    int reused_us = time_us(1, [&]
+    {
+        ic_compiler_context context;
+        bool success = ic_compiler_context_init(context, IC_LIB_CORE, functions, nullptr);
+        assert(success);
+
+        for (int i = 0; i < compiles; ++i)
+        {
+            ic_program program;
+            success = ic_program_init_compile(program, context, _small_script);
+            assert(success);
+            ic_program_free(program);
+        }
+        ic_compiler_context_free(context);
+    });
+    printf("compilations: %d  temporary context: %.2f us each  reused context: %.2f us each\n", compiles,
+        (double)temporary_us / compiles, (double)reused_us / compiles);
+}
+
+// the value main() of a stress program returns if the constant of every leaf function is increased by added[i]
+static int stress_program_result(int functions, const int* added)
+{
+    int x = 0;
+
+    for (int i = 0; i < functions; ++i)
+        x = (x * 31 + i % 997 + added[i]) % 1000;
+    return x;
+}
+
+static int compare_ints(const void* lhs, const void* rhs)
+{
+    return *(const int*)lhs - *(const int*)rhs;
+}
+
+// compile time of programs with a doubling number of functions: a full compilation, an incremental compilation without
+// previous chunks and incremental compilations after edits of single function bodies (each edit is applied to the
+// source of the previous one); every result is checked
+void bench_incremental(int max_functions)
+{
+    const int edits = 16;
+    ic_host_function functions[] = {nullptr};
+
+    bench_sizes(1024, max_functions, stress_source, [&](int size, bench_source& source)
+    {
+        int* added = (int*)calloc(size, sizeof(int));
+        ic_program program;
+        bool success = false;
+        int full_us = time_us(1, [&]
+        {
+            success = ic_program_init_compile(program, source.text.c_str(), IC_LIB_CORE, functions, nullptr, IC_COMPILE_OPTIMIZE);
+        });
+        assert(success);
+        bool ok = run_program(program) == source.expected;
+        ic_program_free(program);
+
+        ic_compiler_context context;
+        success = ic_compiler_context_init(context, IC_LIB_CORE, functions, nullptr);
+        assert(success);
+        int initial_us = time_us(1, [&]
+        {
+            success = ic_program_init_compile_incremental(program, context, source.text.c_str(), IC_COMPILE_OPTIMIZE);
+        });
+        assert(success);
+        ok = ok && run_program(program) == source.expected;
+        ic_program_free(program);
+        int edit_us[edits];
+
+        for (int i = 0; i < edits; ++i)
+        {
+            int fn = (size / 2 + i * 61) % size;
+            char buf[256];
+            snprintf(buf, sizeof(buf), "s32 fn%d(s32 x) { return (x * 31 + ", fn);
+            source.text.insert(source.text.find(buf) + strlen(buf), "1 + ");
+            added[fn] += 1;
+            edit_us[i] = time_us(1, [&]
+            {
+                success = ic_program_init_compile_incremental(program, context, source.text.c_str(), IC_COMPILE_OPTIMIZE);
+            });
+            assert(success);
+            ok = ok && run_program(program) == stress_program_result(size, added);
+            ic_program_free(program);
+        }
+        ic_compiler_context_free(context);
+        free(added);
+        qsort(edit_us, edits, sizeof(int), compare_ints);
+        printf("functions: %6d  full: %8d us  incremental initial: %8d us  after an edit: median %6d us, max %6d us  %s\n",
+            size, full_us, initial_us, edit_us[edits / 2], edit_us[edits - 1], ok ? "ok" : "WRONG RESULT");
+    });
+}
+
+// time to the first instruction of main() (compilation) and to the end of execution with all functions compiled up front
+// and with functions compiled on their first call; main() calls either a single group of 64 functions or all of them
+void bench_lazy(int max_functions)
+{
+    ic_host_function functions[] = {nullptr};
+    ic_compiler_context context;
+    bool success = ic_compiler_context_init(context, IC_LIB_CORE, functions, nullptr);
+    assert(success);
+
+    // a program that calls a single group is the first one
+    auto generate = [](int size)
+    {
+        std::vector<bench_source> sources(2);
+        sources[0].text = generate_stress_program(size, 1, &sources[0].expected);
+        sources[1] = stress_source(size);
+        return sources;
+    };
+    bench_sizes(1024, max_functions, generate, [&](int size, std::vector<bench_source>& sources)
+    {
+        for (int s = 0; s < 2; ++s)
+        {
+            printf("functions: %6d  called: %6d", size, s ? size : 64);
+
+            for (int lazy = 0; lazy < 2; ++lazy)
+            {
+                int flags = IC_COMPILE_OPTIMIZE | (lazy ? IC_COMPILE_LAZY : 0);
+                ic_program program;
+                bool ok = false;
+                int first_us = 0;
+                int total_us = time_us(1, [&]
+                {
+                    first_us = time_us(1, [&] { success = ic_program_init_compile(program, context, sources[s].text.c_str(), flags); });
+                    assert(success);
+                    ok = run_program(program) == sources[s].expected;
+                });
+                ic_program_free(program);
+                printf("  %s first instruction: %7d us  end: %7d us %s", lazy ? "lazy" : "eager", first_us,
+                    total_us, ok ? "ok" : "WRONG RESULT");
+            }
+            printf("\n");
+        }
+    });
+    ic_compiler_context_free(context);
+}
+
+// compile time with a doubling number of threads, the first compilation of a context starts its threads and is not
+// measured; the bytecode must be the same as the one compiled on a single thread
+void bench_parallel(int max_functions)
+{
+    ic_host_function functions[] = {nullptr};
+    printf("hardware threads: %d\n", (int)std::thread::hardware_concurrency());
+
+    bench_sizes(1024, max_functions, stress_source, [&](int size, bench_source& source)
+    {
+        ic_program serial_program;
+        printf("functions: %6d", size);
+
+        for (int threads = 1; threads <= 8; threads *= 2)
+        {
+            ic_compiler_context context;
+            bool success = ic_compiler_context_init(context, IC_LIB_CORE, functions, nullptr);
+            assert(success);
+            context.threads = threads;
+            ic_program program;
+            success = ic_program_init_compile(program, context, source.text.c_str(), IC_COMPILE_OPTIMIZE);
+            assert(success);
+            ic_program_free(program);
+            int us = time_us(1, [&] { success = ic_program_init_compile(program, context, source.text.c_str(), IC_COMPILE_OPTIMIZE); });
+            assert(success);
+            bool ok = run_program(program) == source.expected;
+
+            if (threads == 1)
+                serial_program = program;
+            else
+            {
+                ok = ok && program.bytecode_size == serial_program.bytecode_size &&
+                    !memcmp(program.bytecode, serial_program.bytecode, program.bytecode_size);
+                ic_program_free(program);
+            }
+            ic_compiler_context_free(context);
+            printf("  threads %d: %7d us %s", threads, us, ok ? "ok" : "WRONG RESULT");
+        }
+        ic_program_free(serial_program);
+        printf("\n");
+    });
+}
+
+static void host_noop(ic_data*, ic_data*, void*)
+{
+}
+
+// a program that calls every function of a host table, table entries point to prototypes
+struct host_binding_source
+{
+    std::vector<std::string> prototypes;
+    std::vector<ic_host_function> functions;
+    std::string text;
+};
+
+// load time of a program that calls every function of a host table with a doubling number of functions; host declarations
+// are parsed by the load call and by a context once
+void bench_host_binding(int max_functions)
+{
+    auto generate = [](int size)
+    {
+        host_binding_source source;
+        source.prototypes.resize(size);
+        source.functions.resize(size + 1);
+        source.text = "s32 main()\n{\n";
+        char buf[256];
+
+        for (int i = 0; i < size; ++i)
+        {
+            snprintf(buf, sizeof(buf), "void host_function%d(s32)", i);
+            source.prototypes[i] = buf;
+            source.functions[i] = {source.prototypes[i].c_str(), host_noop};
+            snprintf(buf, sizeof(buf), "    host_function%d(%d);\n", i, i);
+            source.text += buf;
+        }
+        source.text += "    return 0;\n}\n";
+        source.functions[size] = {nullptr};
+        return source;
+    };
+    bench_sizes(64, max_functions, generate, [](int size, host_binding_source& source)
+    {
+        ic_compiler_context context;
+        bool success = ic_compiler_context_init(context, IC_LIB_CORE, source.functions.data(), nullptr);
+        assert(success);
+        ic_program program;
+        success = ic_program_init_compile(program, context, source.text.c_str());
+        assert(success);
+        unsigned char* file;
+        int file_size;
+        ic_program_serialize(program, file, file_size);
+        ic_program_free(program);
+        int table_us = time_us(1, [&]
+        {
+            success = ic_program_init_load(program, file, file_size, IC_LIB_CORE, source.functions.data());
+        });
+        assert(success);
+        bool ok = run_program(program) == 0;
+        ic_program_free(program);
+        int context_us = time_us(1, [&] { success = ic_program_init_load(program, context, file, file_size); });
+        assert(success);
+        ok = ok && run_program(program) == 0;
+        ic_program_free(program);
+        ic_buf_free(file);
+        ic_compiler_context_free(context);
+        printf("host functions: %6d  load with a table: %6d us  with a context: %6d us  %s\n", size, table_us, context_us,
+            ok ? "ok" : "WRONG RESULT");
+    });
+}
+
+// verification time of programs with a doubling number of functions, the best of 5 runs, and the time per MB of bytecode
+void bench_verify(int max_functions)
+{
+    ic_host_function functions[] = {nullptr};
+
+    bench_sizes(1024, max_functions, stress_source, [&](int size, bench_source& source)
+    {
+        ic_program program;
+        bool success = ic_program_init_compile(program, source.text.c_str(), IC_LIB_CORE, functions, nullptr, IC_COMPILE_OPTIMIZE);
+        assert(success);
+        int us = time_us(5, [&]
+        {
+            success = verify_program(program);
+            assert(success);
+        });
+        int code_size = program.bytecode_size - program.strings_byte_size;
+        bool ok = run_program(program) == source.expected;
+        ic_program_free(program);
+        printf("functions: %6d  code: %8d B  verification: %6d us  %6d us/MB  %s\n", size, code_size, us,
+            (int)(us * (1024.0 * 1024.0) / code_size), ok ? "ok" : "WRONG RESULT");
+    });
+}
+
+std::vector<unsigned char> load_file(const char* name);
+void host_random01(ic_data*, ic_data* retv, void*);
+void host_read_file(ic_data* argv, ic_data*, void*);
+void host_write_ppm6(ic_data* argv, ic_data*, void*);
+void native_set_output_dir(const char* dir);
+int native_raytracer_main();
+int native_rasterizer_main();
+int native_fractal_main();
+int native_list_main();
+
+struct bench_workload
+{
+    const char* name;
+    const char* path;
+    int (*native_main)();
+};
+
+static bench_workload _workloads[] =
+{
+    {"raytracer", "test/raytracer.c", native_raytracer_main},
+    {"rasterizer", "test/rasterizer.c", native_rasterizer_main},
+    {"fractal", "test/fractal.c", native_fractal_main},
+    {"list", "test/list.c", native_list_main},
+};
+
+// output of programs is discarded while they are measured; returns a descriptor of the previous stdout, -1 on failure
+static int silence_stdout()
+{
+    fflush(stdout);
+#ifndef _WIN32
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    bool success = out != -1 && null != -1 && dup2(null, STDOUT_FILENO) != -1;
+#else
+    int out = _dup(_fileno(stdout));
+    int null = _open("NUL", _O_WRONLY);
+    bool success = out != -1 && null != -1 && _dup2(null, _fileno(stdout)) != -1;
+#endif
+
+    if (null != -1)
+        close(null);
+
+    if (!success && out != -1)
+    {
+        close(out);
+        out = -1;
+    }
+    return out;
+}
+
+static void restore_stdout(int out)
+{
+    if (out == -1)
+        return;
+    fflush(stdout);
+#ifndef _WIN32
+    dup2(out, STDOUT_FILENO);
+#else
+    _dup2(out, _fileno(stdout));
+#endif
+    close(out);
+}
+
+// a new temporary directory for files that programs write, an empty string on failure; paths use forward slashes, so they
+// can be printed in JSON
+static std::string make_output_dir()
+{
+#ifndef _WIN32
+    const char* tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/ic_bench_XXXXXX";
+    return mkdtemp(&dir[0]) ? dir : std::string();
+#else
+    char* name = _tempnam(nullptr, "ic_bench_");
+    std::string dir = name ? name : "";
+    free(name);
+
+    for (char& c : dir)
+        c = c == '\\' ? '/' : c;
+    return !dir.empty() && _mkdir(dir.c_str()) == 0 ? dir : std::string();
+#endif
+}
+
+// write_ppm6() of main.cpp with a file name in a directory passed as host data
+static void host_write_ppm6_in_dir(ic_data* argv, ic_data* retv, void* host_data)
+{
+    std::string path = std::string((const char*)host_data) + "/" + (const char*)argv[0].pointer;
+    ic_data args[4] = { argv[0], argv[1], argv[2], argv[3] };
+    args[0].pointer = &path[0];
+    host_write_ppm6(args, retv, nullptr);
+}
+
+struct bench_summary
+{
+    double median_ms;
+    double p95_ms;
+    double stddev_ms;
+};
+
+static int compare_times(const void* lhs, const void* rhs)
+{
+    int a = *(const int*)lhs;
+    int b = *(const int*)rhs;
+    return a < b ? -1 : (a > b);
+}
+
+// times are sorted; p95 is the nearest rank, stddev is of a sample
+static bench_summary summarize(std::vector<int>& times_us)
+{
+    qsort(times_us.data(), times_us.size(), sizeof(int), compare_times);
+    int size = times_us.size();
+    bench_summary summary;
+    summary.median_ms = (times_us[(size - 1) / 2] + times_us[size / 2]) / 2000.0;
+    summary.p95_ms = times_us[(size * 95 + 99) / 100 - 1] / 1000.0;
+    double mean = 0;
+
+    for (int us : times_us)
+        mean += us;
+    mean /= size;
+    double variance = 0;
+
+    for (int us : times_us)
+        variance += (us - mean) * (us - mean);
+    summary.stddev_ms = size > 1 ? sqrt(variance / (size - 1)) / 1000.0 : 0;
+    return summary;
+}
+
+// compile and execution times of the test programs and execution times of their native builds (bench_native.cpp) over
+// runs after warmup runs that are not measured; the same seed of rand() is set before each execution, so random01() gives
+// both builds the same work; images are written to a temporary directory, those of native builds have a "native_" prefix;
+// must be run from the repository root, rasterizer.c reads test/model.obj
+void bench_programs(int runs, int warmup, bool json)
+{
+    assert(runs > 0 && warmup >= 0);
+    std::string output_dir = make_output_dir();
+
+    if (output_dir.empty())
+    {
+        printf("error: can't create a temporary directory\n");
+        return;
+    }
+    ic_host_function functions[] =
+    {
+        {"void write_ppm6(const s8*, s32, s32, const u8*)", host_write_ppm6_in_dir, &output_dir[0]},
+        {"f64 random01()", host_random01},
+        {"void read_file(const s8*, u8**, s32*)", host_read_file},
+        nullptr
+    };
+    native_set_output_dir(output_dir.c_str());
+
+    if (json)
+        printf("{\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"output_dir\": \"%s\",\n  \"programs\": [", runs, warmup,
+            output_dir.c_str());
+    else
+        printf("runs: %d  warmup: %d  output: %s  times in ms\n%-12s %-8s %10s %10s %10s %10s\n", runs, warmup,
+            output_dir.c_str(), "program", "phase", "median", "p95", "stddev", "slowdown");
+
+    for (int w = 0; w < (int)(sizeof(_workloads) / sizeof(bench_workload)); ++w)
+    {
+        bench_workload& workload = _workloads[w];
+        std::vector<unsigned char> source = load_file(workload.path);
+        std::vector<int> compile_us;
+        std::vector<int> execute_us;
+        std::vector<int> native_us;
+        int out = silence_stdout();
+
+        for (int i = 0; i < warmup + runs; ++i)
+        {
+            ic_program program;
+            bool success = false;
+            int program_compile_us = time_us(1, [&]
+            {
+                success = ic_program_init_compile(program, (char*)source.data(), IC_LIB_CORE, functions, nullptr,
+                    IC_COMPILE_OPTIMIZE);
+            });
+            assert(success);
+            ic_vm vm;
+            ic_vm_init(vm);
+            srand(1);
+            int ret;
+            int program_execute_us = time_us(1, [&] { success = ic_vm_run(vm, program, ret); });
+            assert(success);
+            ic_vm_free(vm);
+            ic_program_free(program);
+            srand(1);
+            int program_native_us = time_us(1, [&] { workload.native_main(); });
+
+            if (i < warmup)
+                continue;
+            compile_us.push_back(program_compile_us);
+            execute_us.push_back(program_execute_us);
+            native_us.push_back(program_native_us);
+        }
+        restore_stdout(out);
+        bench_summary compile = summarize(compile_us);
+        bench_summary execute = summarize(execute_us);
+        bench_summary native = summarize(native_us);
+        double slowdown = native.median_ms ? execute.median_ms / native.median_ms : 0;
+
+        if (json)
+        {
+            printf("%s\n    {\"name\": \"%s\", \"slowdown\": %.2f", w ? "," : "", workload.name, slowdown);
+            const char* names[] = { "compile", "execute", "native" };
+            bench_summary* summaries[] = { &compile, &execute, &native };
+
+            for (int i = 0; i < 3; ++i)
+                printf(",\n     \"%s\": {\"median_ms\": %.3f, \"p95_ms\": %.3f, \"stddev_ms\": %.3f}", names[i],
+                    summaries[i]->median_ms, summaries[i]->p95_ms, summaries[i]->stddev_ms);
+            printf("}");
+        }
+        else
+        {
+            printf("%-12s %-8s %10.3f %10.3f %10.3f\n", workload.name, "compile", compile.median_ms, compile.p95_ms,
+                compile.stddev_ms);
+            printf("%-12s %-8s %10.3f %10.3f %10.3f %9.2fx\n", workload.name, "execute", execute.median_ms, execute.p95_ms,
+                execute.stddev_ms, slowdown);
+            printf("%-12s %-8s %10.3f %10.3f %10.3f\n", workload.name, "native", native.median_ms, native.p95_ms,
+                native.stddev_ms);
+        }
+        fflush(stdout);
+    }
+
+    if (json)
+        printf("\n  ]\n}\n");
+}
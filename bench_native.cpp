@@ -0,0 +1,50 @@
+#include "test/native.h"
+
+// native builds of the test programs, see bench_programs()
+
+const char* ic_native_lib::output_dir = ".";
+
+void native_set_output_dir(const char* dir)
+{
+    ic_native_lib::output_dir = dir;
+}
+
+struct native_raytracer : ic_native_lib
+{
+#include "test/raytracer.c"
+};
+
+struct native_rasterizer : ic_native_lib
+{
+#include "test/rasterizer.c"
+};
+
+struct native_fractal : ic_native_lib
+{
+#include "test/fractal.c"
+};
+
+struct native_list : ic_native_lib
+{
+#include "test/list.c"
+};
+
+int native_raytracer_main()
+{
+    return native_raytracer().main();
+}
+
+int native_rasterizer_main()
+{
+    return native_rasterizer().main();
+}
+
+int native_fractal_main()
+{
+    return native_fractal().main();
+}
+
+int native_list_main()
+{
+    return native_list().main();
+}
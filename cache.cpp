@@ -0,0 +1,110 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include "ic_impl.h"
+#ifdef _WIN32
+#include <process.h> // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h> // getpid
+#endif
+
+// a cache file is the key followed by a serialized program, the key is a hash of everything that determines the program;
+// bump the version on any change to the bytecode, the serialization or the core library
+#define IC_CACHE_VERSION 4
+
+static unsigned long long hash_str(unsigned long long hash, const char* str)
+{
+    return hash_bytes(hash, str, strlen(str) + 1); // including the terminator, so consecutive strings can't be merged
+}
+
+unsigned long long hash_declarations(int libs, ic_host_function* host_functions, const char* struct_decls)
+{
+    unsigned long long hash = IC_HASH_BASIS;
+    int version = IC_CACHE_VERSION;
+    int sizes[] = {(int)sizeof(void*), (int)sizeof(ic_program), (int)sizeof(ic_host_function)};
+    hash = hash_bytes(hash, &version, sizeof(int));
+    hash = hash_bytes(hash, sizes, sizeof(sizes));
+    hash = hash_bytes(hash, &libs, sizeof(int));
+
+    for (ic_host_function* it = host_functions; it && it->prototype_str; ++it)
+        hash = hash_str(hash, it->prototype_str);
+
+    hash = hash_str(hash, "");
+    return hash_str(hash, struct_decls ? struct_decls : "");
+}
+
+unsigned long long program_cache_key(const char* source, int flags, ic_memory& memory)
+{
+    unsigned long long hash = hash_bytes(memory.declarations_hash, &flags, sizeof(int));
+    return hash_str(hash, source);
+}
+
+// false if the path does not fit, a caller treats it as a cache miss
+static bool cache_file_path(char* path, int size, const char* cache_dir, unsigned long long key)
+{
+    int len = snprintf(path, size, "%s/%016llx.icp", cache_dir, key);
+    return len >= 0 && len < size;
+}
+
+bool load_cached_program(ic_program& program, const char* cache_dir, unsigned long long key, ic_memory& memory)
+{
+    char path[4096];
+
+    if (!cache_file_path(path, sizeof(path), cache_dir, key))
+        return false;
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bool valid = size >= (long)sizeof(key);
+    unsigned char* buf = nullptr;
+
+    if (valid)
+    {
+        buf = (unsigned char*)malloc(size);
+        valid = fread(buf, 1, size, file) == (size_t)size;
+    }
+    fclose(file);
+
+    // make sure a file is not written by something else, the loader checks the rest
+    if (valid)
+    {
+        unsigned long long file_key;
+        memcpy(&file_key, buf, sizeof(key));
+        valid = file_key == key && program_init_load(program, buf + sizeof(key), size - sizeof(key), memory.host_index);
+    }
+    free(buf);
+    return valid;
+}
+
+// a program is written to a temporary file first and renamed, so readers never see a partially written file
+void store_cached_program(ic_program& program, const char* cache_dir, unsigned long long key)
+{
+    char path[4096];
+    char tmp_path[4096];
+
+    if (!cache_file_path(path, sizeof(path), cache_dir, key))
+        return;
+    // unique for every process and every program being compiled
+    int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%p.tmp", path, (int)getpid(), (void*)&program);
+
+    if (len < 0 || len >= (int)sizeof(tmp_path))
+        return;
+    FILE* file = fopen(tmp_path, "wb");
+
+    if (!file)
+        return;
+    unsigned char* buf;
+    int size;
+    ic_program_serialize(program, buf, size);
+    bool success = fwrite(&key, sizeof(key), 1, file) == 1 && fwrite(buf, 1, size, file) == (size_t)size;
+    ic_buf_free(buf);
+    success = !fclose(file) && success;
+
+    // on Windows rename() fails if the file exists, then another process has already stored the same program
+    if (!success || rename(tmp_path, path))
+        remove(tmp_path);
+}
@@ -21,15 +21,15 @@ bool comparison_compatible_pointer_types(ic_type lhs, ic_type rhs)
 
 ic_expr_result compile_compound_assignment_mul_div(ic_expr* expr, ic_opcode opc_s32, ic_opcode opc_f32, ic_opcode opc_f64, ic_compiler& compiler)
 {
-    ic_expr_result lhs = compile_expr(expr->binary.lhs, compiler, false);
-    assert_modifiable_lvalue(lhs, compiler, expr->token);
+    ic_expr_result lhs = compile_expr(compiler.expr(expr->binary.lhs), compiler, false);
+    assert_modifiable_lvalue(lhs, compiler, compiler.token(expr->token));
     compiler.add_opcode(IC_OPC_CLONE);
     compile_load(lhs.type, compiler);
-    ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
-    ic_type atype = arithmetic_expr_type(lhs.type, rhs_type, compiler, expr->token);
-    compile_implicit_conversion(atype, lhs.type, compiler, expr->token);
-    compile_expr(expr->binary.rhs, compiler);
-    compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+    ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
+    ic_type atype = arithmetic_expr_type(lhs.type, rhs_type, compiler, compiler.token(expr->token));
+    compile_implicit_conversion(atype, lhs.type, compiler, compiler.token(expr->token));
+    compile_expr(compiler.expr(expr->binary.rhs), compiler);
+    compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
 
     switch (atype.basic_type)
     {
@@ -43,7 +43,7 @@ ic_expr_result compile_compound_assignment_mul_div(ic_expr* expr, ic_opcode opc_
         compiler.add_opcode(opc_f64);
         break;
     }
-    compile_implicit_conversion(lhs.type, atype, compiler, expr->token);
+    compile_implicit_conversion(lhs.type, atype, compiler, compiler.token(expr->token));
     compiler.add_opcode(IC_OPC_SWAP);
     compile_store(lhs.type, compiler);
     return { lhs.type, false };
@@ -52,33 +52,33 @@ ic_expr_result compile_compound_assignment_mul_div(ic_expr* expr, ic_opcode opc_
 ic_expr_result compile_compound_assignment_add_sub(ic_expr* expr, ic_opcode opc_s32, ic_opcode opc_f32, ic_opcode opc_f64, ic_opcode opc_ptr,
     ic_compiler& compiler)
 {
-    ic_expr_result lhs = compile_expr(expr->binary.lhs, compiler, false);
-    assert_modifiable_lvalue(lhs, compiler, expr->token);
+    ic_expr_result lhs = compile_expr(compiler.expr(expr->binary.lhs), compiler, false);
+    assert_modifiable_lvalue(lhs, compiler, compiler.token(expr->token));
     compiler.add_opcode(IC_OPC_CLONE);
     compile_load(lhs.type, compiler);
 
     if (lhs.type.indirection_level)
     {
-        ic_type rhs_type = compile_expr(expr->binary.rhs, compiler).type;
-        ic_type atype = arithmetic_expr_type(rhs_type, compiler, expr->token);
+        ic_type rhs_type = compile_expr(compiler.expr(expr->binary.rhs), compiler).type;
+        ic_type atype = arithmetic_expr_type(rhs_type, compiler, compiler.token(expr->token));
 
         if (atype.basic_type != IC_TYPE_S32)
-            compiler.set_error(expr->token, "only integer values can be added to a pointer");
-        compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+            compiler.set_error(compiler.token(expr->token), "only integer values can be added to a pointer");
+        compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
         int size = pointed_type_byte_size(lhs.type, compiler);
 
         if (!size)
-            compiler.set_error(expr->token, "void pointers can't be offset");
+            compiler.set_error(compiler.token(expr->token), "void pointers can't be offset");
         compiler.add_opcode(opc_ptr);
         compiler.add_s32(size);
     }
     else
     {
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
-        ic_type atype = arithmetic_expr_type(lhs.type, rhs_type, compiler, expr->token);
-        compile_implicit_conversion(atype, lhs.type, compiler, expr->token);
-        compile_expr(expr->binary.rhs, compiler);
-        compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
+        ic_type atype = arithmetic_expr_type(lhs.type, rhs_type, compiler, compiler.token(expr->token));
+        compile_implicit_conversion(atype, lhs.type, compiler, compiler.token(expr->token));
+        compile_expr(compiler.expr(expr->binary.rhs), compiler);
+        compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
 
         switch (atype.basic_type)
         {
@@ -92,7 +92,7 @@ ic_expr_result compile_compound_assignment_add_sub(ic_expr* expr, ic_opcode opc_
             compiler.add_opcode(opc_f64);
             break;
         }
-        compile_implicit_conversion(lhs.type, atype, compiler, expr->token);
+        compile_implicit_conversion(lhs.type, atype, compiler, compiler.token(expr->token));
     }
 
     compiler.add_opcode(IC_OPC_SWAP);
@@ -102,23 +102,23 @@ ic_expr_result compile_compound_assignment_add_sub(ic_expr* expr, ic_opcode opc_
 
 ic_expr_result compile_comparison(ic_expr* expr, ic_opcode opc_s32, ic_opcode opc_f32, ic_opcode opc_f64, ic_opcode opc_ptr, ic_compiler& compiler)
 {
-    ic_type lhs_type = compile_expr(expr->binary.lhs, compiler).type;
+    ic_type lhs_type = compile_expr(compiler.expr(expr->binary.lhs), compiler).type;
 
     if (lhs_type.indirection_level)
     {
-        ic_type rhs_type = compile_expr(expr->binary.rhs, compiler).type;
+        ic_type rhs_type = compile_expr(compiler.expr(expr->binary.rhs), compiler).type;
         
         if (!comparison_compatible_pointer_types(lhs_type, rhs_type))
-            compiler.set_error(expr->token, "comparison incompatible types");
+            compiler.set_error(compiler.token(expr->token), "comparison incompatible types");
         compiler.add_opcode(opc_ptr);
     }
     else
     {
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
-        ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, expr->token);
-        compile_implicit_conversion(atype, lhs_type, compiler, expr->token);
-        compile_expr(expr->binary.rhs, compiler);
-        compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
+        ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, compiler.token(expr->token));
+        compile_implicit_conversion(atype, lhs_type, compiler, compiler.token(expr->token));
+        compile_expr(compiler.expr(expr->binary.rhs), compiler);
+        compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
 
         switch (atype.basic_type)
         {
@@ -141,11 +141,11 @@ ic_expr_result compile_binary_arithmetic(ic_expr* expr, ic_type rhs_type, ic_opc
     ic_compiler& compiler)
 {
     assert(expr->type == IC_EXPR_BINARY);
-    ic_type lhs_type = compile_expr(expr->binary.lhs, compiler).type;
-    ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, expr->token);
-    compile_implicit_conversion(atype, lhs_type, compiler, expr->token);
-    compile_expr(expr->binary.rhs, compiler);
-    compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+    ic_type lhs_type = compile_expr(compiler.expr(expr->binary.lhs), compiler).type;
+    ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, compiler.token(expr->token));
+    compile_implicit_conversion(atype, lhs_type, compiler, compiler.token(expr->token));
+    compile_expr(compiler.expr(expr->binary.rhs), compiler);
+    compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
 
     switch (atype.basic_type)
     {
@@ -165,14 +165,14 @@ ic_expr_result compile_binary_arithmetic(ic_expr* expr, ic_type rhs_type, ic_opc
 ic_expr_result compile_binary_logical(ic_expr* expr, ic_opcode opc_jump, int value_early_jump, ic_compiler& compiler)
 {
     // lhs condition
-    ic_type lhs_type = compile_expr(expr->binary.lhs, compiler).type;
-    compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), lhs_type, compiler, expr->token);
+    ic_type lhs_type = compile_expr(compiler.expr(expr->binary.lhs), compiler).type;
+    compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), lhs_type, compiler, compiler.token(expr->token));
     compiler.add_opcode(opc_jump);
     int idx_resolve_condition = compiler.bc_size();
     compiler.add_s32({});
     // rhs condition
-    ic_type rhs_type = compile_expr(expr->binary.rhs, compiler).type;
-    compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), rhs_type, compiler, expr->token);
+    ic_type rhs_type = compile_expr(compiler.expr(expr->binary.rhs), compiler).type;
+    compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), rhs_type, compiler, compiler.token(expr->token));
     compiler.add_opcode(IC_OPC_JUMP);
     int idx_resolve_end = compiler.bc_size();
     compiler.add_s32({});
@@ -192,16 +192,16 @@ ic_expr_result compile_pointer_offset_expr(ic_expr* ptr_expr, ic_expr* offset_ex
 {
     ic_type ptr_type = compile_expr(ptr_expr, compiler).type;
     ic_type offset_type = compile_expr(offset_expr, compiler).type;
-    ic_type atype = arithmetic_expr_type(offset_type, compiler, offset_expr->token);
+    ic_type atype = arithmetic_expr_type(offset_type, compiler, compiler.token(offset_expr->token));
 
     if (atype.basic_type != IC_TYPE_S32)
-        compiler.set_error(offset_expr->token, "only integer values can be added to a pointer");
+        compiler.set_error(compiler.token(offset_expr->token), "only integer values can be added to a pointer");
 
-    compile_implicit_conversion(atype, offset_type, compiler, offset_expr->token);
+    compile_implicit_conversion(atype, offset_type, compiler, compiler.token(offset_expr->token));
     int size = pointed_type_byte_size(ptr_type, compiler);
 
     if (!size)
-        compiler.set_error(ptr_expr->token, "void pointers can't be offset");
+        compiler.set_error(compiler.token(ptr_expr->token), "void pointers can't be offset");
     compiler.add_opcode(opc);
     compiler.add_s32(size);
     return { ptr_type, false };
@@ -209,15 +209,15 @@ ic_expr_result compile_pointer_offset_expr(ic_expr* ptr_expr, ic_expr* offset_ex
 
 ic_expr_result compile_binary(ic_expr* expr, ic_compiler& compiler)
 {
-    switch (expr->token.type)
+    switch (compiler.token(expr->token).type)
     {
     case IC_TOK_EQUAL:
     {
-        ic_type lhs_type = get_expr_result_type(expr->binary.lhs, compiler); // this is needed to convert rhs before lhs lvalue is pushed
-        ic_type rhs_type = compile_expr(expr->binary.rhs, compiler).type;
-        compile_implicit_conversion(lhs_type, rhs_type, compiler, expr->token);
-        ic_expr_result lhs = compile_expr(expr->binary.lhs, compiler, false);
-        assert_modifiable_lvalue(lhs, compiler, expr->token);
+        ic_type lhs_type = get_expr_result_type(compiler.expr(expr->binary.lhs), compiler); // this is needed to convert rhs before lhs lvalue is pushed
+        ic_type rhs_type = compile_expr(compiler.expr(expr->binary.rhs), compiler).type;
+        compile_implicit_conversion(lhs_type, rhs_type, compiler, compiler.token(expr->token));
+        ic_expr_result lhs = compile_expr(compiler.expr(expr->binary.lhs), compiler, false);
+        assert_modifiable_lvalue(lhs, compiler, compiler.token(expr->token));
         compile_store(lhs.type, compiler);
         return { lhs_type, false };
     }
@@ -249,19 +249,19 @@ ic_expr_result compile_binary(ic_expr* expr, ic_compiler& compiler)
 
     case IC_TOK_PLUS:
     {
-        ic_type lhs_type = get_expr_result_type(expr->binary.lhs, compiler);
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
+        ic_type lhs_type = get_expr_result_type(compiler.expr(expr->binary.lhs), compiler);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
         // both ptr + 1 and 1 + ptr expressions are valid
         if (lhs_type.indirection_level)
-            return compile_pointer_offset_expr(expr->binary.lhs, expr->binary.rhs, IC_OPC_ADD_PTR_S32, compiler);
+            return compile_pointer_offset_expr(compiler.expr(expr->binary.lhs), compiler.expr(expr->binary.rhs), IC_OPC_ADD_PTR_S32, compiler);
         if (rhs_type.indirection_level)
-            return compile_pointer_offset_expr(expr->binary.rhs, expr->binary.lhs, IC_OPC_ADD_PTR_S32, compiler);
+            return compile_pointer_offset_expr(compiler.expr(expr->binary.rhs), compiler.expr(expr->binary.lhs), IC_OPC_ADD_PTR_S32, compiler);
         return compile_binary_arithmetic(expr, rhs_type, IC_OPC_ADD_S32, IC_OPC_ADD_F32, IC_OPC_ADD_F64, compiler);
     }
     case IC_TOK_MINUS:
     {
-        ic_type lhs_type = get_expr_result_type(expr->binary.lhs, compiler);
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
+        ic_type lhs_type = get_expr_result_type(compiler.expr(expr->binary.lhs), compiler);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
         // 1 - ptr is not a valid expression; ptr - ptr is valid
 
         if (lhs_type.indirection_level && rhs_type.indirection_level)
@@ -272,44 +272,44 @@ ic_expr_result compile_binary(ic_expr* expr, ic_compiler& compiler)
                 match = lhs_type._struct == rhs_type._struct;
 
             if(!match)
-                compiler.set_error(expr->token, "incompatible pointer types");
+                compiler.set_error(compiler.token(expr->token), "incompatible pointer types");
 
-            compile_expr(expr->binary.lhs, compiler);
-            compile_expr(expr->binary.rhs, compiler);
+            compile_expr(compiler.expr(expr->binary.lhs), compiler);
+            compile_expr(compiler.expr(expr->binary.rhs), compiler);
             compiler.add_opcode(IC_OPC_SUB_PTR_PTR);
             int size = pointed_type_byte_size(lhs_type, compiler);
 
             if (!size)
-                compiler.set_error(expr->token, "void pointers can't be subtracted");
+                compiler.set_error(compiler.token(expr->token), "void pointers can't be subtracted");
             compiler.add_s32(size);
             return { non_pointer_type(IC_TYPE_S32), false };
         }
 
         if (lhs_type.indirection_level)
-            return compile_pointer_offset_expr(expr->binary.lhs, expr->binary.rhs, IC_OPC_SUB_PTR_S32, compiler);
+            return compile_pointer_offset_expr(compiler.expr(expr->binary.lhs), compiler.expr(expr->binary.rhs), IC_OPC_SUB_PTR_S32, compiler);
         return compile_binary_arithmetic(expr, rhs_type, IC_OPC_SUB_S32, IC_OPC_SUB_F32, IC_OPC_SUB_F64, compiler);
     }
     case IC_TOK_STAR:
     {
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
         return compile_binary_arithmetic(expr, rhs_type, IC_OPC_MUL_S32, IC_OPC_MUL_F32, IC_OPC_MUL_F64, compiler);
     }
     case IC_TOK_SLASH:
     {
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
         return compile_binary_arithmetic(expr, rhs_type, IC_OPC_DIV_S32, IC_OPC_DIV_F32, IC_OPC_DIV_F64, compiler);
     }
     case IC_TOK_PERCENT:
     {
-        ic_type lhs_type = compile_expr(expr->binary.lhs, compiler).type;
-        ic_type rhs_type = get_expr_result_type(expr->binary.rhs, compiler);
-        ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, expr->token);
+        ic_type lhs_type = compile_expr(compiler.expr(expr->binary.lhs), compiler).type;
+        ic_type rhs_type = get_expr_result_type(compiler.expr(expr->binary.rhs), compiler);
+        ic_type atype = arithmetic_expr_type(lhs_type, rhs_type, compiler, compiler.token(expr->token));
 
         if (atype.basic_type != IC_TYPE_S32)
-            compiler.set_error(expr->token, "expected an integer type expression");
-        compile_implicit_conversion(atype, lhs_type, compiler, expr->token);
-        compile_expr(expr->binary.rhs, compiler);
-        compile_implicit_conversion(atype, rhs_type, compiler, expr->token);
+            compiler.set_error(compiler.token(expr->token), "expected an integer type expression");
+        compile_implicit_conversion(atype, lhs_type, compiler, compiler.token(expr->token));
+        compile_expr(compiler.expr(expr->binary.rhs), compiler);
+        compile_implicit_conversion(atype, rhs_type, compiler, compiler.token(expr->token));
         compiler.add_opcode(IC_OPC_MODULO_S32);
         return { atype, false };
     }
@@ -19,13 +19,13 @@ ic_expr_result compile_dereference(ic_type type, ic_compiler& compiler, bool loa
 
 ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lvalue)
 {
-    switch (expr->token.type)
+    switch (compiler.token(expr->token).type)
     {
     case IC_TOK_MINUS:
     {
-        ic_type type = compile_expr(expr->unary.expr, compiler).type;
-        ic_type atype = arithmetic_expr_type(type, compiler, expr->token);
-        compile_implicit_conversion(atype, type, compiler, expr->token);
+        ic_type type = compile_expr(compiler.expr(expr->unary.expr), compiler).type;
+        ic_type atype = arithmetic_expr_type(type, compiler, compiler.token(expr->token));
+        compile_implicit_conversion(atype, type, compiler, compiler.token(expr->token));
 
         switch (atype.basic_type)
         {
@@ -43,8 +43,8 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
     }
     case IC_TOK_BANG:
     {
-        ic_type type = compile_expr(expr->unary.expr, compiler).type;
-        compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), type, compiler, expr->token);
+        ic_type type = compile_expr(compiler.expr(expr->unary.expr), compiler).type;
+        compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), type, compiler, compiler.token(expr->token));
         compiler.add_opcode(IC_LOGICAL_NOT);
         return { non_pointer_type(IC_TYPE_BOOL), false };
     }
@@ -52,9 +52,9 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
     case IC_TOK_MINUS_MINUS:
     {
         // this is quite a complicated operation
-        int add_value = expr->token.type == IC_TOK_PLUS_PLUS ? 1 : -1;
-        ic_expr_result result = compile_expr(expr->unary.expr, compiler, false);
-        assert_modifiable_lvalue(result, compiler, expr->token);
+        int add_value = compiler.token(expr->token).type == IC_TOK_PLUS_PLUS ? 1 : -1;
+        ic_expr_result result = compile_expr(compiler.expr(expr->unary.expr), compiler, false);
+        assert_modifiable_lvalue(result, compiler, compiler.token(expr->token));
         compiler.add_opcode(IC_OPC_CLONE);
         compiler.add_opcode(IC_OPC_CLONE);
         compile_load(result.type, compiler);
@@ -64,7 +64,7 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
             int size = pointed_type_byte_size(result.type, compiler);
             
             if (!size)
-                compiler.set_error(expr->token, "void pointers can't be incremented / decremented");
+                compiler.set_error(compiler.token(expr->token), "void pointers can't be incremented / decremented");
             compiler.add_opcode(IC_OPC_PUSH_S32);
             compiler.add_s32(add_value);
             compiler.add_opcode(IC_OPC_ADD_PTR_S32);
@@ -72,8 +72,8 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
         }
         else
         {
-            ic_type atype = arithmetic_expr_type(result.type, compiler, expr->token);
-            compile_implicit_conversion(atype, result.type, compiler, expr->token);
+            ic_type atype = arithmetic_expr_type(result.type, compiler, compiler.token(expr->token));
+            compile_implicit_conversion(atype, result.type, compiler, compiler.token(expr->token));
 
             switch (atype.basic_type)
             {
@@ -93,7 +93,7 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
                 compiler.add_opcode(IC_OPC_ADD_F64);
                 break;
             }
-            compile_implicit_conversion(result.type, atype, compiler, expr->token);
+            compile_implicit_conversion(result.type, atype, compiler, compiler.token(expr->token));
         }
         compiler.add_opcode(IC_OPC_SWAP);
         compile_store(result.type, compiler);
@@ -109,18 +109,18 @@ ic_expr_result compile_unary(ic_expr* expr, ic_compiler& compiler, bool load_lva
     }
     case IC_TOK_AMPERSAND:
     {
-        ic_expr_result result = compile_expr(expr->unary.expr, compiler, false);
+        ic_expr_result result = compile_expr(compiler.expr(expr->unary.expr), compiler, false);
 
         if (!result.lvalue)
-            compiler.set_error(expr->token, "expected an lvalue expression");
+            compiler.set_error(compiler.token(expr->token), "expected an lvalue expression");
         result.type.indirection_level += 1;
         result.type.const_mask = result.type.const_mask << 1;
         return { result.type, false };
     }
     case IC_TOK_STAR:
     {
-        ic_type type = compile_expr(expr->unary.expr, compiler).type;
-        return compile_dereference(type, compiler, load_lvalue, expr->token);
+        ic_type type = compile_expr(compiler.expr(expr->unary.expr), compiler).type;
+        return compile_dereference(type, compiler, load_lvalue, compiler.token(expr->token));
     }
     default:
         assert(false);
@@ -8,6 +8,7 @@ bool compile_function(ic_function& function, ic_memory& memory, bool code_gen)
     assert(!memory.break_ops.size);
     assert(!memory.cont_ops.size);
     function.instr_idx = memory.bytecode.size;
+    memory.frame_vars.clear();
     ic_compiler compiler;
     compiler.memory = &memory;
     compiler.function = &function;
@@ -27,16 +28,13 @@ bool compile_function(ic_function& function, ic_memory& memory, bool code_gen)
         
         if (param.name.data)
         {
-            for (int x = 0; x < memory.vars.size; ++x)
-            {
-                if (string_compare(memory.vars.buf[x].name, param.name))
-                    compiler.set_error(function.token, "each parameter must have a unique identifier"); // todo, param.token would be better
-            }
             ic_var var;
             var.type = param.type;
             var.byte_idx = param_byte_idx;
             var.name = param.name;
-            memory.vars.push_back(var);
+
+            if (!compiler.push_var(var))
+                compiler.set_error(function.token, "each parameter must have a unique identifier"); // todo, param.token would be better
         }
         else
             compiler.warn(function.token, "unused function parameter"); // same
@@ -44,10 +42,11 @@ bool compile_function(ic_function& function, ic_memory& memory, bool code_gen)
 
     compiler.return_byte_idx = param_byte_idx - type_data_size(function.return_type) * sizeof(ic_data);
     // allocate stack space for local variables; todo, don't emit instruction if stack size is 0
+    compiler.mark_line(function.token);
     compiler.add_opcode(IC_OPC_PUSH_MANY);
     int idx_resolve_push = compiler.bc_size();
     compiler.add_s32({});
-    ic_stmt_result result = compile_stmt(function.body, compiler);
+    ic_stmt_result result = compile_stmt(compiler.stmt(function.body), compiler);
     compiler.pop_scope();
     compiler.bc_set_int(idx_resolve_push, bytes_to_data_size(compiler.max_stack_byte_size));
 
@@ -57,6 +56,13 @@ bool compile_function(ic_function& function, ic_memory& memory, bool code_gen)
     if(is_void(function.return_type) && result != IC_STMT_RESULT_RETURN)
         compiler.add_opcode(IC_OPC_RETURN);
 
+    // a row of a statement without code at the end, rows of a function must not point past it
+    while (code_gen && memory.lines.size && memory.lines.back().offset == compiler.bc_size())
+        memory.lines.pop_back();
+
+    if (code_gen && !compiler.error && (memory.flags & (IC_COMPILE_OPTIMIZE | IC_COMPILE_PRINT_IR)))
+        optimize_function(function, memory);
+
     return !compiler.error;
 }
 
@@ -64,6 +70,9 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
 {
     assert(stmt);
 
+    if (stmt->type != IC_STMT_COMPOUND)
+        compiler.mark_line(compiler.token(stmt->token));
+
     switch (stmt->type)
     {
     case IC_STMT_COMPOUND:
@@ -71,7 +80,7 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
         if (stmt->compound.push_scope)
             compiler.push_scope();
 
-        ic_stmt* stmt_it = stmt->compound.body;
+        ic_stmt* stmt_it = compiler.stmt(stmt->compound.body);
         ic_stmt_result result = IC_STMT_RESULT_NULL;
         int prev_gen_bc = compiler.code_gen;
 
@@ -85,10 +94,10 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
                 if (stmt_it->next) // if this is not the last statement of a compound statement
                 {
                     compiler.code_gen = false; // don't generate unreachable code, but compile for correctness
-                    compiler.warn(stmt_it->next->token, "unreachable code");
+                    compiler.warn(compiler.token(compiler.stmt(stmt_it->next)->token), "unreachable code");
                 }
             }
-            stmt_it = stmt_it->next;
+            stmt_it = compiler.stmt(stmt_it->next);
         }
 
         if (stmt->compound.push_scope)
@@ -105,27 +114,29 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
         compiler.push_scope();
 
         if (stmt->_for.header1)
-            compile_stmt(stmt->_for.header1, compiler);
+            compile_stmt(compiler.stmt(stmt->_for.header1), compiler);
 
         int idx_begin = compiler.bc_size();
         int idx_resolve_end;
 
         if (stmt->_for.header2)
         {
+            compiler.mark_line(compiler.token(compiler.expr(stmt->_for.header2)->token));
             // no need to pop result, JUMP_FALSE instr pops it
-            ic_expr_result result = compile_expr(stmt->_for.header2, compiler);
-            compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), result.type, compiler, stmt->_for.header2->token);
+            ic_expr_result result = compile_expr(compiler.expr(stmt->_for.header2), compiler);
+            compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), result.type, compiler, compiler.token(compiler.expr(stmt->_for.header2)->token));
             compiler.add_opcode(IC_OPC_JUMP_FALSE);
             idx_resolve_end = compiler.bc_size();
             compiler.add_s32({});
         }
 
-        ic_stmt_result result = compile_stmt(stmt->_for.body, compiler);
+        ic_stmt_result result = compile_stmt(compiler.stmt(stmt->_for.body), compiler);
         int idx_continue = compiler.bc_size();
 
         if (stmt->_for.header3)
         {
-            ic_expr_result result = compile_expr(stmt->_for.header3, compiler);
+            compiler.mark_line(compiler.token(compiler.expr(stmt->_for.header3)->token));
+            ic_expr_result result = compile_expr(compiler.expr(stmt->_for.header3), compiler);
             compile_pop_expr_result(result, compiler);
         }
 
@@ -153,13 +164,13 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
         ic_stmt_result result_if;
         ic_stmt_result result_else = IC_STMT_RESULT_NULL;
         // no need to pop result, JUMP_FALSE instr pops it
-        ic_expr_result result = compile_expr(stmt->_if.header, compiler); // no need to push a scope here, expr can't declare a new variable
-        compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), result.type, compiler, stmt->_if.header->token);
+        ic_expr_result result = compile_expr(compiler.expr(stmt->_if.header), compiler); // no need to push a scope here, expr can't declare a new variable
+        compile_implicit_conversion(non_pointer_type(IC_TYPE_BOOL), result.type, compiler, compiler.token(compiler.expr(stmt->_if.header)->token));
         compiler.add_opcode(IC_OPC_JUMP_FALSE);
         int idx_resolve_else = compiler.bc_size();
         compiler.add_s32({});
         compiler.push_scope();
-        result_if = compile_stmt(stmt->_if.body_if, compiler);
+        result_if = compile_stmt(compiler.stmt(stmt->_if.body_if), compiler);
         compiler.pop_scope();
         int idx_else;
 
@@ -170,7 +181,7 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
             compiler.add_s32({});
             idx_else = compiler.bc_size();
             compiler.push_scope();
-            result_else = compile_stmt(stmt->_if.body_else, compiler);
+            result_else = compile_stmt(compiler.stmt(stmt->_if.body_else), compiler);
             compiler.pop_scope();
             int idx_end = compiler.bc_size();
             compiler.bc_set_int(idx_resolve_end, idx_end);
@@ -183,12 +194,12 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
     }
     case IC_STMT_VAR_DECL:
     {
-        ic_var var = compiler.declare_var(stmt->var_decl.type, stmt->var_decl.token.string, stmt->var_decl.token);
+        ic_var var = compiler.declare_var(stmt->var_decl.type, compiler.token(stmt->var_decl.token).string, compiler.token(stmt->var_decl.token));
 
         if (stmt->var_decl.expr)
         {
-            ic_expr_result result = compile_expr(stmt->var_decl.expr, compiler);
-            compile_implicit_conversion(var.type, result.type, compiler, stmt->token);
+            ic_expr_result result = compile_expr(compiler.expr(stmt->var_decl.expr), compiler);
+            compile_implicit_conversion(var.type, result.type, compiler, compiler.token(stmt->token));
             compiler.add_opcode(IC_OPC_ADDRESS);
             compiler.add_s32(var.byte_idx);
 
@@ -204,7 +215,7 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
             compile_pop_expr_result(result, compiler);
         }
         else if (var.type.const_mask & 1)
-            compiler.set_error(stmt->token, "const variable must be initialized");
+            compiler.set_error(compiler.token(stmt->token), "const variable must be initialized");
 
         return IC_STMT_RESULT_NULL;
     }
@@ -214,15 +225,15 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
 
         if (stmt->_return.expr)
         {
-            ic_expr_result result = compile_expr(stmt->_return.expr, compiler);
-            compile_implicit_conversion(return_type, result.type, compiler, stmt->token);
+            ic_expr_result result = compile_expr(compiler.expr(stmt->_return.expr), compiler);
+            compile_implicit_conversion(return_type, result.type, compiler, compiler.token(stmt->token));
             compiler.add_opcode(IC_OPC_ADDRESS);
             compiler.add_s32(compiler.return_byte_idx);
             compile_store(return_type, compiler); // store return value in a space allocated by a caller
             compile_pop_expr_result({ return_type, false }, compiler);
         }
         else if (!is_void(return_type))
-            compiler.set_error(stmt->token, "function with a non-void return type must return a value");
+            compiler.set_error(compiler.token(stmt->token), "function with a non-void return type must return a value");
 
         compiler.add_opcode(IC_OPC_RETURN);
         return IC_STMT_RESULT_RETURN;
@@ -231,7 +242,7 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
     case IC_STMT_CONTINUE:
     {
         if (!compiler.loop_count)
-            compiler.set_error(stmt->token, "break / continue statements can be used only inside loops");
+            compiler.set_error(compiler.token(stmt->token), "break / continue statements can be used only inside loops");
 
         compiler.add_opcode(IC_OPC_JUMP);
 
@@ -246,7 +257,7 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
     {
         if (stmt->expr)
         {
-            ic_expr_result result = compile_expr(stmt->expr, compiler);
+            ic_expr_result result = compile_expr(compiler.expr(stmt->expr), compiler);
             compile_pop_expr_result(result, compiler);
         }
         return IC_STMT_RESULT_NULL;
@@ -257,10 +268,8 @@ ic_stmt_result compile_stmt(ic_stmt* stmt, ic_compiler& compiler)
     return {};
 }
 
-ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lvalue)
+ic_expr_result compile_expr_impl(ic_expr* expr, ic_compiler& compiler, bool load_lvalue)
 {
-    assert(expr);
-
     switch (expr->type)
     {
     case IC_EXPR_BINARY:
@@ -279,41 +288,41 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
     }
     case IC_EXPR_CAST_OPERATOR:
     {
-        ic_expr_result result = compile_expr(expr->cast_operator.expr, compiler);
+        ic_expr_result result = compile_expr(compiler.expr(expr->cast_operator.expr), compiler);
         ic_type target_type = expr->cast_operator.type;
 
         if (target_type.indirection_level)
         {
             if (!result.type.indirection_level)
-                compiler.set_error(expr->token, "pointer types can't be casted to non-pointer types");
+                compiler.set_error(compiler.token(expr->token), "pointer types can't be casted to non-pointer types");
         }
         else
-            compile_implicit_conversion(target_type, result.type, compiler, expr->token);
+            compile_implicit_conversion(target_type, result.type, compiler, compiler.token(expr->token));
 
         return { target_type, false };
     }
     case IC_EXPR_SUBSCRIPT:
     {
-        ic_type lhs_type = get_expr_result_type(expr->subscript.lhs, compiler);
+        ic_type lhs_type = get_expr_result_type(compiler.expr(expr->subscript.lhs), compiler);
         ic_type result_type;
         if (lhs_type.indirection_level)
-            result_type = compile_pointer_offset_expr(expr->subscript.lhs, expr->subscript.rhs, IC_OPC_ADD_PTR_S32, compiler).type;
+            result_type = compile_pointer_offset_expr(compiler.expr(expr->subscript.lhs), compiler.expr(expr->subscript.rhs), IC_OPC_ADD_PTR_S32, compiler).type;
         else
-            result_type = compile_pointer_offset_expr(expr->subscript.rhs, expr->subscript.lhs, IC_OPC_ADD_PTR_S32, compiler).type;
-        return compile_dereference(result_type, compiler, load_lvalue, expr->token);
+            result_type = compile_pointer_offset_expr(compiler.expr(expr->subscript.rhs), compiler.expr(expr->subscript.lhs), IC_OPC_ADD_PTR_S32, compiler).type;
+        return compile_dereference(result_type, compiler, load_lvalue, compiler.token(expr->token));
     }
     case IC_EXPR_MEMBER_ACCESS:
     {
         ic_expr_result result;
 
-        switch (expr->token.type)
+        switch (compiler.token(expr->token).type)
         {
         case IC_TOK_DOT:
-            result = compile_expr(expr->member_access.lhs, compiler, false);
+            result = compile_expr(compiler.expr(expr->member_access.lhs), compiler, false);
             break;
         case IC_TOK_ARROW:
-            result = compile_expr(expr->member_access.lhs, compiler);
-            result = compile_dereference(result.type, compiler, false, expr->token);
+            result = compile_expr(compiler.expr(expr->member_access.lhs), compiler);
+            result = compile_dereference(result.type, compiler, false, compiler.token(expr->token));
             break;
         default:
             assert(false);
@@ -321,7 +330,7 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
 
         if (!is_struct(result.type))
         {
-            compiler.set_error(expr->token, "member access operators can be used only on structs and struct pointers");
+            compiler.set_error(compiler.token(expr->token), "member access operators can be used only on structs and struct pointers");
             // return to not dereference an invalid struct pointer
             // it is important to not return a STRUCT type which could result in an invalid pointer dereference further in the execution
             return { non_pointer_type(IC_TYPE_S32), false };
@@ -331,7 +340,7 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
         ic_type target_type = non_pointer_type(IC_TYPE_S32);
 
         ic_struct* _struct = result.type._struct;
-        ic_string target_name = expr->member_access.rhs_token.string;
+        ic_string target_name = compiler.token(expr->member_access.rhs_token).string;
         int byte_offset = 0;
         bool match = false;
 
@@ -351,7 +360,7 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
         }
 
         if(!match)
-            compiler.set_error(expr->token, "an invalid struct member name");
+            compiler.set_error(compiler.token(expr->token), "an invalid struct member name");
         if (result.lvalue)
         {
             // todo, don't pollute the codebase with if statements, this could be handled by some optimization pass
@@ -393,13 +402,13 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
     }
     case IC_EXPR_PARENTHESES:
     {
-        return compile_expr(expr->parentheses.expr, compiler, load_lvalue);
+        return compile_expr(compiler.expr(expr->parentheses.expr), compiler, load_lvalue);
     }
     case IC_EXPR_FUNCTION_CALL:
     {
         int argc = 0;
         int idx;
-        ic_function* function = compiler.get_function(expr->token.string, &idx, expr->token);
+        ic_function* function = compiler.get_function(compiler.token(expr->token).string, &idx, compiler.token(expr->token));
 
         int return_size = type_data_size(function->return_type);
         // allocate space for a return value, this is a part of a VM calling convention
@@ -412,19 +421,19 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
         }
 
         int param_size = 0;
-        ic_expr* expr_arg = expr->function_call.arg;
+        ic_expr* expr_arg = compiler.expr(expr->function_call.arg);
 
         while (expr_arg)
         {
             ic_type arg_type = compile_expr(expr_arg, compiler).type;
             ic_type param_type = function->params[argc].type;
-            compile_implicit_conversion(param_type, arg_type, compiler, expr_arg->token);
-            expr_arg = expr_arg->next;
+            compile_implicit_conversion(param_type, arg_type, compiler, compiler.token(expr_arg->token));
+            expr_arg = compiler.expr(expr_arg->next);
             ++argc;
             param_size += type_data_size(param_type);
         }
         if (argc != function->param_count)
-            compiler.set_error(expr->token, "the number of arguments does not match the number of parameters");
+            compiler.set_error(compiler.token(expr->token), "the number of arguments does not match the number of parameters");
 
         if (function->type == IC_FUN_SOURCE)
         {
@@ -444,14 +453,14 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
     }
     case IC_EXPR_PRIMARY:
     {
-        ic_token token = expr->token;
+        ic_token token = compiler.token(expr->token);
 
         switch (token.type)
         {
         case IC_TOK_IDENTIFIER:
         {
-            bool is_global;
-            ic_var var = compiler.get_var(token.string, &is_global, expr->token);
+            bool is_global = false;
+            ic_var var = compiler.get_var(token.string, &is_global, token);
             compiler.add_opcode(is_global ? IC_OPC_ADDRESS_GLOBAL : IC_OPC_ADDRESS);
             compiler.add_s32(var.byte_idx);
 
@@ -483,7 +492,7 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
             return { non_pointer_type(IC_TYPE_F64), false };
 
         case IC_TOK_STRING_LITERAL:
-            compiler.add_opcode(IC_OPC_ADDRESS_GLOBAL);
+            compiler.add_opcode(IC_OPC_ADDRESS_STRING);
             compiler.add_s32(token.number);
             return { const_pointer1_type(IC_TYPE_S8), false };
 
@@ -496,3 +505,21 @@ ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lval
     }
     return {};
 }
+
+ic_expr_result compile_expr(ic_expr* expr, ic_compiler& compiler, bool load_lvalue)
+{
+    assert(expr);
+
+    // a type query of an already compiled expression, without this nested operands are recompiled for every enclosing query
+    if (!compiler.code_gen && load_lvalue && expr->annotated)
+        return { expr->result_type, false };
+
+    ic_expr_result result = compile_expr_impl(expr, compiler, load_lvalue);
+
+    if (load_lvalue)
+    {
+        expr->result_type = result.type;
+        expr->annotated = true;
+    }
+    return result;
+}
@@ -1,14 +1,17 @@
 #include <stdio.h>
 #include "ic_impl.h"
 
-void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_byte_size);
+// lines are optional, then function names and source lines are printed before instructions; so are stats, then execution
+// counts are printed after offsets
+void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_byte_size, ic_line_map* lines,
+    ic_vm_stats* stats);
 
-void ic_program_print_disassembly(ic_program& program)
+void ic_program_print_disassembly(ic_program& program, ic_vm_stats* stats)
 {
     printf("host_functions_size: %d\n", program.host_functions_size);
     printf("bytecode_size (includes strings): %d\n", program.bytecode_size);
     printf("strings_byte_size: %d\n", program.strings_byte_size);
-    printf("global_data_byte_size (includes strings): %d\n", program.global_data_byte_size);
+    printf("global_data_byte_size: %d\n", program.global_data_byte_size);
     printf("strings: ");
     int str_idx = 0;
 
@@ -32,17 +35,43 @@ void ic_program_print_disassembly(ic_program& program)
         printf("param_size: %d\n\n", fun.param_size);
     }
 
-    print_instructions(program.bytecode, program.bytecode_size, program.strings_byte_size);
+    ic_line_map lines;
+    lines.init();
+    bool has_lines = lines.build(program);
+    print_instructions(program.bytecode, program.bytecode_size, program.strings_byte_size, has_lines ? &lines : nullptr,
+        stats);
+    lines.free();
 }
 
-void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_byte_size)
+void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_byte_size, ic_line_map* lines,
+    ic_vm_stats* stats)
 {
     printf("instructions:\n");
     unsigned char* it = bytecode + strings_byte_size;
+    int function = 0;
+    int row = 0;
 
     while (it < bytecode + bytecode_size)
     {
-        printf("%-8d", (int)(it - bytecode));
+        int offset = it - bytecode;
+
+        if (lines)
+        {
+            for (; function < lines->functions.size && lines->functions.buf[function].offset <= offset; ++function)
+                printf("\n%s:\n", lines->name(function));
+
+            int line = 0;
+
+            for (; row < lines->rows.size && lines->rows.buf[row].offset <= offset; ++row)
+                line = lines->rows.buf[row].line;
+
+            if (line)
+                printf("        // line %d\n", line);
+        }
+        printf("%-8d", offset);
+
+        if (stats)
+            printf("%12llu  ", offset < stats->offsets.size ? stats->offsets.buf[offset] : 0ull);
         ic_opcode opcode = (ic_opcode)*it;
         ++it;
 
@@ -96,6 +125,9 @@ void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_
         case IC_OPC_CALL_HOST:
             printf("call_host %d", read_int(&it));
             break;
+        case IC_OPC_CALL_LAZY:
+            printf("call_lazy %d", read_int(&it));
+            break;
         case IC_OPC_RETURN:
             printf("return");
             break;
@@ -117,6 +149,9 @@ void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_
         case IC_OPC_ADDRESS_GLOBAL:
             printf("address_global %d", read_int(&it));
             break;
+        case IC_OPC_ADDRESS_STRING:
+            printf("address_string %d", read_int(&it));
+            break;
         case IC_OPC_STORE_1:
             printf("store_1");
             break;
@@ -177,6 +212,12 @@ void print_instructions(unsigned char* bytecode, int bytecode_size, int strings_
         case IC_OPC_MODULO_S32:
             printf("modulo_s32");
             break;
+        case IC_OPC_SHL_S32:
+            printf("shl_s32 %d", read_int(&it));
+            break;
+        case IC_OPC_SHR_S32:
+            printf("shr_s32 %d", read_int(&it));
+            break;
         case IC_OPC_COMPARE_E_F32:
             printf("compare_e_f32");
             break;
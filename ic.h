@@ -5,6 +5,18 @@ enum ic_lib_type
     IC_LIB_CORE = 1 << 0,
 };
 
+enum ic_compile_flag
+{
+    IC_COMPILE_OPTIMIZE = 1 << 0,
+    IC_COMPILE_PRINT_IR = 1 << 1, // print the IR of each compiled function (after optimization passes if enabled)
+    // compile only main(), other functions are compiled on their first call; requires a context that outlives a program and
+    // is not used for other compilations meanwhile; the program can't be serialized and a compilation error of a function
+    // is reported when the function is called first, then ic_vm_run() stops the program and returns false
+    IC_COMPILE_LAZY = 1 << 2,
+    // map bytecode offsets to source lines and functions, see ic_program::line_table; not used with IC_COMPILE_LAZY
+    IC_COMPILE_LINE_TABLE = 1 << 3,
+};
+
 union ic_data
 {
     char s8;
@@ -45,22 +57,44 @@ struct ic_host_function
     int param_size;
 };
 
+struct ic_memory;
+
 struct ic_program
 {
-    unsigned char* bytecode; // includes strings
+    unsigned char* bytecode; // begins with read-only string literals
+    // the string literals at the beginning of bytecode, except for an IC_COMPILE_LAZY program that has a copy, its bytecode
+    // is reallocated while it runs and pointers to literals must stay valid
+    unsigned char* strings;
     ic_host_function* host_functions;
     int host_functions_size;
     int bytecode_size;
     int strings_byte_size;
-    int global_data_byte_size; // includes strings
+    int global_data_byte_size;
+    ic_memory* lazy_memory; // compiler memory of an IC_COMPILE_LAZY program, otherwise nullptr
+    unsigned char* mapped_file; // set by ic_program_init_map(), bytecode points into it
+    int mapped_file_size;
+    // stack slots of function frames with a saved bp and ip, set by a verifier (see verify.cpp); nullptr if a program is
+    // not verified, then the VM checks the stack on every push instead of once per call
+    int* frame_sizes;
+    // optional, written by IC_COMPILE_LINE_TABLE and read by the disassembler and error reports, the VM doesn't use it;
+    // see line_table.cpp
+    unsigned char* line_table;
+    int line_table_size;
 };
 
+struct ic_vm_stats;
+struct ic_vm_profile;
+struct ic_vm_sampler;
+
 struct ic_vm
 {
     ic_data* stack;
     ic_data* sp; // stack pointer
     ic_data* bp; // base pointer
     unsigned char* ip; // instruction pointer
+    ic_vm_stats* stats; // nullptr unless ic_vm_enable_stats() was called
+    ic_vm_profile* profile; // nullptr unless ic_vm_enable_profile() was called
+    ic_vm_sampler* sampler; // nullptr unless ic_vm_enable_sampling() was called
 
     // todo, make sure these are inlined
     void push();
@@ -70,13 +104,76 @@ struct ic_vm
     ic_data& top();
 };
 
+// keeps parsed host declarations and compiler memory between compilations, a context can't be used by more than one
+// thread at a time; host_functions must outlive the context
+struct ic_compiler_context
+{
+    ic_memory* memory;
+    // optional, compiled programs are stored there and loaded instead of compiling the same source again; programs are
+    // identified by a hash of the source, flags and host declarations, so a changed host callback is not detected
+    const char* cache_dir;
+    int cache_hits;
+    int cache_misses;
+    // number of threads that compile functions, 1 by default; threads are started by the first compilation that uses
+    // them and are kept until the context is freed; IC_COMPILE_LAZY, IC_COMPILE_PRINT_IR and incremental compilation
+    // always compile on the calling thread
+    int threads;
+};
+
 // host_functions should end with a nullptr prototype_str; if host functions use structures, they should be declared in struct_decls
-bool ic_program_init_compile(ic_program& program, const char* source, int libs, ic_host_function* host_functions, const char* struct_decls);
-void ic_program_init_load(ic_program& program, unsigned char* buf, int libs, ic_host_function* host_functions);
+bool ic_compiler_context_init(ic_compiler_context& context, int libs, ic_host_function* host_functions, const char* struct_decls);
+void ic_compiler_context_free(ic_compiler_context& context);
+bool ic_program_init_compile(ic_program& program, ic_compiler_context& context, const char* source, int flags = 0);
+// same as above, but functions whose text and callee signatures have not changed since the previous incremental
+// compilation with the same context are not compiled again, their bytecode is reused; if only function definitions
+// were edited, only these are lexed and parsed again and the edited functions are appended to the previous program,
+// which then keeps unreachable code of their previous versions; the cache and IC_COMPILE_LAZY are not used
+bool ic_program_init_compile_incremental(ic_program& program, ic_compiler_context& context, const char* source, int flags = 0);
+// same as ic_program_init_compile() above but with a temporary context, IC_COMPILE_LAZY is not used
+bool ic_program_init_compile(ic_program& program, const char* source, int libs, ic_host_function* host_functions, const char* struct_decls,
+    int flags = 0);
+// buf is a serialized program, it is copied; these return false if a program is not valid or fails verification (see
+// verify.cpp) or a host function it calls is not provided; sizes of parameters and return values of host functions are
+// computed from host declarations, a program that was compiled with different ones is rejected
+bool ic_program_init_load(ic_program& program, const unsigned char* buf, int size, int libs, ic_host_function* host_functions,
+    const char* struct_decls = nullptr);
+// maps a file written from a serialized program read-only and runs it in place, processes share the pages
+bool ic_program_init_map(ic_program& program, const char* path, int libs, ic_host_function* host_functions,
+    const char* struct_decls = nullptr);
+// same as above, but host declarations are parsed once by a context, the overloads above parse them on every call
+bool ic_program_init_load(ic_program& program, ic_compiler_context& context, const unsigned char* buf, int size);
+bool ic_program_init_map(ic_program& program, ic_compiler_context& context, const char* path);
 void ic_program_free(ic_program& program);
-void ic_program_print_disassembly(ic_program& program);
+// with stats, the number of times each instruction was executed is printed next to it
+void ic_program_print_disassembly(ic_program& program, ic_vm_stats* stats = nullptr);
 void ic_program_serialize(ic_program& program, unsigned char*& buf, int& size);
 void ic_buf_free(unsigned char* buf);
 void ic_vm_init(ic_vm& vm);
-int ic_vm_run(ic_vm& vm, ic_program& program);
+// false if the program was stopped before main() returned: a function of an IC_COMPILE_LAZY program failed to compile
+// or a verified program ran out of the stack
+bool ic_vm_run(ic_vm& vm, ic_program& program, int& main_return);
 void ic_vm_free(ic_vm& vm);
+// runs count executed instructions per opcode, per pair of consecutive opcodes and per bytecode offset; this uses a
+// separate interpreter loop, a vm without stats doesn't pay for it; counts add up over runs until the vm is freed, these
+// should be runs of the same program
+void ic_vm_enable_stats(ic_vm& vm);
+// a report sorted by counts, offsets are mapped to source lines if a program has a line table
+void ic_vm_print_stats(ic_vm& vm, ic_program& program, bool json);
+// the number of instructions executed by runs with stats
+unsigned long long ic_vm_executed_instructions(ic_vm& vm);
+// runs record calls, returns and host calls with a separate interpreter loop: calls and inclusive and exclusive cycles of
+// each function and calls and cycles of each caller and callee pair; ignored if stats are enabled; like stats, a profile
+// adds up over runs of the same program
+void ic_vm_enable_profile(ic_vm& vm);
+// functions sorted by exclusive cycles; names and lines come from the line table of a program, if it has one
+void ic_vm_print_profile(ic_vm& vm, ic_program& program);
+// writes a profile in the callgrind format, e.g. for kcachegrind or callgrind_annotate; source_path is the name of the
+// source file the profile refers to; returns false if the file can't be written
+bool ic_vm_write_profile(ic_vm& vm, ic_program& program, const char* path, const char* source_path);
+// runs are sampled frequency times per second on the calling thread, a signal handler records a stack of
+// functions of each sample; the interpreter loop is a separate instantiation that publishes its position on calls and
+// returns only; ignored if stats or a profile are enabled; returns false if sampling is not supported (it is on Linux)
+bool ic_vm_enable_sampling(ic_vm& vm, int frequency);
+// writes samples as collapsed stacks, a line per stack, e.g. "main;draw;sqrt 12", the input of flamegraph.pl; returns the
+// number of samples, -1 if the file can't be written
+int ic_vm_write_samples(ic_vm& vm, ic_program& program, const char* path);
@@ -1,9 +1,25 @@
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 #include "ic_impl.h"
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward64
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> // MapViewOfFile
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 bool string_compare(ic_string str1, ic_string str2)
 {
+    if (str1.id && str2.id)
+        return str1.id == str2.id;
+
     if (str1.len != str2.len)
         return false;
 
@@ -42,6 +58,35 @@ void print(ic_print_type type, int line, int col, ic_array<ic_string>& source_li
         line, col, err_msg, source_line.len, source_line.data, col - 1, ""); // "" this is a trick to print multiple spaces
 }
 
+void print(ic_print_type type, int pos, ic_array<ic_string>& source_lines, const char* err_msg)
+{
+    int line = source_line(pos, source_lines);
+    int col = line ? pos - int(source_lines.buf[line].data - source_lines.buf[1].data) + 1 : 1;
+    print(type, line, col, source_lines, err_msg);
+}
+
+// 0 for an empty source, it has only the dummy line
+int source_line(int pos, ic_array<ic_string>& source_lines)
+{
+    if (source_lines.size < 2)
+        return 0;
+    const char* source = source_lines.buf[1].data;
+    int line = 1;
+    int last = source_lines.size - 1;
+
+    // the last line that begins at or before pos
+    while (line < last)
+    {
+        int mid = (line + last + 1) / 2;
+
+        if (source_lines.buf[mid].data - source <= pos)
+            line = mid;
+        else
+            last = mid - 1;
+    }
+    return line;
+}
+
 int type_data_size(ic_type type)
 {
     if (is_struct(type))
@@ -88,59 +133,217 @@ int align(int bytes, int align_size)
     return bytes + padding;
 }
 
-ic_struct* get_struct(ic_string name, ic_memory& memory)
+// FNV-1a
+unsigned int hash_identifier(ic_string string)
 {
-    for (int i = 0; i < memory.structs.size; ++i)
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < string.len; ++i)
     {
-        ic_struct* _struct = &memory.structs.get(i);
-        if (string_compare(name, _struct->token.string))
-            return _struct;
+        hash ^= (unsigned char)string.data[i];
+        hash *= 16777619u;
     }
-    return nullptr;
+    return hash;
 }
 
-ic_function* get_function(ic_string name, ic_memory& memory)
+// FNV-1a, 64 bit version, see IC_HASH_BASIS
+unsigned long long hash_bytes(unsigned long long hash, const void* data, int bytes)
 {
-    for (int i = 0; i < memory.functions.size; ++i)
+    const unsigned char* it = (const unsigned char*)data;
+
+    for (int i = 0; i < bytes; ++i)
     {
-        ic_function* function = memory.functions.buf + i;
-        if (string_compare(name, function->token.string))
-            return function;
+        hash ^= it[i];
+        hash *= 1099511628211ull;
     }
-    return nullptr;
+    return hash;
 }
 
-ic_var* get_global_var(ic_string name, ic_memory& memory)
+#define IC_MAX_OWNED_IDENTIFIER_LEN 1024
+
+// sets string.id, equal identifiers get the same id so they can be compared and looked up without comparing characters
+void intern_identifier(ic_string& string, ic_memory& memory)
 {
-    for (int i = 0; i < memory.global_vars.size; ++i)
+    ic_array<int>& table = memory.identifier_table;
+    ic_array<int>& stamps = memory.identifier_stamps;
+
+    // keep the load factor below 1/2
+    if (memory.identifiers.size * 2 > table.size)
     {
-        ic_var* var = memory.global_vars.buf + i;
-        if (string_compare(name, var->name))
-            return var;
+        table.resize(table.size ? table.size * 2 : 1024);
+        stamps.resize(table.size);
+        memset(table.buf, 0, table.size * sizeof(int));
+
+        for (int id = 1; id < memory.identifiers.size; ++id)
+        {
+            unsigned int idx = hash_identifier(memory.identifiers.buf[id]) & (table.size - 1);
+
+            while (table.buf[idx])
+                idx = (idx + 1) & (table.size - 1);
+            table.buf[idx] = id;
+            stamps.buf[idx] = memory.generation;
+        }
     }
-    return nullptr;
+    unsigned int idx = hash_identifier(string) & (table.size - 1);
+
+    while (memory.is_slot_used(idx))
+    {
+        ic_string& identifier = memory.identifiers.buf[table.buf[idx]];
+
+        if (identifier.len == string.len && !memcmp(identifier.data, string.data, string.len))
+        {
+            string.id = table.buf[idx];
+            return;
+        }
+        idx = (idx + 1) & (table.size - 1);
+    }
+    string.id = memory.identifiers.size;
+    table.buf[idx] = string.id;
+    stamps.buf[idx] = memory.generation;
+    ic_string identifier = string;
+
+    // incremental compilation keeps identifiers while the source changes, see incremental.cpp
+    if (memory.own_identifiers)
+    {
+        if (string.len <= IC_MAX_OWNED_IDENTIFIER_LEN)
+        {
+            char* data = memory.allocate_generic(string.len);
+            memcpy(data, string.data, string.len);
+            identifier.data = data;
+        }
+        else
+            memory.own_identifiers = false; // the next compilation parses the whole source again
+    }
+    memory.identifiers.push_back(identifier);
+    ic_symbol symbol;
+    symbol.function = -1;
+    symbol.active_function = -1;
+    symbol.global_var = -1;
+    symbol.var = -1;
+    symbol._struct = nullptr;
+    symbol.generation = memory.generation;
+    memory.symbols.push_back(symbol);
+}
+
+ic_struct* get_struct(ic_string name, ic_memory& memory)
+{
+    return memory.symbol(name)._struct;
 }
 
-void write_bytes(unsigned char** buf_it, void* src, int bytes)
+ic_function* get_function(ic_string name, ic_memory& memory)
 {
-    memcpy(*buf_it, src, bytes);
-    *buf_it += bytes;
+    int idx = memory.symbol(name).function;
+    return idx == -1 ? nullptr : memory.functions.buf + idx;
 }
 
-void read_bytes(void* dst, unsigned char** buf_it, int bytes)
+ic_var* get_global_var(ic_string name, ic_memory& memory)
 {
-    memcpy(dst, *buf_it, bytes);
-    *buf_it += bytes;
+    int idx = memory.symbol(name).global_var;
+    return idx == -1 ? nullptr : memory.global_vars.buf + idx;
 }
 
+// a program file is a header, a section table and sections; integers are 32 bit in the byte order of the machine that
+// wrote the file, a loader rejects the other order; sections are aligned to IC_FILE_ALIGNMENT, so a mapped file can be
+// executed in place:
+// - IC_SECTION_STRINGS, read-only string literals
+// - IC_SECTION_CODE, bytecode of functions; it directly follows the strings section, because code operands are offsets
+//   from the beginning of the strings section
+// - IC_SECTION_HOST_IMPORTS, ic_file_import entries of host functions a program calls, followed by their prototypes
+// - IC_SECTION_LINES, optional, ic_program::line_table
+// sections of an unknown type are skipped, bump IC_FILE_VERSION on an incompatible change
+#define IC_FILE_VERSION 2
+#define IC_FILE_BYTE_ORDER 0x01020304
+#define IC_FILE_ALIGNMENT 16
+
+enum ic_file_section_type
+{
+    IC_SECTION_STRINGS,
+    IC_SECTION_CODE,
+    IC_SECTION_HOST_IMPORTS,
+    IC_SECTION_LINES, // sections before this one are required
+    IC_SECTION_COUNT,
+};
+
+struct ic_file_header
+{
+    char magic[4]; // "icbc"
+    int version;
+    int byte_order;
+    int global_data_byte_size;
+    int host_imports_size;
+    int sections_size; // the number of ic_file_section entries that follow the header
+};
+
+struct ic_file_section
+{
+    int type;
+    int offset; // from the beginning of the file
+    int byte_size;
+};
+
+// an index of an import is an operand of call_host
+struct ic_file_import
+{
+    int origin;
+    int return_size;
+    int param_size;
+    int prototype_offset; // from the beginning of the section, null terminated
+};
+
 void ic_program_serialize(ic_program& program, unsigned char*& buf, int& size)
 {
-    size = sizeof(ic_program) + program.bytecode_size + program.host_functions_size * sizeof(ic_host_function);
-    buf = (unsigned char*)malloc(size);
-    unsigned char* buf_it = buf;
-    write_bytes(&buf_it, &program, sizeof(ic_program));
-    write_bytes(&buf_it, program.bytecode, program.bytecode_size);
-    write_bytes(&buf_it, program.host_functions, program.host_functions_size * sizeof(ic_host_function));
+    assert(!program.lazy_memory);
+    int prototypes_byte_size = 0;
+
+    for (int i = 0; i < program.host_functions_size; ++i)
+        prototypes_byte_size += strlen(program.host_functions[i].prototype_str) + 1;
+
+    ic_file_section sections[IC_SECTION_COUNT];
+    int sections_size = program.line_table ? IC_SECTION_COUNT : IC_SECTION_LINES;
+    int offset = align(sizeof(ic_file_header) + sections_size * sizeof(ic_file_section), IC_FILE_ALIGNMENT);
+    sections[IC_SECTION_STRINGS] = { IC_SECTION_STRINGS, offset, program.strings_byte_size };
+    sections[IC_SECTION_CODE] = { IC_SECTION_CODE, offset + program.strings_byte_size, program.bytecode_size - program.strings_byte_size };
+    offset = align(offset + program.bytecode_size, IC_FILE_ALIGNMENT);
+    int imports_byte_size = program.host_functions_size * sizeof(ic_file_import);
+    sections[IC_SECTION_HOST_IMPORTS] = { IC_SECTION_HOST_IMPORTS, offset, imports_byte_size + prototypes_byte_size };
+    size = offset + sections[IC_SECTION_HOST_IMPORTS].byte_size;
+
+    if (program.line_table)
+    {
+        offset = align(size, IC_FILE_ALIGNMENT);
+        sections[IC_SECTION_LINES] = { IC_SECTION_LINES, offset, program.line_table_size };
+        size = offset + program.line_table_size;
+    }
+    buf = (unsigned char*)calloc(size, 1); // paddings are zeroed
+    ic_file_header header;
+    memcpy(header.magic, "icbc", 4);
+    header.version = IC_FILE_VERSION;
+    header.byte_order = IC_FILE_BYTE_ORDER;
+    header.global_data_byte_size = program.global_data_byte_size;
+    header.host_imports_size = program.host_functions_size;
+    header.sections_size = sections_size;
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), sections, sections_size * sizeof(ic_file_section));
+    memcpy(buf + sections[IC_SECTION_STRINGS].offset, program.bytecode, program.bytecode_size);
+
+    if (program.line_table)
+        memcpy(buf + sections[IC_SECTION_LINES].offset, program.line_table, program.line_table_size);
+    unsigned char* imports = buf + sections[IC_SECTION_HOST_IMPORTS].offset;
+    int prototype_offset = imports_byte_size;
+
+    for (int i = 0; i < program.host_functions_size; ++i)
+    {
+        ic_host_function& fun = program.host_functions[i];
+        ic_file_import import;
+        import.origin = fun.origin;
+        import.return_size = fun.return_size;
+        import.param_size = fun.param_size;
+        import.prototype_offset = prototype_offset;
+        memcpy(imports + i * sizeof(ic_file_import), &import, sizeof(import));
+        int bytes = strlen(fun.prototype_str) + 1;
+        memcpy(imports + prototype_offset, fun.prototype_str, bytes);
+        prototype_offset += bytes;
+    }
 }
 
 void ic_buf_free(unsigned char* buf)
@@ -160,23 +363,6 @@ unsigned int hash_string(const char* str)
     return hash;
 }
 
- void resolve_host_function(ic_host_function& dst, ic_host_function* source)
- {
-     assert(source);
-     while (source->prototype_str)
-     {
-         if (dst.hash == hash_string(source->prototype_str))
-         {
-             dst.prototype_str = source->prototype_str;
-             dst.callback = source->callback;
-             dst.host_data = source->host_data;
-             return;
-         }
-         ++source;
-     }
-     assert(false); // todo, proper error handling
- }
-
 void host_prints(ic_data* argv, ic_data*, void*)
 {
     printf("prints: %s\n", (const char*)argv->pointer);
@@ -232,69 +418,338 @@ static ic_host_function _core_lib[] =
 
 #define IC_USER_FUNCTION -1
 
-void ic_program_init_load(ic_program& program, unsigned char* buf, int libs, ic_host_function* host_functions)
+static void add_host_table(ic_host_index& index, ic_host_function* table, int origin)
 {
-    assert(buf);
-    unsigned char* buf_it = buf;
-    read_bytes(&program, &buf_it, sizeof(program));
-    program.bytecode = (unsigned char*)malloc(program.bytecode_size);
-    read_bytes(program.bytecode, &buf_it, program.bytecode_size);
+    int mask = index.slots.size - 1;
+
+    for (ic_host_function* it = table; it && it->prototype_str; ++it)
+    {
+        it->origin = origin;
+        it->hash = hash_string(it->prototype_str);
+        int idx = it->hash & mask;
+
+        // the first of equal prototypes is used, the compiler rejects duplicates
+        while (index.slots.buf[idx] && !(index.slots.buf[idx]->hash == it->hash && index.slots.buf[idx]->origin == origin &&
+            !strcmp(index.slots.buf[idx]->prototype_str, it->prototype_str)))
+            idx = (idx + 1) & mask;
+
+        if (!index.slots.buf[idx])
+            index.slots.buf[idx] = it;
+    }
+}
+
+void ic_host_index::build(int libs, ic_host_function* host_functions)
+{
+    int count = (libs & IC_LIB_CORE) ? sizeof(_core_lib) / sizeof(ic_host_function) - 1 : 0;
+
+    for (ic_host_function* it = host_functions; it && it->prototype_str; ++it)
+        ++count;
+
+    int size = 16;
+
+    while (size < count * 2)
+        size *= 2;
+
+    slots.resize(size);
+    memset(slots.buf, 0, size * sizeof(ic_host_function*));
+
+    if (libs & IC_LIB_CORE)
+        add_host_table(*this, _core_lib, IC_LIB_CORE);
+    add_host_table(*this, host_functions, IC_USER_FUNCTION);
+}
+
+ic_host_function* ic_host_index::find(int origin, const char* prototype_str)
+{
+    unsigned int hash = hash_string(prototype_str);
+    int mask = slots.size - 1;
+
+    for (int idx = hash & mask; slots.buf[idx]; idx = (idx + 1) & mask)
+    {
+        ic_host_function* fun = slots.buf[idx];
+
+        if (fun->hash == hash && fun->origin == origin && !strcmp(fun->prototype_str, prototype_str))
+            return fun;
+    }
+    return nullptr;
+}
+
+// validates a program file and sets program fields, the bytecode points into the buffer
+static bool read_program_file(ic_program& program, const unsigned char* buf, int size, ic_host_index& host_index)
+{
+    ic_file_header header;
+
+    if (size < (int)sizeof(header))
+        return false;
+    memcpy(&header, buf, sizeof(header));
+
+    if (memcmp(header.magic, "icbc", 4) || header.version != IC_FILE_VERSION || header.byte_order != IC_FILE_BYTE_ORDER ||
+        header.sections_size < 0 || header.sections_size > (size - (int)sizeof(header)) / (int)sizeof(ic_file_section))
+        return false;
+
+    ic_file_section sections[IC_SECTION_COUNT];
+    bool found[IC_SECTION_COUNT] = {};
+
+    for (int i = 0; i < header.sections_size; ++i)
+    {
+        ic_file_section section;
+        memcpy(&section, buf + sizeof(header) + i * sizeof(ic_file_section), sizeof(section));
+
+        if (section.offset < 0 || section.byte_size < 0 || section.offset > size - section.byte_size)
+            return false;
+
+        if (section.type >= 0 && section.type < IC_SECTION_COUNT)
+        {
+            sections[section.type] = section;
+            found[section.type] = true;
+        }
+    }
+
+    for (int i = 0; i < IC_SECTION_LINES; ++i)
+    {
+        if (!found[i])
+            return false;
+    }
+    ic_file_section strings = sections[IC_SECTION_STRINGS];
+    ic_file_section code = sections[IC_SECTION_CODE];
+    ic_file_section imports = sections[IC_SECTION_HOST_IMPORTS];
+
+    if (code.offset != strings.offset + strings.byte_size || header.global_data_byte_size < 0 ||
+        header.host_imports_size < 0 || header.host_imports_size > imports.byte_size / (int)sizeof(ic_file_import))
+        return false;
+
+    program.bytecode = (unsigned char*)buf + strings.offset;
+    program.strings = program.bytecode;
+    program.bytecode_size = strings.byte_size + code.byte_size;
+    program.strings_byte_size = strings.byte_size;
+    program.global_data_byte_size = header.global_data_byte_size;
+    program.lazy_memory = nullptr;
+    program.mapped_file = nullptr;
+    program.mapped_file_size = 0;
+    program.frame_sizes = nullptr;
+    program.line_table = found[IC_SECTION_LINES] ? (unsigned char*)buf + sections[IC_SECTION_LINES].offset : nullptr;
+    program.line_table_size = found[IC_SECTION_LINES] ? sections[IC_SECTION_LINES].byte_size : 0;
+    program.host_functions_size = header.host_imports_size;
     program.host_functions = (ic_host_function*)malloc(program.host_functions_size * sizeof(ic_host_function));
-    read_bytes(program.host_functions, &buf_it, program.host_functions_size * sizeof(ic_host_function));
+    const unsigned char* imports_buf = buf + imports.offset;
 
     for (int i = 0; i < program.host_functions_size; ++i)
     {
-        ic_host_function& fun = program.host_functions[i];
+        ic_file_import import;
+        memcpy(&import, imports_buf + i * sizeof(ic_file_import), sizeof(import));
+        ic_host_function* host_function = nullptr;
 
-        if (fun.origin == IC_LIB_CORE)
-            resolve_host_function(fun, _core_lib);
-        else if (fun.origin == IC_USER_FUNCTION)
-            resolve_host_function(fun, host_functions);
-        else
-            assert(false);
+        // a prototype must be terminated inside the section
+        if (import.prototype_offset >= 0 && import.prototype_offset < imports.byte_size &&
+            memchr(imports_buf + import.prototype_offset, 0, imports.byte_size - import.prototype_offset))
+            host_function = host_index.find(import.origin, (const char*)imports_buf + import.prototype_offset);
+
+        // sizes are computed from a host declaration, a program compiled against a different one is rejected
+        if (!host_function || host_function->return_size != import.return_size || host_function->param_size != import.param_size)
+        {
+            free(program.host_functions);
+            return false;
+        }
+        program.host_functions[i] = *host_function;
+    }
+
+    ic_line_map line_map;
+    line_map.init();
+    bool valid = verify_program(program) && (!program.line_table || line_map.build(program));
+    line_map.free();
+
+    if (!valid)
+    {
+        free(program.host_functions);
+        return false;
+    }
+    return true;
+}
+
+bool program_init_load(ic_program& program, const unsigned char* buf, int size, ic_host_index& host_index)
+{
+    assert(buf);
+
+    if (!read_program_file(program, buf, size, host_index))
+        return false;
+    unsigned char* bytecode = (unsigned char*)malloc(program.bytecode_size);
+    memcpy(bytecode, program.bytecode, program.bytecode_size);
+    program.bytecode = bytecode;
+    program.strings = bytecode;
+
+    if (program.line_table)
+    {
+        unsigned char* line_table = (unsigned char*)malloc(program.line_table_size);
+        memcpy(line_table, program.line_table, program.line_table_size);
+        program.line_table = line_table;
+    }
+    return true;
+}
+
+bool ic_program_init_load(ic_program& program, const unsigned char* buf, int size, int libs, ic_host_function* host_functions,
+    const char* struct_decls)
+{
+    ic_compiler_context context;
+
+    if (!ic_compiler_context_init(context, libs, host_functions, struct_decls))
+        return false;
+    bool success = ic_program_init_load(program, context, buf, size);
+    ic_compiler_context_free(context);
+    return success;
+}
+
+bool ic_program_init_load(ic_program& program, ic_compiler_context& context, const unsigned char* buf, int size)
+{
+    return program_init_load(program, buf, size, context.memory->host_index);
+}
+
+static void unmap_file(unsigned char* data, int size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+static bool program_init_map(ic_program& program, const char* path, ic_host_index& host_index)
+{
+    unsigned char* data = nullptr;
+    int size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && file_size.QuadPart <= INT_MAX)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping)
+        {
+            data = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = (int)file_size.QuadPart;
+            CloseHandle(mapping); // a view keeps the mapping
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+        return false;
+    struct stat st;
+
+    if (!fstat(fd, &st) && st.st_size > 0 && st.st_size <= INT_MAX)
+    {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (mapping != MAP_FAILED)
+        {
+            data = (unsigned char*)mapping;
+            size = (int)st.st_size;
+        }
     }
+    close(fd); // a mapping keeps the file
+#endif
+
+    if (!data)
+        return false;
+
+    if (!read_program_file(program, data, size, host_index))
+    {
+        unmap_file(data, size);
+        return false;
+    }
+    program.mapped_file = data;
+    program.mapped_file_size = size;
+    return true;
+}
+
+bool ic_program_init_map(ic_program& program, const char* path, int libs, ic_host_function* host_functions,
+    const char* struct_decls)
+{
+    ic_compiler_context context;
+
+    if (!ic_compiler_context_init(context, libs, host_functions, struct_decls))
+        return false;
+    bool success = ic_program_init_map(program, context, path);
+    ic_compiler_context_free(context);
+    return success;
+}
+
+bool ic_program_init_map(ic_program& program, ic_compiler_context& context, const char* path)
+{
+    return program_init_map(program, path, context.memory->host_index);
 }
 
 void ic_program_free(ic_program& program)
 {
-    free(program.bytecode);
+    // bytecode of a lazy program is owned by a context
+    if (program.mapped_file)
+        unmap_file(program.mapped_file, program.mapped_file_size);
+    else
+    {
+        if (program.lazy_memory)
+            free(program.strings);
+        else
+            free(program.bytecode);
+        free(program.line_table);
+    }
     free(program.host_functions);
+    free(program.frame_sizes);
 }
 
 struct ic_parser
 {
     ic_memory* memory;
     bool error;
-    ic_token* token_it;
+    bool quiet; // errors are not printed
+    int token_idx;
 
-    ic_stmt* allocate_stmt(ic_stmt_type type, ic_token token)
+    // node arrays grow while parsing, pointers returned by expr() and stmt() are valid only until the next allocation
+    int allocate_stmt(ic_stmt_type type, int token)
     {
-        ic_stmt* stmt = (ic_stmt*)memory->allocate_generic(sizeof(ic_stmt));
-        memset(stmt, 0, sizeof(ic_stmt));
-        stmt->type = type;
-        stmt->token = token;
-        return stmt;
+        memory->stmts.push_back();
+        ic_stmt& stmt = memory->stmts.back();
+        memset(&stmt, 0, sizeof(ic_stmt));
+        stmt.type = type;
+        stmt.token = token;
+        return memory->stmts.size - 1;
     }
 
-    ic_expr* allocate_expr(ic_expr_type type, ic_token token)
+    int allocate_expr(ic_expr_type type, int token)
     {
-        ic_expr* expr = (ic_expr*)memory->allocate_generic(sizeof(ic_expr));
-        memset(expr, 0, sizeof(ic_expr));
-        expr->type = type;
-        expr->token = token;
-        return expr;
+        memory->exprs.push_back();
+        ic_expr& expr = memory->exprs.back();
+        memset(&expr, 0, sizeof(ic_expr));
+        expr.type = type;
+        expr.token = token;
+        return memory->exprs.size - 1;
+    }
+
+    ic_expr* expr(int idx)
+    {
+        return memory->exprs.buf + idx;
+    }
+
+    ic_stmt* stmt(int idx)
+    {
+        return memory->stmts.buf + idx;
     }
 
     void advance()
     {
-        if (token_it->type != IC_TOK_EOF)
-            ++token_it;
+        if (get_token_type() != IC_TOK_EOF)
+            ++token_idx;
     }
 
     // todo, peek() function would be useful in some cases?
     void consume(ic_token_type type, const char* err_msg)
     {
-        if (token_it->type == type)
+        if (get_token_type() == type)
         {
             advance();
             return;
@@ -304,7 +759,7 @@ struct ic_parser
     
     bool try_consume(ic_token_type type)
     {
-        if (token_it->type == type)
+        if (get_token_type() == type)
         {
             advance();
             return true;
@@ -317,22 +772,26 @@ struct ic_parser
         if (error)
             return;
 
-        print(IC_PERROR, token_it->line, token_it->col, memory->source_lines, err_msg);
+        if (!quiet)
+            print(IC_PERROR, memory->token_positions.buf[token_idx], memory->source_lines, err_msg);
         error = true;
+        token_idx = memory->token_types.size - 1; // EOF
+    }
 
-        while (token_it->type != IC_TOK_EOF)
-            ++token_it;
+    ic_token get_token()
+    {
+        return memory->token(token_idx);
     }
 
-    ic_token& get_token()
+    ic_token_type get_token_type()
     {
-        return *token_it;
+        return memory->token_types.buf[token_idx];
     }
 };
 
 void print_error(ic_token token, ic_array<ic_string>& lines, const char* msg)
 {
-    print(IC_PERROR, token.line, token.col, lines, msg);
+    print(IC_PERROR, token.pos, lines, msg);
 }
 
 #define IC_ALLOW_VOID 1
@@ -353,7 +812,7 @@ bool load_host_functions(ic_host_function* it, int origin, ic_parser& parser, ic
         if (!lex(it->prototype_str, memory))
             return false;
         assert(!memory.bytecode.size); // internal error check
-        parser.token_it = memory.tokens.buf;
+        parser.token_idx = 0;
         ic_function function;
         function.type = IC_FUN_HOST;
         function.return_type = produce_type(parser, IC_ALLOW_VOID);
@@ -372,6 +831,13 @@ bool load_host_functions(ic_host_function* it, int origin, ic_parser& parser, ic
         if (parser.error)
             return false;
         function.host_function = it;
+        // loaded programs are checked against these, see read_program_file()
+        it->return_size = type_data_size(function.return_type);
+        it->param_size = 0;
+
+        for (int i = 0; i < function.param_count; ++i)
+            it->param_size += type_data_size(function.params[i].type);
+        memory.symbol(function.token.string).function = memory.functions.size;
         memory.functions.push_back(function);
         ++it;
     }
@@ -387,7 +853,9 @@ bool add_struct_declaration(ic_struct& _struct, ic_memory& memory)
     {
         if (prev_struct)
             return true; // do nothing, multiple declarations are not an error
-        *memory.structs.allocate() = _struct;
+        ic_struct* new_struct = memory.structs.allocate();
+        *new_struct = _struct;
+        memory.symbol(token.string)._struct = new_struct;
         return true;
     }
     // if declaration is also a definition
@@ -401,7 +869,9 @@ bool add_struct_declaration(ic_struct& _struct, ic_memory& memory)
         *prev_struct = _struct; // replace forward declaration with definition
         return true;
     }
-    *memory.structs.allocate() = _struct;
+    ic_struct* new_struct = memory.structs.allocate();
+    *new_struct = _struct;
+    memory.symbol(token.string)._struct = new_struct;
     return true;
 }
 
@@ -412,9 +882,9 @@ bool load_host_structures(const char* source, ic_parser& parser, ic_memory& memo
     if (!lex(source, memory))
         return false;
      assert(!memory.bytecode.size); // internal error check
-     parser.token_it = memory.tokens.buf;
+     parser.token_idx = 0;
 
-     while (parser.get_token().type != IC_TOK_EOF)
+     while (parser.get_token_type() != IC_TOK_EOF)
      {
          ic_decl decl = produce_decl(parser);
 
@@ -431,13 +901,12 @@ bool load_host_structures(const char* source, ic_parser& parser, ic_memory& memo
      return true;
 }
 
-bool program_init_compile_impl(ic_program& program, const char* source, int libs, ic_host_function* host_functions,
-    const char* struct_decls, ic_memory& memory)
+bool load_host_declarations(int libs, ic_host_function* host_functions, const char* struct_decls, ic_memory& memory)
 {
-    assert(source);
     ic_parser parser;
     parser.memory = &memory;
     parser.error = false;
+    parser.quiet = false;
 
     if (libs & IC_LIB_CORE)
     {
@@ -447,7 +916,12 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
 
     if (struct_decls)
     {
-        if (!load_host_structures(struct_decls, parser, memory))
+        // identifiers point into the source, keep a copy so a caller doesn't have to
+        int bytes = strlen(struct_decls) + 1;
+        memory.struct_decls.resize(bytes);
+        memcpy(memory.struct_decls.buf, struct_decls, bytes);
+
+        if (!load_host_structures(memory.struct_decls.buf, parser, memory))
             return false;
     }
 
@@ -456,23 +930,74 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
         if (!load_host_functions(host_functions, IC_USER_FUNCTION, parser, memory))
             return false;
     }
+    return true;
+}
+
+// the end of the text of tokens [tokens_begin, tokens_end), declarations end with a single character token
+int tokens_text_end(int tokens_end, ic_memory& memory)
+{
+    return memory.token_positions.buf[tokens_end - 1] + 1;
+}
 
+// global variables are placed after string literals
+void place_global_var(ic_program& program, ic_var& var)
+{
+    int byte_size = type_byte_size(var.type);
+    int align_size = is_struct(var.type) ? var.type._struct->alignment : byte_size;
+    program.global_data_byte_size = align(program.global_data_byte_size, align_size);
+    var.byte_idx = program.global_data_byte_size;
+    program.global_data_byte_size += byte_size;
+}
+
+// lexes and parses a source, function bodies are compiled by a caller; if decls is given, top-level declarations
+// are appended to it
+bool parse_program(ic_program& program, const char* source, ic_memory& memory, ic_array<ic_source_decl>* decls)
+{
+    assert(source);
+    ic_parser parser;
+    parser.memory = &memory;
+    parser.error = false;
+    parser.quiet = false;
     assert(!memory.bytecode.size);
 
     if (!lex(source, memory))
         return false;
 
     program.strings_byte_size = memory.bytecode.size;
-    program.global_data_byte_size = program.strings_byte_size;
-    parser.token_it = memory.tokens.buf;
+    program.global_data_byte_size = 0;
+    parser.token_idx = 0;
+    memory.layout_hash = hash_bytes(IC_HASH_BASIS, &memory.flags, sizeof(int));
 
-    while (parser.get_token().type != IC_TOK_EOF)
+    while (parser.get_token_type() != IC_TOK_EOF)
     {
+        int tokens_begin = parser.token_idx;
         ic_decl decl = produce_decl(parser);
 
         if (parser.error)
             return false;
 
+        int text_begin = memory.token_positions.buf[tokens_begin];
+        int text_end = tokens_text_end(parser.token_idx, memory);
+
+        if (decl.type == IC_DECL_FUNCTION)
+        {
+            decl.function.tokens_begin = tokens_begin;
+            decl.function.tokens_end = parser.token_idx;
+        }
+        else
+            memory.layout_hash = hash_bytes(memory.layout_hash, source + text_begin, text_end - text_begin);
+
+        if (decls)
+        {
+            ic_source_decl source_decl;
+            source_decl.text_begin = text_begin;
+            source_decl.text_end = text_end;
+            source_decl.tokens_begin = tokens_begin;
+            source_decl.tokens_end = parser.token_idx;
+            source_decl.function = decl.type == IC_DECL_FUNCTION ? memory.functions.size : -1;
+            decls->push_back(source_decl);
+        }
+
         switch (decl.type)
         {
         case IC_DECL_FUNCTION:
@@ -488,6 +1013,7 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
                     print_error(token, memory.source_lines, "function with such name already exists");
                 return false;
             }
+            memory.symbol(token.string).function = memory.functions.size;
             memory.functions.push_back(decl.function);
             break;
         }
@@ -509,19 +1035,52 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
             ic_var var;
             var.type = decl.var.type;
             var.name = token.string;
-            int byte_size = type_byte_size(var.type);
-            int align_size = is_struct(var.type) ? var.type._struct->alignment : byte_size;
-            program.global_data_byte_size = align(program.global_data_byte_size, align_size);
-            var.byte_idx = program.global_data_byte_size;
+            place_global_var(program, var);
+            memory.symbol(var.name).global_var = memory.global_vars.size;
             memory.global_vars.push_back(var);
-            program.global_data_byte_size += byte_size;
             break;
         }
         default:
             assert(false);
         }
     } // while
+    return activate_main(memory);
+}
+
+// parses function definitions from tokens_begin up to an EOF token without printing errors; returns false on an error
+// or if there is a different declaration, see incremental.cpp
+bool parse_function_definitions(int tokens_begin, ic_memory& memory, ic_array<ic_function>& functions,
+    ic_array<ic_source_decl>& decls)
+{
+    ic_parser parser;
+    parser.memory = &memory;
+    parser.error = false;
+    parser.quiet = true;
+    parser.token_idx = tokens_begin;
+
+    while (parser.get_token_type() != IC_TOK_EOF)
+    {
+        ic_source_decl source_decl;
+        source_decl.tokens_begin = parser.token_idx;
+        ic_decl decl = produce_decl(parser);
+
+        if (parser.error || decl.type != IC_DECL_FUNCTION)
+            return false;
+        source_decl.tokens_end = parser.token_idx;
+        source_decl.text_begin = memory.token_positions.buf[source_decl.tokens_begin];
+        source_decl.text_end = tokens_text_end(source_decl.tokens_end, memory);
+        source_decl.function = functions.size;
+        decl.function.tokens_begin = source_decl.tokens_begin;
+        decl.function.tokens_end = source_decl.tokens_end;
+        functions.push_back(decl.function);
+        decls.push_back(source_decl);
+    }
+    return true;
+}
 
+// main is the first active function, other functions become active when they are called
+bool activate_main(ic_memory& memory)
+{
     for (ic_function& function : memory.functions)
     {
         if (function.type == IC_FUN_SOURCE)
@@ -533,6 +1092,7 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
                     print_error(function.token, memory.source_lines, "invalid main function prototype, expected 's32 main()'");
                     return false;
                 }
+                memory.symbol(function.token.string).active_function = memory.active_source_functions.size;
                 memory.active_source_functions.push_back(&function);
             }
             function.instr_idx = -1; // this is important
@@ -544,95 +1104,274 @@ bool program_init_compile_impl(ic_program& program, const char* source, int libs
         printf("error: main function missing\n");
         return false;
     }
+    return true;
+}
 
-    // important, size changes inside a loop
-    for (int i = 0; i < memory.active_source_functions.size; ++i)
+// sets call operands to instr_idx of callees, calls of functions that are not compiled yet trap into lazy_compile_function()
+static void resolve_calls(ic_memory& memory)
+{
+    for (int op_idx : memory.call_ops)
     {
-        if (!compile_function(*memory.active_source_functions.buf[i], memory, true))
-            return false;
+        int fun_idx;
+        memcpy(&fun_idx, memory.bytecode.buf + op_idx, sizeof(int));
+        int instr_idx = memory.active_source_functions.buf[fun_idx]->instr_idx;
+
+        if (instr_idx == -1)
+            memory.bytecode.buf[op_idx - 1] = IC_OPC_CALL_LAZY;
+        else
+            memcpy(memory.bytecode.buf + op_idx, &instr_idx, sizeof(int));
     }
+    memory.call_ops.clear();
+}
 
-    for (int op_idx : memory.call_ops)
+// adds host functions that were called for the first time since the previous call
+static void add_host_functions(ic_program& program, ic_memory& memory)
+{
+    int begin = program.host_functions_size;
+    program.host_functions_size = memory.active_host_functions.size;
+    program.host_functions = (ic_host_function*)realloc(program.host_functions, program.host_functions_size * sizeof(ic_host_function));
+
+    for(int i = begin; i < program.host_functions_size; ++i)
     {
-        int fun_idx = memory.bytecode.buf[op_idx];
-        int instr_idx = memory.active_source_functions.buf[fun_idx]->instr_idx;
-        memcpy(memory.bytecode.buf + op_idx, &instr_idx, sizeof(int));
+        ic_function& fun = *memory.active_host_functions.buf[i];
+        ic_host_function& hfun = program.host_functions[i];
+        hfun = *fun.host_function; // sizes are set by load_host_functions()
     }
+}
 
-    // compile inactive functions for a code corectness, these won't be included in a returned program
+// compiles inactive functions for a code corectness, these won't be included in a returned program
+bool compile_unused_functions(ic_memory& memory)
+{
     for (ic_function& function : memory.functions)
     {
         if (function.type == IC_FUN_HOST || function.instr_idx != -1)
             continue;
-        print(IC_PWARNING, function.token.line, function.token.col, memory.source_lines, "function defined but not used");
+        print(IC_PWARNING, function.token.pos, memory.source_lines, "function defined but not used");
 
         if (!compile_function(function, memory, false))
             return false;
+        function.instr_idx = -1; // still not active, see incremental.cpp
     }
+    return true;
+}
+
+// resolves call operands and moves the bytecode to a program
+bool link_program(ic_program& program, ic_memory& memory)
+{
+    resolve_calls(memory);
+    bool lazy = memory.flags & IC_COMPILE_LAZY;
     program.bytecode_size = memory.bytecode.size;
-    program.bytecode = memory.bytecode.transfer();
-    program.host_functions_size = memory.active_host_functions.size;
-    program.host_functions = (ic_host_function*)malloc(program.host_functions_size * sizeof(ic_host_function));
+    program.bytecode = lazy ? memory.bytecode.buf : memory.bytecode.transfer();
+    program.lazy_memory = lazy ? &memory : nullptr;
+    program.strings = program.bytecode;
+
+    if (lazy)
+    {
+        program.strings = (unsigned char*)malloc(program.strings_byte_size);
+        memcpy(program.strings, program.bytecode, program.strings_byte_size);
+    }
+    program.mapped_file = nullptr;
+    program.mapped_file_size = 0;
+    program.frame_sizes = nullptr;
+    program.line_table = nullptr;
+    program.line_table_size = 0;
+    program.host_functions_size = 0;
+    program.host_functions = nullptr;
+    add_host_functions(program, memory);
+
+    if (!lazy && (memory.flags & IC_COMPILE_LINE_TABLE))
+        build_line_table(program, memory);
+
+    // bytecode of a lazy program changes while it runs; a compiled program that fails verification, e.g. because of a frame
+    // larger than the stack, runs with runtime checks
+    if (!lazy)
+        verify_program(program);
+    return true;
+}
 
-    for(int i = 0; i < program.host_functions_size; ++i)
+// compiles a function of an IC_COMPILE_LAZY program on its first call and returns its instr_idx, the bytecode may be
+// reallocated; returns -1 if the function has an error, the error is printed by the compiler
+int lazy_compile_function(ic_program& program, int fun_idx)
+{
+    ic_memory& memory = *program.lazy_memory;
+    ic_function& function = *memory.active_source_functions.buf[fun_idx];
+
+    if (function.instr_idx != -1)
+        return function.instr_idx;
+
+    if (!compile_function(function, memory, true))
+    {
+        // drop the partial code, the function fails the same way if the program is run again
+        memory.scopes.clear();
+        memory.vars.clear();
+        memory.break_ops.clear();
+        memory.cont_ops.clear();
+        memory.call_ops.clear();
+        memory.bytecode.resize(function.instr_idx);
+        function.instr_idx = -1;
+        program.bytecode = memory.bytecode.buf;
+        return -1;
+    }
+    resolve_calls(memory);
+    program.bytecode = memory.bytecode.buf;
+    program.bytecode_size = memory.bytecode.size;
+    add_host_functions(program, memory);
+    return function.instr_idx;
+}
+
+bool program_init_compile_impl(ic_program& program, const char* source, ic_memory& memory)
+{
+    if (!parse_program(program, source, memory))
+        return false;
+
+    if (memory.threads > 1)
     {
-        ic_function& fun = *memory.active_host_functions.buf[i];
-        ic_host_function& hfun = program.host_functions[i];
-        hfun = *fun.host_function;
-        hfun.hash = hash_string(hfun.prototype_str);
-        hfun.return_size = type_data_size(fun.return_type);
-        hfun.param_size = 0;
+        if (!compile_functions_parallel(memory))
+            return false;
+        return link_program(program, memory);
+    }
+
+    // important, size changes inside a loop
+    for (int i = 0; i < memory.active_source_functions.size; ++i)
+    {
+        if (!compile_function(*memory.active_source_functions.buf[i], memory, true))
+            return false;
+
+        if (memory.flags & IC_COMPILE_LAZY)
+            break; // only main(), see lazy_compile_function()
+    }
+
+    // in the lazy mode functions that are not compiled yet may still be called
+    if (!(memory.flags & IC_COMPILE_LAZY) && !compile_unused_functions(memory))
+        return false;
+    return link_program(program, memory);
+}
+
+bool ic_compiler_context_init(ic_compiler_context& context, int libs, ic_host_function* host_functions, const char* struct_decls)
+{
+    ic_memory* memory = (ic_memory*)malloc(sizeof(ic_memory));
+    memory->init();
+
+    if (!load_host_declarations(libs, host_functions, struct_decls, *memory))
+    {
+        memory->free();
+        free(memory);
+        context.memory = nullptr;
+        return false;
+    }
+    memory->mark_persistent();
+    memory->host_index.build(libs, host_functions);
+    memory->declarations_hash = hash_declarations(libs, host_functions, struct_decls);
+    context.memory = memory;
+    context.cache_dir = nullptr;
+    context.cache_hits = 0;
+    context.cache_misses = 0;
+    context.threads = 1;
+    return true;
+}
 
-        for (int j = 0; j < fun.param_count; ++j)
-            hfun.param_size += type_data_size(fun.params[j].type);
+void ic_compiler_context_free(ic_compiler_context& context)
+{
+    context.memory->free();
+    free(context.memory);
+}
+
+bool ic_program_init_compile(ic_program& program, ic_compiler_context& context, const char* source, int flags)
+{
+    assert(source);
+    ic_memory& memory = *context.memory;
+    // printing the IR is a side effect of compiling, a lazy program is not complete
+    bool use_cache = context.cache_dir && !(flags & (IC_COMPILE_PRINT_IR | IC_COMPILE_LAZY));
+    unsigned long long key;
+
+    if (use_cache)
+    {
+        key = program_cache_key(source, flags, memory);
 
-        // make sure there is no hash collision
-        for(int x = 0; x < i; ++x)
-            assert(hfun.hash != program.host_functions[x].hash);
+        if (load_cached_program(program, context.cache_dir, key, memory))
+        {
+            context.cache_hits += 1;
+            return true;
+        }
+        context.cache_misses += 1;
     }
+    memory.reset();
+    memory.flags = flags;
+    memory.threads = flags & (IC_COMPILE_PRINT_IR | IC_COMPILE_LAZY) ? 1 : context.threads;
+
+    // functions are compiled after this function returns
+    if (flags & IC_COMPILE_LAZY)
+    {
+        int bytes = strlen(source) + 1;
+        memory.lazy_source.resize(bytes);
+        memcpy(memory.lazy_source.buf, source, bytes);
+        source = memory.lazy_source.buf;
+    }
+
+    if (!program_init_compile_impl(program, source, memory))
+        return false;
+
+    if (use_cache)
+        store_cached_program(program, context.cache_dir, key);
     return true;
 }
 
-bool ic_program_init_compile(ic_program& program, const char* source, int libs, ic_host_function* host_functions, const char* struct_decls)
+bool ic_program_init_compile_incremental(ic_program& program, ic_compiler_context& context, const char* source, int flags)
+{
+    assert(source);
+    ic_memory& memory = *context.memory;
+    memory.threads = 1;
+    return program_init_compile_incremental_impl(program, source, flags & ~IC_COMPILE_LAZY, memory);
+}
+
+bool ic_program_init_compile(ic_program& program, const char* source, int libs, ic_host_function* host_functions, const char* struct_decls,
+    int flags)
 {
     assert(source);
-    ic_memory memory;
-    memory.init();
-    bool success = program_init_compile_impl(program, source, libs, host_functions, struct_decls, memory);
-    memory.free();
+    ic_compiler_context context;
+
+    if (!ic_compiler_context_init(context, libs, host_functions, struct_decls))
+        return false;
+    bool success = ic_program_init_compile(program, context, source, flags & ~IC_COMPILE_LAZY);
+    ic_compiler_context_free(context);
     return success;
 }
 
 struct ic_lexer
 {
-    ic_array<ic_token>* tokens;
+    ic_memory* memory;
+    ic_array<ic_string>* source_lines;
+    bool range; // a part of a source is lexed, lines are already indexed and errors are not printed, see lex_range()
+    bool split; // the source continues after source_end, tokens and comments must end before it
     int line;
-    int col;
     int token_line;
     int token_col;
+    const char* token_begin;
+    const char* source;
     const char* source_it;
+    const char* source_end;
+    const char* line_begin;
 
-    // when string.data is nullptr number is used
-    void add_token_impl(ic_token_type type, ic_string string, double number)
+    // see ic_memory::token_values
+    void add_token_value(ic_token_type type, int value)
     {
-        ic_token token;
-        token.type = type;
-        token.line = token_line;
-        token.col = token_col;
-
-        if(string.data)
-            token.string = string;
-        else
-            token.number = number;
-        tokens->push_back(token);
+        memory->token_types.push_back(type);
+        memory->token_positions.push_back(token_begin - source);
+        memory->token_values.push_back(value);
     }
 
-    void add_token(ic_token_type type) { add_token_impl(type, {nullptr}, {}); }
-    void add_token_string(ic_token_type type, ic_string string) { add_token_impl(type, string, {}); }
-    void add_token_number(ic_token_type type, double number) { add_token_impl(type, {nullptr}, number); }
-    bool end() { return *source_it == '\0'; }
+    void add_token(ic_token_type type) { add_token_value(type, 0); }
+    void add_token_identifier(ic_string string) { add_token_value(IC_TOK_IDENTIFIER, string.id); }
+
+    void add_token_number(ic_token_type type, double number)
+    {
+        add_token_value(type, memory->token_numbers.size);
+        memory->token_numbers.push_back(number);
+    }
+    bool end() { return source_it == source_end; }
     char peek() { return *source_it; }
     const char* pos() { return source_it - 1; } // this function name makes sense from the interface perspective
+    int col() { return int(source_it - line_begin) + 1; }
 
     char advance()
     {
@@ -640,13 +1379,14 @@ struct ic_lexer
         const char c = *source_it;
         ++source_it;
 
+        // lines are indexed while lexing, error reporting needs only lines that were already lexed
         if (c == '\n')
         {
+            if (!range)
+                source_lines->push_back({ line_begin, int(pos() - line_begin) });
+            line_begin = source_it;
             ++line;
-            col = 1;
         }
-        else
-            ++col;
         return c;
     }
 
@@ -661,6 +1401,32 @@ struct ic_lexer
         advance();
         return true;
     }
+
+    // indexes the rest of the source, this must be done before an error is reported (the whole line is printed)
+    // and when lexing is done
+    void index_remaining_lines()
+    {
+        for (const char* it = source_it; it != source_end; ++it)
+        {
+            if (*it == '\n')
+            {
+                source_lines->push_back({ line_begin, int(it - line_begin) });
+                line_begin = it + 1;
+            }
+        }
+
+        if (line_begin != source_end) // useful for host functions prototype_str error reporting
+            source_lines->push_back({ line_begin, int(source_end - line_begin) });
+        line_begin = source_end;
+    }
+
+    void error(int line, int col, const char* err_msg)
+    {
+        if (range)
+            return;
+        index_remaining_lines();
+        print(IC_PERROR, line, col, *source_lines, err_msg);
+    }
 };
 
 bool is_digit(char c)
@@ -673,10 +1439,88 @@ bool is_identifier_char(char c)
     return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
 }
 
+bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+enum ic_char_class
+{
+    IC_CHARS_IDENTIFIER,
+    IC_CHARS_DIGIT,
+    IC_CHARS_BLANK, // whitespace except a new line, new lines are counted
+};
+
+#define IC_SWAR_ONES 0x0101010101010101ull
+#define IC_SWAR_HIGHS 0x8080808080808080ull
+
+// SWAR (SIMD within a register) classification of 8 characters at a time, the high bit of a byte is set
+// if a character is in [lo, hi]; only valid for ASCII characters
+inline unsigned long long swar_in_range(unsigned long long chars, unsigned char lo, unsigned char hi)
+{
+    unsigned long long ge_lo = (chars | IC_SWAR_HIGHS) - IC_SWAR_ONES * lo;
+    unsigned long long gt_hi = (chars | IC_SWAR_HIGHS) - IC_SWAR_ONES * (hi + 1);
+    return ge_lo & ~gt_hi & IC_SWAR_HIGHS;
+}
+
+template<ic_char_class C>
+inline unsigned long long swar_in_class(unsigned long long chars)
+{
+    unsigned long long mask;
+
+    if (C == IC_CHARS_DIGIT)
+        mask = swar_in_range(chars, '0', '9');
+    else if (C == IC_CHARS_IDENTIFIER)
+        mask = swar_in_range(chars, '0', '9') | swar_in_range(chars, 'a', 'z') | swar_in_range(chars, 'A', 'Z') |
+            swar_in_range(chars, '_', '_');
+    else
+        mask = swar_in_range(chars, ' ', ' ') | swar_in_range(chars, '\t', '\t') | swar_in_range(chars, '\r', '\r');
+    return mask & ~chars; // exclude non-ASCII characters
+}
+
+template<ic_char_class C>
+inline bool in_class(char c)
+{
+    return C == IC_CHARS_DIGIT ? is_digit(c) : C == IC_CHARS_IDENTIFIER ? is_identifier_char(c) : is_blank(c);
+}
+
+// index of the first byte with the high bit set (in memory order), assumes a little-endian machine
+inline int first_marked_byte(unsigned long long mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return idx / 8;
+#else
+    return __builtin_ctzll(mask) / 8;
+#endif
+}
+
+// returns the first character that is not in a given class, or end
+template<ic_char_class C>
+const char* skip_chars(const char* it, const char* end)
+{
+    while (end - it >= 8)
+    {
+        unsigned long long chars;
+        memcpy(&chars, it, sizeof(chars));
+        unsigned long long stop = ~swar_in_class<C>(chars) & IC_SWAR_HIGHS;
+
+        if (stop)
+            return it + first_marked_byte(stop);
+        it += 8;
+    }
+
+    while (it != end && in_class<C>(*it))
+        ++it;
+    return it;
+}
+
 struct ic_keyword
 {
     const char* str;
     ic_token_type token_type;
+    int len;
 };
 
 static ic_keyword _keywords[] = {
@@ -702,53 +1546,117 @@ static ic_keyword _keywords[] = {
     {"sizeof", IC_TOK_SIZEOF},
 };
 
-bool lex(const char* source, ic_memory& memory)
+#define IC_KEYWORD_MIN_LEN 2
+#define IC_KEYWORD_MAX_LEN 8
+#define IC_KEYWORD_TABLE_SIZE 64
+
+// a perfect hash of _keywords, the multiplier was found by a search so that no two keywords collide;
+// must be updated when a keyword is added (build_keyword_table() asserts that)
+inline int keyword_hash(const char* str, int len)
 {
-    assert(source);
-    memory.tokens.clear();
-    memory.source_lines.clear();
+    return (str[0] + str[1] * 5 + len) & (IC_KEYWORD_TABLE_SIZE - 1);
+}
+
+struct ic_keyword_table
+{
+    ic_keyword slots[IC_KEYWORD_TABLE_SIZE]; // str is nullptr in an empty slot
+};
+
+ic_keyword_table build_keyword_table()
+{
+    ic_keyword_table table;
+    memset(&table, 0, sizeof(table));
+
+    for (ic_keyword keyword : _keywords)
+    {
+        keyword.len = strlen(keyword.str);
+        assert(keyword.len >= IC_KEYWORD_MIN_LEN && keyword.len <= IC_KEYWORD_MAX_LEN);
+        ic_keyword& slot = table.slots[keyword_hash(keyword.str, keyword.len)];
+        assert(!slot.str);
+        slot = keyword;
+    }
+    return table;
+}
+
+static ic_keyword_table _keyword_table = build_keyword_table();
+
+// returns IC_TOK_IDENTIFIER if a string is not a keyword
+ic_token_type keyword_token_type(ic_string string)
+{
+    if (string.len < IC_KEYWORD_MIN_LEN || string.len > IC_KEYWORD_MAX_LEN)
+        return IC_TOK_IDENTIFIER;
+
+    const ic_keyword& keyword = _keyword_table.slots[keyword_hash(string.data, string.len)];
+
+    if (keyword.len == string.len && !memcmp(keyword.str, string.data, string.len))
+        return keyword.token_type;
+    return IC_TOK_IDENTIFIER;
+}
+
+// returns a byte offset of the literal in the bytecode, equal literals are stored once
+static int intern_string_literal(const char* data, int len, ic_memory& memory)
+{
+    ic_array<int>& table = memory.string_table;
+
+    // keep the load factor below 1/2
+    if (memory.string_literals.size * 2 >= table.size)
     {
-        memory.source_lines.push_back(); // dummy line for index 0
-        const char* it = source;
-        const char* line_begin = it;
-        int len = 0;
+        table.resize(table.size ? table.size * 2 : 64);
+        memset(table.buf, 0, table.size * sizeof(int));
 
-        while (*it)
+        for (int i = 0; i < memory.string_literals.size; ++i)
         {
-            if (*it == '\n')
-            {
-                memory.source_lines.push_back({ line_begin, len });
-                len = 0;
-                line_begin = it + 1;
-            }
-            else
-                len += 1;
-            it += 1;
+            const char* literal = (const char*)memory.bytecode.buf + memory.string_literals.buf[i];
+            unsigned int idx = hash_bytes(IC_HASH_BASIS, literal, strlen(literal)) & (table.size - 1);
+
+            while (table.buf[idx])
+                idx = (idx + 1) & (table.size - 1);
+            table.buf[idx] = i + 1;
         }
+    }
+    unsigned int idx = hash_bytes(IC_HASH_BASIS, data, len) & (table.size - 1);
 
-        if(len != 0) // useful for host functions prototype_str error reporting
-            memory.source_lines.push_back({ line_begin, len });
+    // the source can't contain a null character, so strncmp() stops at the end of a shorter literal and a literal is equal
+    // if it ends where data does
+    while (table.buf[idx])
+    {
+        int offset = memory.string_literals.buf[table.buf[idx] - 1];
+        const char* literal = (const char*)memory.bytecode.buf + offset;
+
+        if (!strncmp(literal, data, len) && !literal[len])
+            return offset;
+        idx = (idx + 1) & (table.size - 1);
     }
+    int offset = memory.bytecode.size;
+    table.buf[idx] = memory.string_literals.size + 1;
+    memory.string_literals.push_back(offset);
+    memory.bytecode.resize(offset + len + 1);
+    memcpy(memory.bytecode.buf + offset, data, len);
+    memory.bytecode.back() = '\0';
+    return offset;
+}
 
-    ic_lexer lexer;
-    lexer.tokens = &memory.tokens;
-    lexer.line = 1;
-    lexer.col = 1;
-    lexer.source_it = source;
+// appends tokens up to lexer.source_end and an EOF token
+static bool lex_tokens(ic_lexer& lexer)
+{
+    ic_memory& memory = *lexer.memory;
 
     while (!lexer.end())
     {
+        lexer.source_it = skip_chars<IC_CHARS_BLANK>(lexer.source_it, lexer.source_end);
+
+        if (lexer.end())
+            break;
+
         lexer.token_line = lexer.line;
-        lexer.token_col = lexer.col;
+        lexer.token_col = lexer.col();
+        lexer.token_begin = lexer.source_it;
         const char c = lexer.advance();
-        const char* const token_begin = lexer.pos();
+        const char* const token_begin = lexer.token_begin;
 
         switch (c)
         {
-        case ' ':
-        case '\t':
         case '\n':
-        case '\r':
             break;
         case '(':
             lexer.add_token(IC_TOK_LEFT_PAREN);
@@ -811,7 +1719,7 @@ bool lex(const char* source, ic_memory& memory)
                 lexer.add_token(IC_TOK_VBAR_VBAR);
             else // single | is not allowed in the source code
             {
-                print(IC_PERROR, lexer.line, lexer.col, memory.source_lines, "unexpected character");
+                lexer.error(lexer.line, lexer.col(), "unexpected character");
                 return false;
             }
 
@@ -825,6 +1733,9 @@ bool lex(const char* source, ic_memory& memory)
             {
                 while (!lexer.end() && lexer.advance() != '\n')
                     ;
+
+                if (lexer.split && *lexer.pos() != '\n')
+                    return false;
             }
             else
                 lexer.add_token(IC_TOK_SLASH);
@@ -836,20 +1747,16 @@ bool lex(const char* source, ic_memory& memory)
             while (!lexer.end() && lexer.advance() != '"')
                 ;
 
-            if (lexer.end() && *lexer.pos() != '"')
+            // the opening quote can be the last character of a range
+            if (lexer.end() && (lexer.pos() == token_begin || *lexer.pos() != '"'))
             {
-                print(IC_PERROR, lexer.token_line, lexer.token_col, memory.source_lines, "unterminated string literal");
+                lexer.error(lexer.token_line, lexer.token_col, "unterminated string literal");
                 return false;
             }
 
-            // todo, if the same string literal already exists, reuse it
-            int idx_begin = memory.bytecode.size;
-            lexer.add_token_number(IC_TOK_STRING_LITERAL, idx_begin);
             const char* string_begin = token_begin + 1; // skip first "
             int len = lexer.pos() - string_begin; // this doesn't count last "
-            memory.bytecode.resize(idx_begin + len + 1);
-            memcpy(memory.bytecode.buf + idx_begin, string_begin, len);
-            memory.bytecode.back() = '\0';
+            lexer.add_token_value(IC_TOK_STRING_LITERAL, intern_string_literal(string_begin, len, memory));
             break;
         }
         case '\'':
@@ -857,9 +1764,10 @@ bool lex(const char* source, ic_memory& memory)
             while (!lexer.end() && lexer.advance() != '\'')
                 ;
 
-            if (lexer.end() && *lexer.pos() != '\'')
+            // the opening quote can be the last character of a range
+            if (lexer.end() && (lexer.pos() == token_begin || *lexer.pos() != '\''))
             {
-                print(IC_PERROR, lexer.token_line, lexer.token_col, memory.source_lines, "unterminated character literal");
+                lexer.error(lexer.token_line, lexer.token_col, "unterminated character literal");
                 return false;
             }
 
@@ -888,32 +1796,28 @@ bool lex(const char* source, ic_memory& memory)
 
             if (code == -1)
             {
-                print(IC_PERROR, lexer.token_line, lexer.token_col, memory.source_lines,
+                lexer.error(lexer.token_line, lexer.token_col,
                     "invalid character literal; only printable, \\n, \\0, \\r and \\t characters are supported");
                 return false;
             }
 
-            lexer.add_token_number(IC_TOK_CHARACTER_LITERAL, code);
+            lexer.add_token_value(IC_TOK_CHARACTER_LITERAL, code);
             break;
         }
         default:
         {
             if (is_digit(c))
             {
-                while (!lexer.end() && is_digit(lexer.peek()))
-                    lexer.advance();
-
+                lexer.source_it = skip_chars<IC_CHARS_DIGIT>(lexer.source_it, lexer.source_end);
                 ic_token_type token_type = IC_TOK_INT_NUMBER_LITERAL;
 
                 if (lexer.peek() == '.')
                 {
                     token_type = IC_TOK_FLOAT_NUMBER_LITERAL;
                     lexer.advance();
+                    lexer.source_it = skip_chars<IC_CHARS_DIGIT>(lexer.source_it, lexer.source_end);
                 }
 
-                while (!lexer.end() && is_digit(lexer.peek()))
-                    lexer.advance();
-
                 const int len = (lexer.pos() + 1) - token_begin;
                 char buf[1024];
                 assert(len < sizeof(buf));
@@ -923,44 +1827,162 @@ bool lex(const char* source, ic_memory& memory)
             }
             else if (is_identifier_char(c))
             {
-                while (!lexer.end() && is_identifier_char(lexer.peek()))
-                    lexer.advance();
-
-                ic_string string = { token_begin, int((lexer.pos() + 1) - token_begin) };
-                bool is_keyword = false;
-                ic_token_type token_type;
+                lexer.source_it = skip_chars<IC_CHARS_IDENTIFIER>(lexer.source_it, lexer.source_end);
+                ic_string string = { token_begin, int(lexer.source_it - token_begin) };
+                ic_token_type token_type = keyword_token_type(string);
 
-                for (const ic_keyword& keyword : _keywords)
+                if (token_type == IC_TOK_IDENTIFIER)
                 {
-                    if (string_compare(string, { keyword.str, int(strlen(keyword.str)) }))
-                    {
-                        is_keyword = true;
-                        token_type = keyword.token_type;
-                        break;
-                    }
+                    intern_identifier(string, memory);
+                    lexer.add_token_identifier(string);
                 }
-
-                if (!is_keyword)
-                    lexer.add_token_string(IC_TOK_IDENTIFIER, string);
                 else
                     lexer.add_token(token_type);
             }
             else
             {
-                print(IC_PERROR, lexer.token_line, lexer.token_col, memory.source_lines, "unexpected character");
+                lexer.error(lexer.token_line, lexer.token_col, "unexpected character");
                 return false;
             }
         }
         } // switch
     } // while
-    ic_token token;
-    token.type = IC_TOK_EOF;
-    token.line = lexer.line;
-    token.col = lexer.col;
-    lexer.tokens->push_back(token);
+    lexer.token_begin = lexer.source_end;
+    lexer.add_token(IC_TOK_EOF);
     return true;
 }
 
+bool lex(const char* source, ic_memory& memory)
+{
+    assert(source);
+    memory.token_types.clear();
+    memory.token_positions.clear();
+    memory.token_values.clear();
+    memory.token_numbers.clear();
+    memory.string_literals.clear();
+
+    if (memory.string_table.size)
+        memset(memory.string_table.buf, 0, memory.string_table.size * sizeof(int));
+    memory.source_lines.clear();
+    memory.source_lines.push_back({}); // dummy line for index 0
+    ic_lexer lexer;
+    lexer.memory = &memory;
+    lexer.source_lines = &memory.source_lines;
+    lexer.range = false;
+    lexer.split = false;
+    lexer.line = 1;
+    lexer.source = source;
+    lexer.source_it = source;
+    lexer.source_end = source + strlen(source);
+    lexer.line_begin = source;
+
+    if (!lex_tokens(lexer))
+        return false;
+    lexer.index_remaining_lines();
+    return true;
+}
+
+// appends tokens of [begin, end) of a source, positions are relative to the whole source; returns false without
+// printing anything on an error and if a literal or a comment doesn't end before end, see incremental.cpp
+bool lex_range(const char* source, int begin, int end, ic_memory& memory)
+{
+    ic_lexer lexer;
+    lexer.memory = &memory;
+    lexer.source_lines = &memory.source_lines;
+    lexer.range = true;
+    lexer.split = source[end] != '\0';
+    lexer.line = 0; // only used by errors
+    lexer.source = source;
+    lexer.source_it = source + begin;
+    lexer.source_end = source + end;
+    lexer.line_begin = source + begin;
+    return lex_tokens(lexer);
+}
+
+// the same lines lex() indexes
+void index_source_lines(const char* source, int size, ic_array<ic_string>& lines)
+{
+    lines.clear();
+    lines.push_back({}); // dummy line for index 0
+    const char* it = source;
+    const char* end = source + size;
+
+    for (;;)
+    {
+        const char* line_end = (const char*)memchr(it, '\n', end - it);
+
+        if (!line_end)
+            break;
+        lines.push_back({ it, int(line_end - it) });
+        it = line_end + 1;
+    }
+
+    if (it != end)
+        lines.push_back({ it, int(end - it) });
+}
+
+// updates lines of a source after [begin, old_end) of it was replaced with [begin, end) in place, so lines that
+// precede the edit don't change and lines that follow it move
+void update_source_lines(const char* source, int size, int begin, int old_end, int end, ic_array<ic_string>& lines)
+{
+    int delta = end - old_end;
+    // the line that contains begin
+    int first = 1;
+    int hi = lines.size;
+
+    while (first + 1 < hi)
+    {
+        int mid = (first + hi) / 2;
+
+        if (lines.buf[mid].data - source <= begin)
+            first = mid;
+        else
+            hi = mid;
+    }
+    // the first line that begins after old_end, the new line character that precedes it was not edited
+    int last = first;
+    hi = lines.size;
+
+    while (last < hi)
+    {
+        int mid = (last + hi) / 2;
+
+        if (lines.buf[mid].data - source > old_end)
+            hi = mid;
+        else
+            last = mid + 1;
+    }
+    const char* it = first < lines.size ? lines.buf[first].data : source;
+    const char* it_end = last < lines.size ? lines.buf[last].data + delta : source + size;
+    ic_array<ic_string> edited_lines;
+    edited_lines.init();
+
+    for (;;)
+    {
+        const char* line_end = (const char*)memchr(it, '\n', it_end - it);
+
+        if (!line_end)
+            break;
+        edited_lines.push_back({ it, int(line_end - it) });
+        it = line_end + 1;
+    }
+
+    if (it != it_end)
+        edited_lines.push_back({ it, int(it_end - it) });
+    int shift = edited_lines.size - (last - first);
+    int old_size = lines.size;
+
+    if (shift > 0)
+        lines.resize(old_size + shift);
+    memmove(lines.buf + last + shift, lines.buf + last, (old_size - last) * sizeof(ic_string));
+    lines.resize(old_size + shift);
+    memcpy(lines.buf + first, edited_lines.buf, edited_lines.size * sizeof(ic_string));
+
+    for (int i = first + edited_lines.size; i < lines.size; ++i)
+        lines.buf[i].data += delta;
+    edited_lines.free();
+}
+
 // these parsing functions must always terminate loops on EOF token and
 // never early return (there are some exceptions) to not leave behind any invalid pointers;
 
@@ -978,7 +2000,7 @@ bool try_produce_type(ic_parser& parser, ic_type& type, bool allow_void = false)
         init = true;
     }
 
-    switch (parser.get_token().type)
+    switch (parser.get_token_type())
     {
     case IC_TOK_BOOL:
         type.basic_type = IC_TYPE_BOOL;
@@ -1066,7 +2088,7 @@ void produce_parameter_list(ic_parser& parser, ic_function& function)
 
     // this is important; because exceptions are not used all loops must terminate on EOF token
     // either by condition fail or break that is guaranteed to execute
-    while(parser.get_token().type != IC_TOK_EOF)
+    while(parser.get_token_type() != IC_TOK_EOF)
     {
         if (function.param_count == IC_MAX_ARGC)
         {
@@ -1077,10 +2099,10 @@ void produce_parameter_list(ic_parser& parser, ic_function& function)
 
         ic_type param_type = produce_type(parser);
         function.params[function.param_count].type = param_type;
-        const ic_token* id_token = parser.token_it;
+        ic_token id_token = parser.get_token();
 
         if(parser.try_consume(IC_TOK_IDENTIFIER))
-            function.params[function.param_count].name = id_token->string;
+            function.params[function.param_count].name = id_token.string;
         else
             function.params[function.param_count].name = { nullptr };
 
@@ -1107,15 +2129,15 @@ enum ic_op_precedence
 };
 
 // production rules hierarchy
-ic_stmt* produce_stmt(ic_parser& parser);
-ic_stmt* produce_stmt_var_decl(ic_parser& parser);
-ic_expr* produce_expr_stmt(ic_parser& parser);
-ic_expr* produce_expr(ic_parser& parser);
-ic_expr* produce_expr_assignment(ic_parser& parser);
-ic_expr* produce_expr_binary(ic_parser& parser, ic_op_precedence precedence);
-ic_expr* produce_expr_unary(ic_parser& parser);
-ic_expr* produce_expr_subscript(ic_parser& parser);
-ic_expr* produce_expr_primary(ic_parser& parser);
+int produce_stmt(ic_parser& parser);
+int produce_stmt_var_decl(ic_parser& parser);
+int produce_expr_stmt(ic_parser& parser);
+int produce_expr(ic_parser& parser);
+int produce_expr_assignment(ic_parser& parser);
+int produce_expr_binary(ic_parser& parser, ic_op_precedence precedence);
+int produce_expr_unary(ic_parser& parser);
+int produce_expr_subscript(ic_parser& parser);
+int produce_expr_primary(ic_parser& parser);
 
 ic_decl produce_decl(ic_parser& parser)
 {
@@ -1132,8 +2154,7 @@ ic_decl produce_decl(ic_parser& parser)
             return decl;
 
         // this is to support constructions like a linked list without a previous struct declaration
-        if (!get_struct(_struct.token.string, *parser.memory))
-            *parser.memory->structs.allocate() = _struct;
+        add_struct_declaration(_struct, *parser.memory); // a forward declaration, does nothing if the struct is already declared
 
         _struct.defined = true;
         parser.consume(IC_TOK_LEFT_BRACE, "expected '{'");
@@ -1142,7 +2163,7 @@ ic_decl produce_decl(ic_parser& parser)
         _struct.byte_size = 0;
         _struct.alignment = 1;
 
-        while (parser.get_token().type != IC_TOK_RIGHT_BRACE && parser.get_token().type != IC_TOK_EOF)
+        while (parser.get_token_type() != IC_TOK_RIGHT_BRACE && parser.get_token_type() != IC_TOK_EOF)
         {
             if (_struct.members_size == IC_MAX_MEMBERS)
             {
@@ -1202,10 +2223,10 @@ ic_decl produce_decl(ic_parser& parser)
         produce_parameter_list(parser, function);
         function.body = produce_stmt(parser);
 
-        if (function.body->type != IC_STMT_COMPOUND)
+        if (parser.stmt(function.body)->type != IC_STMT_COMPOUND)
             parser.set_error("expected a compound stmt after function parameter list");
 
-        function.body->compound.push_scope = false; // do not allow shadowing of arguments
+        parser.stmt(function.body)->compound.push_scope = false; // do not allow shadowing of arguments
         return decl;
     }
 
@@ -1218,99 +2239,118 @@ ic_decl produce_decl(ic_parser& parser)
     decl.var.type = type;
     decl.var.token = token_id;
 
-    if (parser.get_token().type == IC_TOK_EQUAL)
+    if (parser.get_token_type() == IC_TOK_EQUAL)
         parser.set_error("global variables can't be initialized by an expression, they are memset to 0");
 
     parser.consume(IC_TOK_SEMICOLON, "expected ';'");
     return decl;
 }
 
-ic_stmt* produce_stmt(ic_parser& parser)
+int produce_stmt(ic_parser& parser)
 {
-    switch (parser.get_token().type)
+    switch (parser.get_token_type())
     {
     case IC_TOK_LEFT_BRACE:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_COMPOUND, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_COMPOUND, parser.token_idx);
         parser.advance();
-        stmt->compound.push_scope = true;
-        ic_stmt** body_tail  = &(stmt->compound.body);
+        parser.stmt(stmt)->compound.push_scope = true;
+        int tail = 0;
 
-        while (parser.get_token().type != IC_TOK_RIGHT_BRACE && parser.get_token().type != IC_TOK_EOF)
+        while (parser.get_token_type() != IC_TOK_RIGHT_BRACE && parser.get_token_type() != IC_TOK_EOF)
         {
-            *body_tail = produce_stmt(parser);
-            body_tail = &((*body_tail)->next);
+            int body_stmt = produce_stmt(parser);
+
+            if (tail)
+                parser.stmt(tail)->next = body_stmt;
+            else
+                parser.stmt(stmt)->compound.body = body_stmt;
+            tail = body_stmt;
         }
         parser.consume(IC_TOK_RIGHT_BRACE, "expected '}' to close a compound statement");
         return stmt;
     }
     case IC_TOK_WHILE:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_FOR, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_FOR, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_LEFT_PAREN, "expected '(' after while keyword");
-        stmt->_for.header2 = produce_expr(parser);
+        int header = produce_expr(parser);
+        parser.stmt(stmt)->_for.header2 = header;
         parser.consume(IC_TOK_RIGHT_PAREN, "expected ')' after while condition");
-        stmt->_for.body = produce_stmt(parser);
+        int body = produce_stmt(parser);
+        parser.stmt(stmt)->_for.body = body;
 
         // be consistent with IC_TOK_FOR
-        if (stmt->_for.body->type == IC_STMT_COMPOUND)
-            stmt->_for.body->compound.push_scope = false;
+        if (parser.stmt(body)->type == IC_STMT_COMPOUND)
+            parser.stmt(body)->compound.push_scope = false;
         return stmt;
     }
     case IC_TOK_FOR:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_FOR, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_FOR, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_LEFT_PAREN, "expected '(' after for keyword");
-        stmt->_for.header1 = produce_stmt_var_decl(parser); // only in header1 var declaration is allowed
-        stmt->_for.header2 = produce_expr_stmt(parser);
+        int header1 = produce_stmt_var_decl(parser); // only in header1 var declaration is allowed
+        parser.stmt(stmt)->_for.header1 = header1;
+        int header2 = produce_expr_stmt(parser);
+        parser.stmt(stmt)->_for.header2 = header2;
 
-        if (parser.get_token().type != IC_TOK_RIGHT_PAREN)
-            stmt->_for.header3 = produce_expr(parser); // this one should not end with ';', that's why we don't use produce_stmt_expr()
+        if (parser.get_token_type() != IC_TOK_RIGHT_PAREN)
+        {
+            int header3 = produce_expr(parser); // this one should not end with ';', that's why we don't use produce_stmt_expr()
+            parser.stmt(stmt)->_for.header3 = header3;
+        }
 
         parser.consume(IC_TOK_RIGHT_PAREN, "expected ')' after for header");
-        stmt->_for.body = produce_stmt(parser);
+        int body = produce_stmt(parser);
+        parser.stmt(stmt)->_for.body = body;
 
         // prevent shadowing of header variable
-        if (stmt->_for.body->type == IC_STMT_COMPOUND)
-            stmt->_for.body->compound.push_scope = false;
+        if (parser.stmt(body)->type == IC_STMT_COMPOUND)
+            parser.stmt(body)->compound.push_scope = false;
         return stmt;
     }
     case IC_TOK_IF:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_IF, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_IF, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_LEFT_PAREN, "expected '(' after if keyword");
-        stmt->_if.header = produce_expr(parser);
+        int header = produce_expr(parser);
+        parser.stmt(stmt)->_if.header = header;
 
-        if (stmt->_if.header->token.type == IC_TOK_EQUAL)
+        if (parser.memory->token_types.buf[parser.expr(header)->token] == IC_TOK_EQUAL)
             parser.set_error("assignment expression can't be used directly in an if header, encolse it with ()");
 
         parser.consume(IC_TOK_RIGHT_PAREN, "expected ')' after if condition");
-        stmt->_if.body_if = produce_stmt(parser);
+        int body_if = produce_stmt(parser);
+        parser.stmt(stmt)->_if.body_if = body_if;
 
         if (parser.try_consume(IC_TOK_ELSE))
-            stmt->_if.body_else = produce_stmt(parser);
+        {
+            int body_else = produce_stmt(parser);
+            parser.stmt(stmt)->_if.body_else = body_else;
+        }
         return stmt;
     }
     case IC_TOK_RETURN:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_RETURN, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_RETURN, parser.token_idx);
         parser.advance();
-        stmt->_return.expr = produce_expr_stmt(parser);
+        int expr = produce_expr_stmt(parser);
+        parser.stmt(stmt)->_return.expr = expr;
         return stmt;
     }
     case IC_TOK_BREAK:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_BREAK, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_BREAK, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_SEMICOLON, "expected ';' after break keyword");
         return stmt;
     }
     case IC_TOK_CONTINUE:
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_CONTINUE, parser.get_token());
+        int stmt = parser.allocate_stmt(IC_STMT_CONTINUE, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_SEMICOLON, "expected ';' after continue keyword");
         return stmt;
@@ -1321,21 +2361,22 @@ ic_stmt* produce_stmt(ic_parser& parser)
 
 // this function is seperate from produce_expr_assignment so we don't allow(): var x = var y = 5;
 // and: while(var x = 6);
-ic_stmt* produce_stmt_var_decl(ic_parser& parser)
+int produce_stmt_var_decl(ic_parser& parser)
 {
     ic_type type;
-    ic_token init_token = parser.get_token();
+    int init_token = parser.token_idx;
 
     if (try_produce_type(parser, type))
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_VAR_DECL, init_token);
-        stmt->var_decl.type = type;
-        stmt->var_decl.token = parser.get_token();
+        int stmt = parser.allocate_stmt(IC_STMT_VAR_DECL, init_token);
+        parser.stmt(stmt)->var_decl.type = type;
+        parser.stmt(stmt)->var_decl.token = parser.token_idx;
         parser.consume(IC_TOK_IDENTIFIER, "expected a variable name");
 
         if (parser.try_consume(IC_TOK_EQUAL))
         {
-            stmt->var_decl.expr = produce_expr_stmt(parser);
+            int expr = produce_expr_stmt(parser);
+            parser.stmt(stmt)->var_decl.expr = expr;
             return stmt;
         }
         parser.consume(IC_TOK_SEMICOLON, "expected ';' or '=' after a variable name");
@@ -1343,22 +2384,23 @@ ic_stmt* produce_stmt_var_decl(ic_parser& parser)
     }
     else
     {
-        ic_stmt* stmt = parser.allocate_stmt(IC_STMT_EXPR, init_token);
-        stmt->expr = produce_expr_stmt(parser);
+        int stmt = parser.allocate_stmt(IC_STMT_EXPR, init_token);
+        int expr = produce_expr_stmt(parser);
+        parser.stmt(stmt)->expr = expr;
         return stmt;
     }
 }
 
-ic_expr* produce_expr_stmt(ic_parser& parser)
+int produce_expr_stmt(ic_parser& parser)
 {
     if (parser.try_consume(IC_TOK_SEMICOLON))
-        return nullptr;
-    ic_expr* expr = produce_expr(parser);
+        return 0;
+    int expr = produce_expr(parser);
     parser.consume(IC_TOK_SEMICOLON, "expected ';' after an expression");
     return expr;
 }
 
-ic_expr* produce_expr(ic_parser& parser)
+int produce_expr(ic_parser& parser)
 {
     return produce_expr_assignment(parser);
 }
@@ -1366,27 +2408,28 @@ ic_expr* produce_expr(ic_parser& parser)
 // produce_expr_assignment() - grows down and right
 // produce_expr_binary() - grows up and right (given operators with the same precedence)
 
-ic_expr* produce_expr_assignment(ic_parser& parser)
+int produce_expr_assignment(ic_parser& parser)
 {
-    ic_expr* expr_lhs = produce_expr_binary(parser, IC_PRECEDENCE_LOGICAL_OR);
+    int expr_lhs = produce_expr_binary(parser, IC_PRECEDENCE_LOGICAL_OR);
 
-    switch (parser.get_token().type)
+    switch (parser.get_token_type())
     {
     case IC_TOK_EQUAL:
     case IC_TOK_PLUS_EQUAL:
     case IC_TOK_MINUS_EQUAL:
     case IC_TOK_STAR_EQUAL:
     case IC_TOK_SLASH_EQUAL:
-        ic_expr* expr = parser.allocate_expr(IC_EXPR_BINARY, parser.get_token());
+        int expr = parser.allocate_expr(IC_EXPR_BINARY, parser.token_idx);
         parser.advance();
-        expr->binary.rhs = produce_expr(parser);
-        expr->binary.lhs = expr_lhs;
+        int expr_rhs = produce_expr(parser);
+        parser.expr(expr)->binary.rhs = expr_rhs;
+        parser.expr(expr)->binary.lhs = expr_lhs;
         return expr;
     }
     return expr_lhs;
 }
 
-ic_expr* produce_expr_binary(ic_parser& parser, ic_op_precedence precedence)
+int produce_expr_binary(ic_parser& parser, ic_op_precedence precedence)
 {
     ic_token_type target_token_types[5] = {}; // this is important, initialize all elements to IC_TOK_EOF
 
@@ -1433,7 +2476,7 @@ ic_expr* produce_expr_binary(ic_parser& parser, ic_op_precedence precedence)
         return produce_expr_unary(parser);
     }
 
-    ic_expr* expr = produce_expr_binary(parser, ic_op_precedence(int(precedence) + 1));
+    int expr = produce_expr_binary(parser, ic_op_precedence(int(precedence) + 1));
 
     for (;;)
     {
@@ -1442,7 +2485,7 @@ ic_expr* produce_expr_binary(ic_parser& parser, ic_op_precedence precedence)
 
         while (*target_token_type != IC_TOK_EOF)
         {
-            if (*target_token_type == parser.get_token().type)
+            if (*target_token_type == parser.get_token_type())
             {
                 match = true;
                 break;
@@ -1454,18 +2497,19 @@ ic_expr* produce_expr_binary(ic_parser& parser, ic_op_precedence precedence)
             break; // important, avoid infinite loop
 
         // operator matches given precedence
-        ic_expr* expr_parent = parser.allocate_expr(IC_EXPR_BINARY, parser.get_token());
+        int expr_parent = parser.allocate_expr(IC_EXPR_BINARY, parser.token_idx);
         parser.advance();
-        expr_parent->binary.rhs = produce_expr_binary(parser, ic_op_precedence(int(precedence) + 1));
-        expr_parent->binary.lhs = expr;
+        int expr_rhs = produce_expr_binary(parser, ic_op_precedence(int(precedence) + 1));
+        parser.expr(expr_parent)->binary.rhs = expr_rhs;
+        parser.expr(expr_parent)->binary.lhs = expr;
         expr = expr_parent;
     }
     return expr;
 }
 
-ic_expr* produce_expr_unary(ic_parser& parser)
+int produce_expr_unary(ic_parser& parser)
 {
-    switch (parser.get_token().type)
+    switch (parser.get_token_type())
     {
     case IC_TOK_BANG:
     case IC_TOK_MINUS:
@@ -1474,9 +2518,10 @@ ic_expr* produce_expr_unary(ic_parser& parser)
     case IC_TOK_AMPERSAND:
     case IC_TOK_STAR:
     {
-        ic_expr* expr = parser.allocate_expr(IC_EXPR_UNARY, parser.get_token());
+        int expr = parser.allocate_expr(IC_EXPR_UNARY, parser.token_idx);
         parser.advance();
-        expr->unary.expr = produce_expr_unary(parser);
+        int operand = produce_expr_unary(parser);
+        parser.expr(expr)->unary.expr = operand;
         return expr;
     }
     case IC_TOK_LEFT_PAREN:
@@ -1487,20 +2532,21 @@ ic_expr* produce_expr_unary(ic_parser& parser)
         if (try_produce_type(parser, type))
         {
             parser.consume(IC_TOK_RIGHT_PAREN, "expected ) at the end of a cast operator");
-            ic_expr* expr = parser.allocate_expr(IC_EXPR_CAST_OPERATOR, parser.get_token());
-            expr->cast_operator.type = type;
-            expr->cast_operator.expr = produce_expr_unary(parser);
+            int expr = parser.allocate_expr(IC_EXPR_CAST_OPERATOR, parser.token_idx);
+            parser.expr(expr)->cast_operator.type = type;
+            int operand = produce_expr_unary(parser);
+            parser.expr(expr)->cast_operator.expr = operand;
             return expr;
         }
-        parser.token_it -= 1; // go back by one, parentheses expression also starts with '('
+        parser.token_idx -= 1; // go back by one, parentheses expression also starts with '('
         break;
     }
     case IC_TOK_SIZEOF:
     {
-        ic_expr* expr = parser.allocate_expr(IC_EXPR_SIZEOF, parser.get_token());
+        int expr = parser.allocate_expr(IC_EXPR_SIZEOF, parser.token_idx);
         parser.advance();
         parser.consume(IC_TOK_LEFT_PAREN, "expected '(' after sizeof operator");
-        expr->_sizeof.type = produce_type(parser);
+        parser.expr(expr)->_sizeof.type = produce_type(parser);
         parser.consume(IC_TOK_RIGHT_PAREN, "expected ')' after a type");
         return expr;
     }
@@ -1508,27 +2554,28 @@ ic_expr* produce_expr_unary(ic_parser& parser)
     return produce_expr_subscript(parser);
 }
 
-ic_expr* produce_expr_subscript(ic_parser& parser)
+int produce_expr_subscript(ic_parser& parser)
 {
-    ic_expr* lhs = produce_expr_primary(parser);
+    int lhs = produce_expr_primary(parser);
 
     for (;;)
     {
-        if (parser.get_token().type == IC_TOK_LEFT_BRACKET)
+        if (parser.get_token_type() == IC_TOK_LEFT_BRACKET)
         {
-            ic_expr* expr = parser.allocate_expr(IC_EXPR_SUBSCRIPT, parser.get_token());
+            int expr = parser.allocate_expr(IC_EXPR_SUBSCRIPT, parser.token_idx);
             parser.advance();
-            expr->subscript.lhs = lhs;
-            expr->subscript.rhs = produce_expr(parser);
+            parser.expr(expr)->subscript.lhs = lhs;
+            int rhs = produce_expr(parser);
+            parser.expr(expr)->subscript.rhs = rhs;
             parser.consume(IC_TOK_RIGHT_BRACKET, "expected a closing bracket for a subscript operator");
             lhs = expr;
         }
-        else if (parser.get_token().type == IC_TOK_DOT || parser.get_token().type == IC_TOK_ARROW)
+        else if (parser.get_token_type() == IC_TOK_DOT || parser.get_token_type() == IC_TOK_ARROW)
         {
-            ic_expr* expr = parser.allocate_expr(IC_EXPR_MEMBER_ACCESS, parser.get_token());
+            int expr = parser.allocate_expr(IC_EXPR_MEMBER_ACCESS, parser.token_idx);
             parser.advance();
-            expr->member_access.lhs = lhs;
-            expr->member_access.rhs_token = parser.get_token();
+            parser.expr(expr)->member_access.lhs = lhs;
+            parser.expr(expr)->member_access.rhs_token = parser.token_idx;
             parser.consume(IC_TOK_IDENTIFIER, "expected a member name after a member access operator");
             lhs = expr;
         }
@@ -1538,9 +2585,9 @@ ic_expr* produce_expr_subscript(ic_parser& parser)
     return lhs;
 }
 
-ic_expr* produce_expr_primary(ic_parser& parser)
+int produce_expr_primary(ic_parser& parser)
 {
-    switch (parser.get_token().type)
+    switch (parser.get_token_type())
     {
     case IC_TOK_INT_NUMBER_LITERAL:
     case IC_TOK_FLOAT_NUMBER_LITERAL:
@@ -1550,29 +2597,34 @@ ic_expr* produce_expr_primary(ic_parser& parser)
     case IC_TOK_FALSE:
     case IC_TOK_NULLPTR:
     {
-        ic_expr* expr = parser.allocate_expr(IC_EXPR_PRIMARY, parser.get_token());
+        int expr = parser.allocate_expr(IC_EXPR_PRIMARY, parser.token_idx);
         parser.advance();
         return expr;
     }
     case IC_TOK_IDENTIFIER:
     {
-        ic_token token_id = parser.get_token();
+        int token_id = parser.token_idx;
         parser.advance();
 
         if (parser.try_consume(IC_TOK_LEFT_PAREN))
         {
-            ic_expr* expr = parser.allocate_expr(IC_EXPR_FUNCTION_CALL, token_id);
+            int expr = parser.allocate_expr(IC_EXPR_FUNCTION_CALL, token_id);
 
             if (parser.try_consume(IC_TOK_RIGHT_PAREN))
                 return expr;
 
-            ic_expr** arg_tail = &expr->function_call.arg;
+            int tail = 0;
             int argc = 0;
 
-            while(parser.get_token().type != IC_TOK_EOF) // important, avoid infinite loop
+            while(parser.get_token_type() != IC_TOK_EOF) // important, avoid infinite loop
             {
-                *arg_tail = produce_expr(parser);
-                arg_tail = &((*arg_tail)->next);
+                int arg = produce_expr(parser);
+
+                if (tail)
+                    parser.expr(tail)->next = arg;
+                else
+                    parser.expr(expr)->function_call.arg = arg;
+                tail = arg;
                 ++argc;
 
                 if (parser.try_consume(IC_TOK_RIGHT_PAREN))
@@ -1586,13 +2638,14 @@ ic_expr* produce_expr_primary(ic_parser& parser)
     }
     case IC_TOK_LEFT_PAREN:
     {
-        ic_expr* expr = parser.allocate_expr(IC_EXPR_PARENTHESES, parser.get_token());
+        int expr = parser.allocate_expr(IC_EXPR_PARENTHESES, parser.token_idx);
         parser.advance();
-        expr->parentheses.expr = produce_expr(parser);
+        int operand = produce_expr(parser);
+        parser.expr(expr)->parentheses.expr = operand;
         parser.consume(IC_TOK_RIGHT_PAREN, "expected ')' after an expression");
         return expr;
     }
     } // switch
     parser.set_error("expected a literal / an indentifier / parentheses / a function call");
-    return parser.allocate_expr({}, {}); // don't return nullptr, may be dereferenced
+    return parser.allocate_expr({}, parser.token_idx); // don't return the null node, may be dereferenced
 }
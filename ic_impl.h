@@ -28,6 +28,10 @@ static_assert(sizeof(double) == 8, "sizeof(double) == 8");
 static_assert(sizeof(void*) == 8, "sizeof(void*) == 8");
 
 #define IC_MAX_ARGC 10
+#define IC_STACK_SIZE (1024 * 1024) // in ic_data
+// ic_program::frame_sizes has an entry for each 8 bytes of code, functions that begin in the same 8 bytes share the largest
+// frame size
+#define IC_FRAME_SIZES_SHIFT 3
 
 // this is quite important to know:
 // local variables are packed with a proper alignment and padded as a whole to ic_data
@@ -56,6 +60,7 @@ enum ic_opcode
     IC_OPC_CLONE,
     IC_OPC_CALL,
     IC_OPC_CALL_HOST,
+    IC_OPC_CALL_LAZY, // operand is an index into ic_memory::active_source_functions, see lazy_compile_function()
     IC_OPC_RETURN,
     IC_OPC_JUMP_TRUE,
     IC_OPC_JUMP_FALSE,
@@ -63,6 +68,7 @@ enum ic_opcode
     IC_OPC_JUMP,
     IC_OPC_ADDRESS, // operand is a byte offset from a base pointer
     IC_OPC_ADDRESS_GLOBAL, // similar
+    IC_OPC_ADDRESS_STRING, // operand is a byte offset into read-only string literals, see ic_program::strings
 
     // order of operands on the operand stack is reversed (data before address)
     // address is popped, data is left
@@ -89,6 +95,8 @@ enum ic_opcode
     IC_OPC_MUL_S32,
     IC_OPC_DIV_S32,
     IC_OPC_MODULO_S32,
+    IC_OPC_SHL_S32, // operand is a shift count; emitted by optimizations only
+    IC_OPC_SHR_S32, // arithmetic shift that rounds toward zero, same as a division by a power of two
 
     IC_OPC_COMPARE_E_F32,
     IC_OPC_COMPARE_NE_F32,
@@ -157,6 +165,7 @@ enum ic_opcode
     IC_OPC_F64_U8,
     IC_OPC_F64_S32,
     IC_OPC_F64_F32,
+    IC_OPC_COUNT,
 };
 
 // todo, is unsigned char any better than int? memory-wise yes,
@@ -298,13 +307,14 @@ struct ic_string
 {
     const char* data;
     int len;
+    int id; // an index into ic_memory::identifiers if the string is an interned identifier, otherwise 0
 };
 
+// a decoded token, see ic_memory::token_types
 struct ic_token
 {
     ic_token_type type;
-    int line;
-    int col;
+    int pos; // a byte offset in the source, print() converts it to a line and a column
 
     union
     {
@@ -323,25 +333,30 @@ struct ic_type
     ic_struct* _struct;
 };
 
+// AST nodes are stored in ic_memory::exprs and ic_memory::stmts and reference each other and tokens by indices;
+// index 0 is a null node
 // todo, combine ic_expr and ic_stmt into a single ast_node structure
 // maybe this way is better?
 struct ic_expr
 {
     ic_expr_type type;
-    ic_token token;
-    ic_expr* next;
+    int token;
+    int next;
+    bool annotated;
+    // the type of a loaded result, set on the first compilation so type queries of operands do not recompile them
+    ic_type result_type;
 
     union
     {
         struct
         {
-            ic_expr* lhs;
-            ic_expr* rhs;
+            int lhs;
+            int rhs;
         } binary;
 
         struct
         {
-            ic_expr* expr;
+            int expr;
         } unary;
 
         struct
@@ -352,29 +367,29 @@ struct ic_expr
         struct
         {
             ic_type type;
-            ic_expr* expr;
+            int expr;
         } cast_operator;
 
         struct
         {
-            ic_expr* lhs;
-            ic_expr* rhs;
+            int lhs;
+            int rhs;
         } subscript;
 
         struct
         {
-            ic_expr* lhs;
-            ic_token rhs_token;
+            int lhs;
+            int rhs_token;
         } member_access;
 
         struct
         {
-            ic_expr* expr;
+            int expr;
         } parentheses;
 
         struct
         {
-            ic_expr* arg;
+            int arg;
         } function_call;
     };
 };
@@ -382,45 +397,45 @@ struct ic_expr
 struct ic_stmt
 {
     ic_stmt_type type;
-    ic_token token;
-    ic_stmt* next;
+    int token;
+    int next;
 
     union
     {
         struct
         {
             bool push_scope;
-            ic_stmt* body;
+            int body;
         } compound;
 
         struct
         {
-            ic_stmt* header1;
-            ic_expr* header2;
-            ic_expr* header3;
-            ic_stmt* body;
+            int header1; // stmt
+            int header2;
+            int header3;
+            int body; // stmt
         } _for;
 
         struct
         {
-            ic_expr* header;
-            ic_stmt* body_if;
-            ic_stmt* body_else;
+            int header;
+            int body_if; // stmt
+            int body_else; // stmt
         } _if;
 
         struct
         {
             ic_type type;
-            ic_token token;
-            ic_expr* expr;
+            int token;
+            int expr;
         } var_decl;
 
         struct
         {
-            ic_expr* expr;
+            int expr;
         } _return;
         
-        ic_expr* expr;
+        int expr;
     };
 };
 
@@ -435,6 +450,12 @@ struct ic_function
     ic_function_type type;
     ic_type return_type;
     ic_token token;
+    int tokens_begin; // token range of a source function definition
+    int tokens_end;
+    // set by incremental compilation and kept with the AST of a function, see incremental.cpp
+    unsigned long long text_hash; // of the definition
+    unsigned long long signature_hash; // of the return type, the name and the parameters
+    int chunk; // an index into ic_memory::chunks, -1 if there is none
     int param_count;
     // todo, allocate, same as struct members?
     ic_param params[IC_MAX_ARGC];
@@ -443,7 +464,7 @@ struct ic_function
     {
         struct
         {
-            ic_stmt* body;
+            int body; // an index into ic_memory::stmts
             int instr_idx;
         };
         ic_host_function* host_function;
@@ -480,6 +501,75 @@ struct ic_var
     ic_type type;
     ic_string name;
     int byte_idx;
+    int shadowed; // an index into ic_memory::vars of a variable with the same name from an outer scope, -1 if there is none
+};
+
+// declarations of an identifier; -1 or nullptr if there is none
+struct ic_symbol
+{
+    int function; // an index into ic_memory::functions
+    int active_function; // an index into ic_memory::active_source_functions or active_host_functions
+    int global_var; // an index into ic_memory::global_vars
+    int var; // an index into ic_memory::vars of a variable from the innermost scope
+    ic_struct* _struct;
+    int generation; // see ic_memory::symbol()
+};
+
+enum ic_reloc_type
+{
+    IC_RELOC_JUMP, // operand is a byte offset from a chunk begin
+    IC_RELOC_CALL, // target is an index of a chunk callee
+    IC_RELOC_CALL_HOST, // same
+    IC_RELOC_STRING, // target is an index of a string literal in a function, operand is a byte offset from the literal
+    IC_RELOC_GLOBAL, // target is an index of a global variable, operand is a byte offset from the variable
+};
+
+struct ic_reloc
+{
+    ic_reloc_type type;
+    int offset; // of an operand, from a chunk begin
+    int target;
+};
+
+struct ic_chunk_callee
+{
+    int name_begin; // name is in ic_chunk_store::names
+    int name_len;
+    int name_id; // an identifier id, valid while ic_chunk_store::generation is ic_memory::generation
+    unsigned long long signature_hash; // 0 for host functions, these don't change within a context
+};
+
+// code from an offset up to the next row is compiled from a source line
+struct ic_line_row
+{
+    int offset;
+    int line;
+};
+
+// position independent bytecode of a compiled function
+struct ic_chunk
+{
+    int name_begin;
+    int name_len;
+    unsigned long long text_hash;
+    int code_begin;
+    int code_size;
+    int relocs_begin;
+    int relocs_size;
+    int callees_begin;
+    int callees_size;
+    int lines_begin;
+    int lines_size;
+};
+
+// a top-level declaration of the source of the last incremental compilation
+struct ic_source_decl
+{
+    int text_begin;
+    int text_end;
+    int tokens_begin;
+    int tokens_end;
+    int function; // an index into ic_memory::functions, -1 for a struct or a global variable
 };
 
 template<typename T>
@@ -605,6 +695,13 @@ struct ic_deque
         return &get(size - 1);
     }
 
+    // drops elements allocated after the first new_size, pools are kept for reuse
+    void truncate(int new_size)
+    {
+        assert(new_size <= size);
+        size = new_size;
+    }
+
     T* allocate_chunk(int chunk_size)
     {
         assert(chunk_size <= N);
@@ -662,13 +759,90 @@ ic_type non_pointer_type(ic_basic_type type);
 ic_type const_pointer1_type(ic_basic_type type);
 ic_type pointer1_type(ic_basic_type type);
 void print(ic_print_type type, int line, int col, ic_array<ic_string>& source_lines, const char* err_msg);
+void print(ic_print_type type, int pos, ic_array<ic_string>& source_lines, const char* err_msg);
+int source_line(int pos, ic_array<ic_string>& source_lines);
 int type_data_size(ic_type type);
 int type_byte_size(ic_type type);
 int align(int bytes, int type_size);
 struct ic_memory;
+void intern_identifier(ic_string& string, ic_memory& memory);
+bool lex(const char* source, ic_memory& memory);
 ic_function* get_function(ic_string name, ic_memory& memory);
 ic_var* get_global_var(ic_string name, ic_memory& memory);
 
+// host functions of the core library and of a host table by an origin and a prototype, binds imports of loaded programs;
+// entries are compared by the whole prototype, the hash only selects a slot
+struct ic_host_index
+{
+    ic_array<ic_host_function*> slots; // open addressing, nullptr is an empty slot, the size is a power of two
+
+    void init() { slots.init(); }
+    void free() { slots.free(); }
+    // sets origin and hash of table entries like load_host_functions() does, which must have set their sizes before
+    void build(int libs, ic_host_function* host_functions);
+    ic_host_function* find(int origin, const char* prototype_str);
+};
+
+bool program_init_load(ic_program& program, const unsigned char* buf, int size, ic_host_index& host_index);
+
+// functions of the last successful incremental compilation, see incremental.cpp
+struct ic_chunk_store
+{
+    ic_array<ic_chunk> chunks;
+    ic_array<unsigned char> code;
+    ic_array<ic_reloc> relocs;
+    ic_array<ic_chunk_callee> callees;
+    ic_array<char> names;
+    ic_array<ic_line_row> lines; // offsets are from a chunk begin, lines are from the line of a function name
+    unsigned long long layout_hash; // chunks can be reused only if ic_memory::layout_hash is the same
+    int generation; // ic_memory::generation of the compilation
+
+    void init()
+    {
+        chunks.init();
+        code.init();
+        relocs.init();
+        callees.init();
+        names.init();
+        lines.init();
+        layout_hash = 0;
+        generation = -1;
+    }
+
+    void free()
+    {
+        chunks.free();
+        code.free();
+        relocs.free();
+        callees.free();
+        names.free();
+        lines.free();
+    }
+
+    void clear()
+    {
+        chunks.clear();
+        code.clear();
+        relocs.clear();
+        callees.clear();
+        names.clear();
+        lines.clear();
+        layout_hash = 0;
+        generation = -1;
+    }
+};
+
+// a compiler error or warning that is printed later, see ic_memory::report()
+struct ic_message
+{
+    ic_print_type type;
+    int pos;
+    const char* text;
+};
+
+struct ic_compile_pool; // see parallel.cpp
+void free_compile_pool(ic_compile_pool* pool);
+
 struct ic_scope
 {
     int prev_stack_size;
@@ -680,7 +854,16 @@ struct ic_memory
     ic_deque<char, 10000> generic_pool;
     ic_deque<ic_struct, 100> structs;
     ic_array<ic_string> source_lines;
-    ic_array<ic_token> tokens;
+    // tokens of the last lexed source as a structure of arrays, token() decodes a single token
+    ic_array<ic_token_type> token_types;
+    ic_array<int> token_positions;
+    ic_array<int> token_values; // an identifier id, index into token_numbers, string literal index or character code
+    ic_array<double> token_numbers; // number literals
+    // distinct string literals of the last lexed source, equal literals share bytes
+    ic_array<int> string_literals; // byte offsets into bytecode
+    ic_array<int> string_table; // open addressing, string_literals index + 1 (0 is an empty slot), the size is a power of two
+    ic_array<ic_expr> exprs;
+    ic_array<ic_stmt> stmts;
     ic_array<ic_function*> active_source_functions;
     ic_array<ic_function*> active_host_functions;
     ic_array<unsigned char> bytecode;
@@ -691,13 +874,78 @@ struct ic_memory
     ic_array<int> break_ops;
     ic_array<int> cont_ops;
     ic_array<int> call_ops;
+    ic_array<ic_var> frame_vars; // all variables of a function that is being compiled, also from closed scopes; used by optimizations
+    ic_array<ic_line_row> lines; // IC_COMPILE_LINE_TABLE, offsets into bytecode in ascending order, see ic_compiler::mark_line()
+    ic_array<ic_string> identifiers; // indexed by ic_string::id, index 0 is not used
+    ic_array<ic_symbol> symbols; // indexed by ic_string::id
+    ic_array<int> identifier_table; // open addressing, identifier ids (0 is an empty slot), the size is a power of two
+    ic_array<int> identifier_stamps; // generation of each identifier_table slot, see is_slot_used()
+    int flags; // ic_compile_flag
+    unsigned long long layout_hash; // of struct and global variable declarations and flags, set by parse_program()
+    // chunks of the previous incremental compilation and chunks of the current one, these are kept by reset()
+    ic_chunk_store chunks;
+    ic_chunk_store next_chunks;
+    // the source of the last incremental compilation and its declarations; the next one lexes and parses only
+    // declarations that were edited and keeps the tokens and the AST of the others, reset() drops them
+    ic_array<char> source;
+    ic_array<ic_source_decl> source_decls;
+    ic_array<unsigned char> source_strings; // string literals of the kept tokens
+    int source_tokens; // tokens of source_decls, other tokens are left from edited declarations
+    bool own_identifiers; // new identifiers are copied to generic_pool so they don't point into a source
+    // the bytecode of the last incremental compilation; if only bodies of a few functions were edited, these are
+    // appended to it and calls are redirected to them instead of linking all functions again
+    ic_array<unsigned char> linked_bytecode;
+    ic_array<int> linked_call_ops;
+    int linked_garbage; // bytes of functions that were replaced
+    bool linked; // linked_bytecode is valid
+    ic_array<char> struct_decls; // copy of host struct declarations, identifiers of host structs point to it
+    ic_array<char> lazy_source; // copy of a lazy program source, see IC_COMPILE_LAZY
+    unsigned long long declarations_hash; // a part of program cache keys, see cache.cpp
+    // ic_compiler_context; host declarations are loaded first and kept between compilations, reset() drops everything
+    // else by truncating arrays and bumping the generation which lazily invalidates entries of the hash tables
+    int generation;
+    int persistent_identifiers;
+    int persistent_functions;
+    int persistent_structs;
+    int persistent_generic_pool;
+    ic_array<ic_symbol> persistent_symbols; // symbols of host identifiers as they were after loading host declarations
+    ic_array<ic_struct*> declared_structs; // host structs that are declared but not defined, a source may define them
+    ic_host_index host_index; // built once, host declarations don't change
+    // parallel compilation; threads compile into worker memories, these record messages and activated functions so
+    // the link step can print and activate them in the order of the serial compilation
+    int threads;
+    ic_compile_pool* pool;
+    bool worker;
+    ic_array<ic_message> messages;
+    ic_array<ic_function*> activations;
 
     void init()
     {
+        flags = 0;
+        declarations_hash = 0;
+        generation = 0;
+        persistent_identifiers = 0;
+        persistent_functions = 0;
+        persistent_structs = 0;
+        persistent_generic_pool = 0;
+        source_tokens = 0;
+        own_identifiers = false;
+        linked_garbage = 0;
+        linked = false;
+        threads = 1;
+        pool = nullptr;
+        worker = false;
         generic_pool.init();
         structs.init();
         source_lines.init();
-        tokens.init();
+        token_types.init();
+        token_positions.init();
+        token_values.init();
+        token_numbers.init();
+        string_literals.init();
+        string_table.init();
+        exprs.init();
+        stmts.init();
         active_source_functions.init();
         active_host_functions.init();
         bytecode.init();
@@ -708,6 +956,181 @@ struct ic_memory
         break_ops.init();
         cont_ops.init();
         call_ops.init();
+        frame_vars.init();
+        lines.init();
+        identifiers.init();
+        symbols.init();
+        identifier_table.init();
+        identifier_stamps.init();
+        chunks.init();
+        next_chunks.init();
+        source.init();
+        source_decls.init();
+        source_strings.init();
+        linked_bytecode.init();
+        linked_call_ops.init();
+        struct_decls.init();
+        lazy_source.init();
+        persistent_symbols.init();
+        declared_structs.init();
+        host_index.init();
+        messages.init();
+        activations.init();
+        identifiers.push_back({});
+        symbols.push_back({});
+        exprs.push_back({}); // null nodes
+        stmts.push_back({});
+    }
+
+    ic_token token(int idx)
+    {
+        ic_token token;
+        token.type = token_types.buf[idx];
+        token.pos = token_positions.buf[idx];
+        int value = token_values.buf[idx];
+
+        switch (token.type)
+        {
+        case IC_TOK_IDENTIFIER:
+            token.string = identifiers.buf[value];
+            break;
+        case IC_TOK_INT_NUMBER_LITERAL:
+        case IC_TOK_FLOAT_NUMBER_LITERAL:
+            token.number = token_numbers.buf[value];
+            break;
+        default:
+            token.number = value;
+        }
+        return token;
+    }
+
+    // symbols of host identifiers may still hold declarations of a previous compilation, they are restored on the first access
+    ic_symbol& symbol(ic_string name)
+    {
+        assert(name.id);
+        ic_symbol& symbol = symbols.buf[name.id];
+
+        if (symbol.generation != generation)
+        {
+            symbol = persistent_symbols.buf[name.id];
+            symbol.generation = generation;
+        }
+        return symbol;
+    }
+
+    // returns an index into active_source_functions or active_host_functions, a function is added on the first call
+    int activate_function(ic_function* function)
+    {
+        ic_array<ic_function*>& active_functions = function->type == IC_FUN_HOST ? active_host_functions : active_source_functions;
+        ic_symbol& symbol = this->symbol(function->token.string);
+
+        if (worker)
+            activations.push_back(function);
+
+        if (symbol.active_function == -1)
+        {
+            symbol.active_function = active_functions.size;
+            active_functions.push_back(function);
+        }
+        return symbol.active_function;
+    }
+
+    void report(ic_print_type type, int pos, const char* msg)
+    {
+        if (worker)
+            messages.push_back({ type, pos, msg });
+        else
+            print(type, pos, source_lines, msg);
+    }
+
+    // identifiers of host declarations are never invalidated, their probe sequences can't contain newer slots
+    bool is_slot_used(int idx)
+    {
+        int id = identifier_table.buf[idx];
+        return id && (id < persistent_identifiers || identifier_stamps.buf[idx] == generation);
+    }
+
+    // called after host declarations are loaded
+    void mark_persistent()
+    {
+        persistent_identifiers = identifiers.size;
+        persistent_functions = functions.size;
+        persistent_structs = structs.size;
+        persistent_generic_pool = generic_pool.size;
+        persistent_symbols.resize(symbols.size);
+        memcpy(persistent_symbols.buf, symbols.buf, symbols.size * sizeof(ic_symbol));
+
+        for (int i = 0; i < structs.size; ++i)
+        {
+            if (!structs.get(i).defined)
+                declared_structs.push_back(&structs.get(i));
+        }
+    }
+
+    // prepares for the next compilation, keeps host declarations and allocated memory
+    void reset()
+    {
+        generation += 1;
+        generic_pool.truncate(persistent_generic_pool);
+        structs.truncate(persistent_structs);
+        functions.resize(persistent_functions);
+        identifiers.resize(persistent_identifiers);
+        symbols.resize(persistent_identifiers);
+
+        for (ic_struct* _struct : declared_structs)
+            _struct->defined = false;
+
+        exprs.resize(1);
+        stmts.resize(1);
+        active_source_functions.clear();
+        active_host_functions.clear();
+        global_vars.clear();
+        scopes.clear();
+        vars.clear();
+        break_ops.clear();
+        cont_ops.clear();
+        call_ops.clear();
+        frame_vars.clear();
+        source_decls.clear();
+        own_identifiers = false;
+        linked = false;
+        lines.clear();
+
+        // the previous program took the buffer
+        if (bytecode.buf)
+            bytecode.clear();
+        else
+            bytecode.init();
+    }
+
+    // prepares for compiling the same declarations again, see incremental.cpp
+    void reset_compilation()
+    {
+        scopes.clear();
+        vars.clear();
+        break_ops.clear();
+        cont_ops.clear();
+        call_ops.clear();
+        frame_vars.clear();
+        lines.clear();
+
+        if (bytecode.buf)
+            bytecode.clear();
+        else
+            bytecode.init();
+    }
+
+    // functions are activated again by activate_main() and calls
+    void deactivate_functions()
+    {
+        for (ic_function* function : active_source_functions)
+            symbol(function->token.string).active_function = -1;
+
+        for (ic_function* function : active_host_functions)
+            symbol(function->token.string).active_function = -1;
+
+        active_source_functions.clear();
+        active_host_functions.clear();
     }
 
     void free()
@@ -715,7 +1138,14 @@ struct ic_memory
         generic_pool.free();
         structs.free();
         source_lines.free();
-        tokens.free();
+        token_types.free();
+        token_positions.free();
+        token_values.free();
+        token_numbers.free();
+        string_literals.free();
+        string_table.free();
+        exprs.free();
+        stmts.free();
         active_source_functions.free();
         active_host_functions.free();
         bytecode.free();
@@ -726,6 +1156,29 @@ struct ic_memory
         break_ops.free();
         cont_ops.free();
         call_ops.free();
+        frame_vars.free();
+        lines.free();
+        identifiers.free();
+        symbols.free();
+        identifier_table.free();
+        identifier_stamps.free();
+        chunks.free();
+        next_chunks.free();
+        source.free();
+        source_decls.free();
+        source_strings.free();
+        linked_bytecode.free();
+        linked_call_ops.free();
+        struct_decls.free();
+        lazy_source.free();
+        persistent_symbols.free();
+        declared_structs.free();
+        host_index.free();
+        messages.free();
+        activations.free();
+
+        if (pool)
+            free_compile_pool(pool);
     }
 
     // add a padding so the next allocation is aligned to double (the largest type this code is using)
@@ -736,6 +1189,156 @@ struct ic_memory
     }
 };
 
+// 64 bit FNV-1a, a hash starts with IC_HASH_BASIS
+#define IC_HASH_BASIS 14695981039346656037ull
+unsigned long long hash_bytes(unsigned long long hash, const void* data, int bytes);
+int tokens_text_end(int tokens_end, ic_memory& memory);
+bool is_identifier_char(char c);
+bool lex_range(const char* source, int begin, int end, ic_memory& memory);
+void index_source_lines(const char* source, int size, ic_array<ic_string>& lines);
+void update_source_lines(const char* source, int size, int begin, int old_end, int end, ic_array<ic_string>& lines);
+void place_global_var(ic_program& program, ic_var& var);
+bool parse_program(ic_program& program, const char* source, ic_memory& memory, ic_array<ic_source_decl>* decls = nullptr);
+bool parse_function_definitions(int tokens_begin, ic_memory& memory, ic_array<ic_function>& functions,
+    ic_array<ic_source_decl>& decls);
+bool activate_main(ic_memory& memory);
+bool compile_unused_functions(ic_memory& memory);
+bool link_program(ic_program& program, ic_memory& memory);
+bool compile_functions_parallel(ic_memory& memory);
+int lazy_compile_function(ic_program& program, int fun_idx);
+bool verify_program(ic_program& program);
+void build_line_table(ic_program& program, ic_memory& memory);
+
+// see ic_vm_enable_stats()
+struct ic_vm_stats
+{
+    ic_array<unsigned long long> offsets; // indexed by a bytecode offset
+    unsigned long long opcodes[IC_OPC_COUNT];
+    unsigned long long pairs[IC_OPC_COUNT][IC_OPC_COUNT]; // [previous][next]
+    int prev_opcode; // -1 at the beginning of a run
+
+    void count(int offset, ic_opcode opcode)
+    {
+        // a lazy program appends code while it runs
+        if (offset >= offsets.size)
+            grow(offset + 1);
+        offsets.buf[offset] += 1;
+        opcodes[opcode] += 1;
+
+        if (prev_opcode != -1)
+            pairs[prev_opcode][opcode] += 1;
+        prev_opcode = opcode;
+    }
+
+    void grow(int size)
+    {
+        int begin = offsets.size;
+        offsets.resize(size);
+        memset(offsets.buf + begin, 0, (size - begin) * sizeof(unsigned long long));
+    }
+};
+
+// a source or a host function of a profile, see ic_vm_enable_profile()
+struct ic_profile_node
+{
+    int function; // an offset of the first instruction or an index into ic_program::host_functions
+    bool host;
+    int active; // frames of a function on the call stack, cycles of recursive calls are added to inclusive once
+    unsigned long long calls;
+    unsigned long long inclusive;
+    unsigned long long exclusive;
+};
+
+// calls of a callee from a single call site
+struct ic_profile_edge
+{
+    int caller; // an index into nodes
+    int callee;
+    int call; // an offset of the call instruction
+    unsigned long long calls;
+    unsigned long long inclusive;
+};
+
+struct ic_profile_frame
+{
+    int node;
+    int edge; // -1 for main()
+    unsigned long long begin; // cycles at the entry
+    unsigned long long callees; // inclusive cycles of calls made by the frame
+};
+
+struct ic_vm_profile
+{
+    ic_array<ic_profile_node> nodes;
+    ic_array<ic_profile_edge> edges;
+    ic_array<int> edge_table; // open addressing, an edge index + 1 (0 is an empty slot), the size is a power of two
+    ic_array<int> source_nodes; // indexed by a bytecode offset, -1 if there is no node
+    ic_array<int> host_nodes; // indexed by a host function index, -1 if there is no node
+    ic_array<ic_profile_frame> frames;
+};
+
+// written by the interpreter loop, read by a signal handler of the sampling profiler, see vm_sampling.cpp
+struct ic_vm_sampler
+{
+    unsigned char* volatile ip; // an entry or a return address of the current function, not of the current instruction
+    ic_data* volatile bp; // nullptr while the position is updated or a lazy program is compiled
+    volatile int host_function; // an index of a running host function, -1 if there is none
+    unsigned char* volatile bytecode; // of a program that runs
+    volatile int bytecode_size;
+    ic_data* stack;
+    // each sample is a stack size, a host function and offsets from the current function to main()
+    int* samples;
+    int samples_capacity;
+    volatile int samples_size;
+    volatile int lost; // samples without a published position or that didn't fit into the buffer
+    int frequency;
+    void* timer;
+
+    void publish(unsigned char* _ip, ic_data* _bp)
+    {
+        bp = nullptr;
+        ip = _ip;
+        bp = _bp;
+    }
+};
+
+void sampler_start(ic_vm_sampler& sampler, ic_program& program);
+void sampler_stop(ic_vm_sampler& sampler);
+void sampler_free(ic_vm_sampler* sampler);
+int profile_source_node(ic_vm_profile& profile, int offset);
+int profile_host_node(ic_vm_profile& profile, int host_function);
+// call is an offset of the call instruction, it is not used for main()
+void profile_enter(ic_vm_profile& profile, int node, int call, unsigned long long cycles);
+void profile_leave(ic_vm_profile& profile, unsigned long long cycles);
+
+// a function of a line table
+struct ic_line_function
+{
+    int offset; // of the first instruction, into bytecode
+    int name; // null terminated, from the beginning of the names of a line table
+};
+
+// a decoded line table of a program for lookups by bytecode offsets, see line_table.cpp
+struct ic_line_map
+{
+    ic_array<ic_line_row> rows;
+    ic_array<ic_line_function> functions;
+    const char* names; // points into the line table, so a program must outlive a map
+
+    void init() { rows.init(); functions.init(); names = nullptr; }
+    void free() { rows.free(); functions.free(); }
+    // returns false if a program has no line table or the table is not valid
+    bool build(ic_program& program);
+    int line_at(int offset); // 0 if unknown
+    int function_at(int offset); // an index into functions, -1 if unknown
+    const char* name(int function) { return names + functions.buf[function].name; }
+};
+bool program_init_compile_incremental_impl(ic_program& program, const char* source, int flags, ic_memory& memory);
+unsigned long long hash_declarations(int libs, ic_host_function* host_functions, const char* struct_decls);
+unsigned long long program_cache_key(const char* source, int flags, ic_memory& memory);
+bool load_cached_program(ic_program& program, const char* cache_dir, unsigned long long key, ic_memory& memory);
+void store_cached_program(ic_program& program, const char* cache_dir, unsigned long long key);
+
 struct ic_expr_result
 {
     ic_type type;
@@ -759,14 +1362,30 @@ struct ic_compiler
         if (error)
             return;
         error = true;
-        print(IC_PERROR, token.line, token.col, memory->source_lines, err_msg);
+        memory->report(IC_PERROR, token.pos, err_msg);
     }
 
     void warn(ic_token token, const char* msg)
     {
         if (error)
             return;
-        print(IC_PWARNING, token.line, token.col, memory->source_lines, msg);
+        memory->report(IC_PWARNING, token.pos, msg);
+    }
+
+    // nullptr for the null node
+    ic_expr* expr(int idx)
+    {
+        return idx ? memory->exprs.buf + idx : nullptr;
+    }
+
+    ic_stmt* stmt(int idx)
+    {
+        return idx ? memory->stmts.buf + idx : nullptr;
+    }
+
+    ic_token token(int idx)
+    {
+        return memory->token(idx);
     }
 
     int bc_size()
@@ -791,11 +1410,31 @@ struct ic_compiler
 
     void pop_scope()
     {
+        for (int i = memory->vars.size - 1; i >= memory->scopes.back().prev_var_count; --i)
+        {
+            ic_var& var = memory->vars.buf[i];
+            memory->symbol(var.name).var = var.shadowed;
+        }
         memory->vars.resize(memory->scopes.back().prev_var_count);
         stack_byte_size = memory->scopes.back().prev_stack_size;
         memory->scopes.pop_back();
     }
 
+    // code emitted from now on is compiled from the line of a token, see IC_COMPILE_LINE_TABLE
+    void mark_line(ic_token token)
+    {
+        if (!code_gen || !(memory->flags & IC_COMPILE_LINE_TABLE))
+            return;
+        ic_array<ic_line_row>& lines = memory->lines;
+        int line = source_line(token.pos, memory->source_lines);
+
+        // a statement may not emit any code
+        if (lines.size && lines.back().offset == bc_size())
+            lines.back().line = line;
+        else if (!lines.size || lines.back().line != line || lines.back().offset < function->instr_idx)
+            lines.push_back({ bc_size(), line });
+    }
+
     void add_opcode(ic_opcode opcode)
     {
         assert(opcode >= 0 && opcode <= 255);
@@ -866,18 +1505,21 @@ struct ic_compiler
         memory->call_ops.push_back(bc_size());
     }
 
-    ic_var declare_var(ic_type type, ic_string name, ic_token token)
+    // returns false if a variable with the same name is already declared in the current scope
+    bool push_var(ic_var& var)
     {
         assert(memory->scopes.size);
+        ic_symbol& symbol = memory->symbol(var.name);
+        bool unique = symbol.var < memory->scopes.back().prev_var_count;
+        var.shadowed = symbol.var;
+        symbol.var = memory->vars.size;
+        memory->vars.push_back(var);
+        memory->frame_vars.push_back(var);
+        return unique;
+    }
 
-        for (int i = memory->vars.size - 1; i >= memory->scopes.back().prev_var_count; --i)
-        {
-            if (string_compare(memory->vars.buf[i].name, name))
-            {
-                set_error(token, "variable with such name is already declared in the current scope");
-                break;
-            }
-        }
+    ic_var declare_var(ic_type type, ic_string name, ic_token token)
+    {
         ic_var var;
         var.type = type;
         var.name = name;
@@ -885,7 +1527,9 @@ struct ic_compiler
         int align_size = is_struct(var.type) ? var.type._struct->alignment : byte_size;
         stack_byte_size = align(stack_byte_size, align_size);
         var.byte_idx = stack_byte_size;
-        memory->vars.push_back(var);
+
+        if (!push_var(var))
+            set_error(token, "variable with such name is already declared in the current scope");
         stack_byte_size += byte_size;
         max_stack_byte_size = stack_byte_size > max_stack_byte_size ? stack_byte_size : max_stack_byte_size;
         return var;
@@ -906,31 +1550,18 @@ struct ic_compiler
         if (!code_gen)
             return function;
 
-        ic_array<ic_function*>& active_functions = function->type == IC_FUN_HOST ? memory->active_host_functions : memory->active_source_functions;
-
-        for(int i = 0; i < active_functions.size; ++i)
-        {
-            ic_function* active = active_functions.buf[i];
-            if (active == function)
-            {
-                *idx = i;
-                return function;
-            }
-        }
-        *idx = active_functions.size;
-        active_functions.push_back(function);
+        *idx = memory->activate_function(function);
         return function;
     }
 
     ic_var get_var(ic_string name, bool* is_global, ic_token token)
     {
-        for (int i = memory->vars.size - 1; i >= 0; --i)
+        int var_idx = memory->symbol(name).var;
+
+        if (var_idx != -1)
         {
-            if (string_compare(memory->vars.buf[i].name, name))
-            {
-                *is_global = false;
-                return memory->vars.buf[i];
-            }
+            *is_global = false;
+            return memory->vars.buf[var_idx];
         }
 
         ic_var* global_var = get_global_var(name, *memory);
@@ -966,3 +1597,187 @@ void compile_load(ic_type type, ic_compiler& compiler);
 void compile_store(ic_type type, ic_compiler& compiler);
 void compile_pop_expr_result(ic_expr_result result, ic_compiler& compiler);
 int pointed_type_byte_size(ic_type type, ic_compiler& compiler);
+
+// ir.cpp
+// the IR is a typed SSA form of a single function; it is built from the bytecode that compile_function() has just emitted
+// for the function AST and lowered back in place; operand stack slots are SSA values (block entry slots that merge
+// different values become phis), local and global variables stay in memory and are accessed by load and store instructions
+
+enum ic_operand_kind: unsigned char
+{
+    IC_OPERAND_NONE,
+    IC_OPERAND_S8,
+    IC_OPERAND_S32,
+    IC_OPERAND_F32,
+    IC_OPERAND_F64,
+    IC_OPERAND_S32X3,
+};
+
+enum ic_ir_type: unsigned char
+{
+    IC_IR_S8, // also bool
+    IC_IR_S32,
+    IC_IR_F32,
+    IC_IR_F64,
+    IC_IR_PTR,
+    IC_IR_W32, // memory word of an unknown type, produced by a load
+    IC_IR_W64,
+    IC_IR_SLOT, // raw ic_data, e.g. a part of a struct or a space for a return value
+};
+
+#define IC_VARIABLE -1
+
+struct ic_opcode_info
+{
+    const char* name;
+    ic_operand_kind operand;
+    signed char pops; // IC_VARIABLE if it depends on an operand
+    signed char pushes;
+    ic_ir_type type; // type of pushed values
+    bool pure; // no side effects other than on the operand stack
+};
+
+union ic_ir_operand
+{
+    char s8;
+    int s32;
+    float f32;
+    double f64;
+    int s32x3[3];
+};
+
+struct ic_ir_instr
+{
+    ic_opcode opcode;
+    ic_ir_operand operand;
+    int target; // block index of a jump target
+    // ssa, set by ir_build_ssa(); values are stored in ic_ir_function::refs
+    int args_begin; // values popped by an instruction, from the bottom of the stack
+    int args_size;
+    int results_begin; // values pushed by an instruction, these may be the same values as args (e.g. swap, clone, store)
+    int results_size;
+    int line; // see IC_COMPILE_LINE_TABLE; 0 for instructions that optimizations insert, these take a line of the previous one
+};
+
+// a block without a terminating jump or return falls through to the next block in the array
+struct ic_ir_block
+{
+    ic_array<ic_ir_instr> instrs;
+    // ssa
+    bool reachable;
+    int succs[2];
+    int succs_size;
+    int preds_begin;
+    int preds_size;
+    int entry_begin; // operand stack at the block entry
+    int entry_size;
+    int phis_begin;
+    int phis_size;
+};
+
+struct ic_ir_phi
+{
+    int value;
+    int args_begin; // one value per predecessor, in the order of block preds
+};
+
+struct ic_ir_value
+{
+    ic_ir_type type;
+    int block;
+    int instr; // IC_VARIABLE for a phi
+    int use_count;
+};
+
+enum ic_ir_base: unsigned char
+{
+    IC_IR_BASE_UNKNOWN, // e.g. a pointer loaded from memory
+    IC_IR_BASE_LOCAL,
+    IC_IR_BASE_GLOBAL,
+};
+
+// where an address value points to
+struct ic_ir_address
+{
+    ic_ir_base base;
+    bool known_offset;
+    int root; // operand of the address / address_global instruction the value is derived from
+    int offset; // byte offset from root, valid if known_offset
+};
+
+struct ic_ir_range
+{
+    int begin;
+    int end;
+};
+
+struct ic_ir_function
+{
+    ic_function* function;
+    ic_memory* memory;
+    int frame_size; // local variables data size, an operand of the entry push_many
+    int initial_instr_count;
+    ic_array<ic_ir_block> blocks;
+    ic_array<ic_ir_range> locals; // byte ranges of all local variables and parameters, see ic_memory::frame_vars
+    // ssa
+    ic_array<ic_ir_value> values;
+    ic_array<ic_ir_phi> phis;
+    ic_array<int> refs;
+    // ir_analyze_memory()
+    ic_array<ic_ir_address> addresses; // one per value
+    ic_array<ic_ir_range> escaped; // local memory that may be accessed through pointers unknown to a function
+
+    int* ref(int idx) { return refs.buf + idx; }
+    ic_ir_instr& instr(ic_ir_value value) { return blocks.buf[value.block].instrs.buf[value.instr]; }
+};
+
+struct ic_ir_pass
+{
+    const char* name;
+    bool (*run)(ic_ir_function& fn); // returns true if a function was changed
+};
+
+// instructions [begin, end] of a block
+struct ic_ir_span
+{
+    int block;
+    int begin;
+    int end;
+};
+
+// memory access of a load or a store; a store of an unknown base may write anything except local memory that has not escaped
+struct ic_ir_access
+{
+    ic_ir_base base;
+    ic_ir_range range;
+};
+
+const ic_opcode_info& opcode_info(ic_opcode opcode);
+int operand_byte_size(ic_operand_kind kind);
+int function_param_size(ic_function& function);
+bool is_jump(ic_opcode opcode);
+void stack_effect(ic_ir_function& fn, ic_ir_instr& instr, int* pops, int* pushes);
+ic_ir_instr make_instr(ic_opcode opcode);
+void optimize_function(ic_function& function, ic_memory& memory);
+bool ir_build_ssa(ic_ir_function& fn);
+void ir_print(ic_ir_function& fn);
+ic_ir_block& ir_insert_block(ic_ir_function& fn, int idx);
+void ir_remove_block(ic_ir_function& fn, int idx);
+void ir_insert_instr(ic_ir_block& block, int idx, ic_ir_instr instr);
+void ir_remove_instrs(ic_ir_block& block, int idx, int count);
+int ir_instr_count(ic_ir_function& fn);
+int ir_allocate_slot(ic_ir_function& fn);
+void ir_insert_slot_store(ic_ir_block& block, int idx, int slot);
+void ir_replace_with_slot_load(ic_ir_block& block, ic_ir_span span, int slot);
+bool ir_is_expression(ic_opcode opcode);
+void ir_compute_dominators(ic_ir_function& fn, ic_array<int>& idom);
+bool ir_dominates(ic_array<int>& idom, int dominator, int block);
+void ir_analyze_memory(ic_ir_function& fn);
+bool ir_access(ic_ir_function& fn, ic_ir_instr& instr, ic_ir_access* access);
+bool ir_may_alias(ic_ir_function& fn, ic_ir_access lhs, ic_ir_access rhs);
+bool ir_call_clobbers(ic_ir_function& fn, ic_ir_access access);
+bool ir_pass_dce(ic_ir_function& fn);
+bool ir_pass_licm(ic_ir_function& fn);
+bool ir_pass_ivsr(ic_ir_function& fn);
+bool ir_pass_cse(ic_ir_function& fn);
+bool ir_pass_peephole(ic_ir_function& fn);
@@ -0,0 +1,815 @@
+#include "ic_impl.h"
+
+// incremental compilation; the bytecode of every compiled function is saved as a position independent chunk, the next
+// compilation copies and relocates a chunk instead of compiling a function again if the function text, the signatures of
+// its callees and the layout of structs and global variables are the same; tokens and the AST are kept as well, only
+// function definitions that overlap the edited text are lexed and parsed again; if only bodies of a few functions were
+// edited, the previous program is patched instead of linking all functions again
+
+// patching redirects calls of each edited function, linking everything is cheaper for many of them
+#define IC_MAX_PATCHED_FUNCTIONS 16
+
+// function definitions that reparse_edited_functions() parsed again
+struct ic_edit
+{
+    ic_array<ic_function> replaced; // previous records of the edited functions, if signatures are the same
+    int functions_begin; // index of the first edited function in ic_memory::functions
+    bool same_signatures;
+    bool new_strings; // the edited functions have new string literals, the code that follows them moves
+};
+
+static unsigned long long function_text_hash(ic_function& function, const char* source, ic_memory& memory)
+{
+    int begin = memory.token_positions.buf[function.tokens_begin];
+    return hash_bytes(IC_HASH_BASIS, source + begin, tokens_text_end(function.tokens_end, memory) - begin);
+}
+
+// the text of a return type, a name and parameters
+static unsigned long long function_signature_hash(ic_function& function, const char* source, ic_memory& memory)
+{
+    if (function.type == IC_FUN_HOST)
+        return 0;
+    int begin = memory.token_positions.buf[function.tokens_begin];
+    int end = memory.token_positions.buf[memory.stmts.buf[function.body].token];
+    return hash_bytes(IC_HASH_BASIS, source + begin, end - begin);
+}
+
+// a callee of a chunk must have the same signature
+static unsigned long long callee_signature_hash(ic_function& function)
+{
+    return function.type == IC_FUN_HOST ? 0 : function.signature_hash;
+}
+
+static void hash_functions(ic_function* begin, ic_function* end, const char* source, ic_memory& memory)
+{
+    for (ic_function* function = begin; function != end; ++function)
+    {
+        if (function->type == IC_FUN_HOST)
+            continue;
+        function->text_hash = function_text_hash(*function, source, memory);
+        function->signature_hash = function_signature_hash(*function, source, memory);
+        function->chunk = -1;
+    }
+}
+
+// byte offsets of string literals of a function, in the order of appearance
+static void function_strings(ic_function& function, ic_memory& memory, ic_array<int>& strings)
+{
+    strings.clear();
+
+    for (int i = function.tokens_begin; i < function.tokens_end; ++i)
+    {
+        if (memory.token_types.buf[i] == IC_TOK_STRING_LITERAL)
+            strings.push_back(memory.token_values.buf[i]);
+    }
+}
+
+static int add_name(ic_chunk_store& store, ic_string name)
+{
+    int begin = store.names.size;
+    store.names.resize(begin + name.len);
+    memcpy(store.names.buf + begin, name.data, name.len);
+    return begin;
+}
+
+// the name is interned so it can be looked up, it is valid until the chunk store is cleared
+static ic_string chunk_name(ic_chunk_store& store, int begin, int len, ic_memory& memory)
+{
+    ic_string name;
+    name.data = store.names.buf + begin;
+    name.len = len;
+    intern_identifier(name, memory);
+    return name;
+}
+
+// saves the bytecode that compile_function() has just emitted to a store; returns false if the bytecode can't be
+// relocated, then the function is compiled every time
+static bool save_chunk(ic_function& function, ic_chunk_store& store, ic_array<int>& strings, ic_memory& memory)
+{
+    int base = function.instr_idx;
+    ic_chunk chunk;
+    chunk.text_hash = function.text_hash;
+    chunk.code_begin = store.code.size;
+    chunk.code_size = memory.bytecode.size - base;
+    chunk.relocs_begin = store.relocs.size;
+    chunk.callees_begin = store.callees.size;
+    chunk.lines_begin = store.lines.size;
+    int names_size = store.names.size;
+    store.code.resize(chunk.code_begin + chunk.code_size);
+    unsigned char* code = store.code.buf + chunk.code_begin;
+    memcpy(code, memory.bytecode.buf + base, chunk.code_size);
+    function_strings(function, memory, strings);
+    int offset = 0;
+
+    while (offset < chunk.code_size)
+    {
+        ic_opcode opcode = (ic_opcode)code[offset];
+        int next_offset = offset + 1 + operand_byte_size(opcode_info(opcode).operand);
+        ic_reloc reloc;
+        reloc.offset = offset + 1;
+        reloc.target = 0;
+        int operand = 0;
+
+        if (opcode_info(opcode).operand == IC_OPERAND_S32)
+            memcpy(&operand, code + reloc.offset, sizeof(int));
+
+        switch (opcode)
+        {
+        case IC_OPC_JUMP:
+        case IC_OPC_JUMP_TRUE:
+        case IC_OPC_JUMP_FALSE:
+            reloc.type = IC_RELOC_JUMP;
+            operand -= base;
+            break;
+        case IC_OPC_CALL:
+        case IC_OPC_CALL_HOST:
+        {
+            reloc.type = opcode == IC_OPC_CALL ? IC_RELOC_CALL : IC_RELOC_CALL_HOST;
+            ic_array<ic_function*>& active_functions = opcode == IC_OPC_CALL ? memory.active_source_functions :
+                memory.active_host_functions;
+            ic_function& callee = *active_functions.buf[operand];
+            ic_chunk_callee chunk_callee;
+            chunk_callee.name_begin = add_name(store, callee.token.string);
+            chunk_callee.name_len = callee.token.string.len;
+            chunk_callee.name_id = callee.token.string.id;
+            chunk_callee.signature_hash = callee_signature_hash(callee);
+            reloc.target = store.callees.size - chunk.callees_begin;
+            store.callees.push_back(chunk_callee);
+            break;
+        }
+        case IC_OPC_ADDRESS_GLOBAL:
+        case IC_OPC_ADDRESS_STRING:
+        {
+            // offsets are relative to the variable or the literal that contains the operand; variables are sorted by
+            // offsets, literals of a function are not, because equal literals of a source share bytes
+            bool global = opcode == IC_OPC_ADDRESS_GLOBAL;
+            reloc.type = global ? IC_RELOC_GLOBAL : IC_RELOC_STRING;
+            reloc.target = -1;
+            int target_begin = -1;
+
+            if (global)
+            {
+                for (reloc.target = memory.global_vars.size - 1; reloc.target >= 0; --reloc.target)
+                {
+                    target_begin = memory.global_vars.buf[reloc.target].byte_idx;
+
+                    if (target_begin <= operand)
+                        break;
+                }
+            }
+            else
+            {
+                for (int i = 0; i < strings.size; ++i)
+                {
+                    if (strings.buf[i] <= operand && strings.buf[i] > target_begin)
+                    {
+                        reloc.target = i;
+                        target_begin = strings.buf[i];
+                    }
+                }
+            }
+
+            if (reloc.target == -1)
+            {
+                store.code.resize(chunk.code_begin);
+                store.relocs.resize(chunk.relocs_begin);
+                store.callees.resize(chunk.callees_begin);
+                store.names.resize(names_size);
+                return false;
+            }
+            operand -= target_begin;
+            break;
+        }
+        default:
+            offset = next_offset;
+            continue;
+        }
+        memcpy(code + reloc.offset, &operand, sizeof(int));
+        store.relocs.push_back(reloc);
+        offset = next_offset;
+    }
+    assert(offset == chunk.code_size);
+    chunk.name_begin = add_name(store, function.token.string);
+    chunk.name_len = function.token.string.len;
+    chunk.relocs_size = store.relocs.size - chunk.relocs_begin;
+    chunk.callees_size = store.callees.size - chunk.callees_begin;
+    // rows of a function are the last ones
+    int lines_begin = memory.lines.size;
+    int function_line = source_line(function.token.pos, memory.source_lines);
+
+    while (lines_begin && memory.lines.buf[lines_begin - 1].offset >= base)
+        --lines_begin;
+
+    for (int i = lines_begin; i < memory.lines.size; ++i)
+    {
+        ic_line_row row = memory.lines.buf[i];
+        store.lines.push_back({ row.offset - base, row.line - function_line });
+    }
+    chunk.lines_size = store.lines.size - chunk.lines_begin;
+    function.chunk = store.chunks.size;
+    store.chunks.push_back(chunk);
+    return true;
+}
+
+// callees are resolved to the current functions
+static bool can_reuse_chunk(ic_chunk& chunk, ic_function& function, ic_array<ic_function*>& callees, ic_memory& memory)
+{
+    ic_chunk_store& store = memory.chunks;
+
+    if (chunk.text_hash != function.text_hash)
+        return false;
+    callees.clear();
+
+    for (int i = 0; i < chunk.callees_size; ++i)
+    {
+        ic_chunk_callee& chunk_callee = store.callees.buf[chunk.callees_begin + i];
+        ic_string name;
+
+        // identifiers are kept if the source was not parsed again
+        if (store.generation == memory.generation)
+        {
+            name.data = store.names.buf + chunk_callee.name_begin;
+            name.len = chunk_callee.name_len;
+            name.id = chunk_callee.name_id;
+        }
+        else
+            name = chunk_name(store, chunk_callee.name_begin, chunk_callee.name_len, memory);
+        ic_function* callee = get_function(name, memory);
+
+        if (!callee || callee_signature_hash(*callee) != chunk_callee.signature_hash)
+            return false;
+        callees.push_back(callee);
+    }
+    return true;
+}
+
+// appends the relocated chunk to the bytecode and copies it to memory.next_chunks
+static void link_chunk(ic_chunk& chunk, ic_function& function, ic_array<int>& strings, ic_array<ic_function*>& callees,
+    ic_memory& memory)
+{
+    ic_chunk_store& store = memory.chunks;
+    ic_chunk_store& next_store = memory.next_chunks;
+    int base = memory.bytecode.size;
+    function.instr_idx = base;
+    memory.bytecode.resize(base + chunk.code_size);
+    unsigned char* code = memory.bytecode.buf + base;
+    memcpy(code, store.code.buf + chunk.code_begin, chunk.code_size);
+    bool has_strings = false;
+    int function_line = source_line(function.token.pos, memory.source_lines);
+
+    for (int i = 0; i < chunk.lines_size; ++i)
+    {
+        ic_line_row row = store.lines.buf[chunk.lines_begin + i];
+        memory.lines.push_back({ row.offset + base, row.line + function_line });
+    }
+
+    for (int i = 0; i < chunk.relocs_size; ++i)
+    {
+        ic_reloc reloc = store.relocs.buf[chunk.relocs_begin + i];
+        int operand = 0;
+        memcpy(&operand, code + reloc.offset, sizeof(int));
+
+        switch (reloc.type)
+        {
+        case IC_RELOC_JUMP:
+            operand += base;
+            break;
+        case IC_RELOC_CALL:
+            operand = memory.activate_function(callees.buf[reloc.target]);
+            memory.call_ops.push_back(base + reloc.offset);
+            break;
+        case IC_RELOC_CALL_HOST:
+            operand = memory.activate_function(callees.buf[reloc.target]);
+            break;
+        case IC_RELOC_STRING:
+            if (!has_strings) // most functions have no string literals, don't scan the tokens for them
+            {
+                function_strings(function, memory, strings);
+                has_strings = true;
+            }
+            operand += strings.buf[reloc.target];
+            break;
+        case IC_RELOC_GLOBAL:
+            operand += memory.global_vars.buf[reloc.target].byte_idx;
+            break;
+        }
+        memcpy(code + reloc.offset, &operand, sizeof(int));
+    }
+    ic_chunk next_chunk = chunk;
+    next_chunk.name_begin = next_store.names.size;
+    next_store.names.resize(next_chunk.name_begin + chunk.name_len);
+    memcpy(next_store.names.buf + next_chunk.name_begin, store.names.buf + chunk.name_begin, chunk.name_len);
+    next_chunk.code_begin = next_store.code.size;
+    next_store.code.resize(next_chunk.code_begin + chunk.code_size);
+    memcpy(next_store.code.buf + next_chunk.code_begin, store.code.buf + chunk.code_begin, chunk.code_size);
+    next_chunk.relocs_begin = next_store.relocs.size;
+    next_store.relocs.resize(next_chunk.relocs_begin + chunk.relocs_size);
+    memcpy(next_store.relocs.buf + next_chunk.relocs_begin, store.relocs.buf + chunk.relocs_begin, chunk.relocs_size * sizeof(ic_reloc));
+    next_chunk.callees_begin = next_store.callees.size;
+    next_chunk.lines_begin = next_store.lines.size;
+    next_store.lines.resize(next_chunk.lines_begin + chunk.lines_size);
+    memcpy(next_store.lines.buf + next_chunk.lines_begin, store.lines.buf + chunk.lines_begin, chunk.lines_size * sizeof(ic_line_row));
+
+    for (int i = 0; i < chunk.callees_size; ++i)
+    {
+        ic_chunk_callee callee = store.callees.buf[chunk.callees_begin + i];
+        int name_begin = next_store.names.size;
+        next_store.names.resize(name_begin + callee.name_len);
+        memcpy(next_store.names.buf + name_begin, store.names.buf + callee.name_begin, callee.name_len);
+        callee.name_begin = name_begin;
+        callee.name_id = callees.buf[i]->token.string.id;
+        next_store.callees.push_back(callee);
+    }
+    function.chunk = next_store.chunks.size;
+    next_store.chunks.push_back(next_chunk);
+}
+
+// the previous source is kept, a full parse copies the new one
+static bool parse_source(ic_program& program, const char* source, int flags, ic_memory& memory)
+{
+    memory.reset();
+    memory.flags = flags;
+    memory.own_identifiers = true;
+    int size = strlen(source);
+    memory.source.resize(size + 1);
+    memcpy(memory.source.buf, source, size + 1);
+
+    if (!parse_program(program, memory.source.buf, memory, &memory.source_decls))
+        return false;
+    memory.source_strings.resize(program.strings_byte_size);
+    memcpy(memory.source_strings.buf, memory.bytecode.buf, program.strings_byte_size);
+    memory.source_tokens = memory.token_types.size;
+    hash_functions(memory.functions.buf + memory.persistent_functions, memory.functions.end(), memory.source.buf, memory);
+
+    // chunks are found by name, function records are new
+    if (memory.chunks.layout_hash == memory.layout_hash)
+    {
+        ic_chunk_store& store = memory.chunks;
+
+        for (int i = 0; i < store.chunks.size; ++i)
+        {
+            ic_chunk& chunk = store.chunks.buf[i];
+            ic_function* function = get_function(chunk_name(store, chunk.name_begin, chunk.name_len, memory), memory);
+
+            if (function && function->type == IC_FUN_SOURCE)
+                function->chunk = i;
+        }
+    }
+    return true;
+}
+
+static int common_prefix(const char* lhs, const char* rhs, int size)
+{
+    const int block_size = 4096;
+    int prefix = 0;
+
+    while (size - prefix >= block_size && !memcmp(lhs + prefix, rhs + prefix, block_size))
+        prefix += block_size;
+
+    while (prefix < size && lhs[prefix] == rhs[prefix])
+        ++prefix;
+    return prefix;
+}
+
+// lhs and rhs point past the end of texts
+static int common_suffix(const char* lhs, const char* rhs, int size)
+{
+    const int block_size = 4096;
+    int suffix = 0;
+
+    while (size - suffix >= block_size && !memcmp(lhs - suffix - block_size, rhs - suffix - block_size, block_size))
+        suffix += block_size;
+
+    while (suffix < size && lhs[-suffix - 1] == rhs[-suffix - 1])
+        ++suffix;
+    return suffix;
+}
+
+// the first declaration that ends after a text offset
+static int decl_ending_after(ic_array<ic_source_decl>& decls, int offset)
+{
+    int lo = 0;
+    int hi = decls.size;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (decls.buf[mid].text_end > offset)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// the first declaration that begins at or after a text offset
+static int decl_beginning_at(ic_array<ic_source_decl>& decls, int offset)
+{
+    int lo = 0;
+    int hi = decls.size;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (decls.buf[mid].text_begin >= offset)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// a changed signature may change a type an expression of any function was annotated with
+static bool same_signatures(ic_function* lhs, int lhs_size, ic_function* rhs, int rhs_size)
+{
+    if (lhs_size != rhs_size)
+        return false;
+
+    for (int i = 0; i < lhs_size; ++i)
+    {
+        if (lhs[i].token.string.id != rhs[i].token.string.id || lhs[i].signature_hash != rhs[i].signature_hash)
+            return false;
+    }
+    return true;
+}
+
+// lexes and parses the text between the declarations that precede and follow an edit, tokens and the AST of other
+// declarations are kept; returns false if the whole source must be parsed again (a struct or a global variable was
+// edited, a literal or a comment continues into a kept declaration, there is an error that a full parse reports, or
+// tokens left from edited declarations outnumber the kept ones), memory is then reset
+static bool reparse_edited_functions(ic_program& program, const char* source, int flags, ic_memory& memory, ic_edit& edit)
+{
+    ic_array<ic_source_decl>& decls = memory.source_decls;
+
+    if (!decls.size || flags != memory.flags || !memory.own_identifiers ||
+        memory.token_types.size > 2 * memory.source_tokens + 4096)
+        return false;
+
+    int old_size = memory.source.size - 1;
+    int new_size = strlen(source);
+    int min_size = old_size < new_size ? old_size : new_size;
+    int prefix = common_prefix(memory.source.buf, source, min_size);
+    int suffix = common_suffix(memory.source.buf + old_size, source + new_size, min_size - prefix);
+    int delta = new_size - old_size;
+    // a declaration that ends right before an edit is kept, it ends with a single character token
+    int first = decl_ending_after(decls, prefix);
+    int last = decl_beginning_at(decls, old_size - suffix);
+
+    if (last < first)
+        last = first;
+
+    for (int i = first; i < last; ++i)
+    {
+        if (decls.buf[i].function == -1)
+            return false;
+    }
+    int lex_begin = first ? decls.buf[first - 1].text_end : 0;
+    int lex_end = last < decls.size ? decls.buf[last].text_begin + delta : new_size;
+
+    // an identifier or a number would continue in the first token of a kept declaration
+    if (lex_end && last < decls.size && is_identifier_char(source[lex_end - 1]))
+        return false;
+
+    memory.reset_compilation();
+    int source_capacity = memory.source.capacity;
+    memory.source.resize(new_size + 1);
+
+    // lines point into the source
+    if (new_size + 1 <= source_capacity)
+    {
+        memcpy(memory.source.buf + prefix, source + prefix, new_size + 1 - prefix);
+        update_source_lines(memory.source.buf, new_size, prefix, old_size - suffix, new_size - suffix, memory.source_lines);
+    }
+    else
+    {
+        memcpy(memory.source.buf, source, new_size + 1);
+        index_source_lines(memory.source.buf, new_size, memory.source_lines);
+    }
+    memory.bytecode.resize(memory.source_strings.size);
+    memcpy(memory.bytecode.buf, memory.source_strings.buf, memory.source_strings.size);
+    int tokens_begin = memory.token_types.size;
+
+    if (!lex_range(memory.source.buf, lex_begin, lex_end, memory))
+        return false;
+
+    // names of edited functions can be taken by new ones
+    int functions_begin = memory.functions.size;
+
+    for (int i = first; i < decls.size; ++i)
+    {
+        if (decls.buf[i].function != -1)
+        {
+            functions_begin = decls.buf[i].function;
+            break;
+        }
+    }
+    int functions_end = functions_begin + (last - first);
+
+    for (int i = functions_begin; i < functions_end; ++i)
+        memory.symbol(memory.functions.buf[i].token.string).function = -1;
+
+    ic_array<ic_function> functions;
+    ic_array<ic_source_decl> new_decls;
+    functions.init();
+    new_decls.init();
+    bool success = parse_function_definitions(tokens_begin, memory, functions, new_decls);
+
+    for (int i = 0; success && i < functions.size; ++i)
+    {
+        ic_string name = functions.buf[i].token.string;
+        success = !get_function(name, memory);
+        memory.symbol(name).function = functions_begin + i;
+    }
+
+    if (!success)
+    {
+        functions.free();
+        new_decls.free();
+        return false;
+    }
+    hash_functions(functions.begin(), functions.end(), memory.source.buf, memory);
+    edit.functions_begin = functions_begin;
+    edit.same_signatures = same_signatures(memory.functions.buf + functions_begin, functions_end - functions_begin,
+        functions.buf, functions.size);
+    edit.new_strings = memory.bytecode.size != memory.source_strings.size;
+
+    if (edit.same_signatures)
+    {
+        edit.replaced.resize(functions.size);
+        memcpy(edit.replaced.buf, memory.functions.buf + functions_begin, functions.size * sizeof(ic_function));
+    }
+    else
+    {
+        // functions move, active functions point to them
+        memory.deactivate_functions();
+
+        for (ic_expr& expr : memory.exprs)
+            expr.annotated = false;
+    }
+
+    // kept declarations that follow the edit move by delta bytes, their functions by shift indices
+    int shift = functions.size - (functions_end - functions_begin);
+    int old_functions_size = memory.functions.size;
+
+    if (shift > 0)
+        memory.functions.resize(old_functions_size + shift);
+    memmove(memory.functions.buf + functions_end + shift, memory.functions.buf + functions_end,
+        (old_functions_size - functions_end) * sizeof(ic_function));
+    memory.functions.resize(old_functions_size + shift);
+    memcpy(memory.functions.buf + functions_begin, functions.buf, functions.size * sizeof(ic_function));
+
+    if (shift || delta)
+    {
+        for (int i = functions_begin + functions.size; i < memory.functions.size; ++i)
+        {
+            ic_function& function = memory.functions.buf[i];
+            memory.symbol(function.token.string).function = i;
+            function.token.pos += delta;
+        }
+    }
+    int decls_shift = new_decls.size - (last - first);
+    int old_decls_size = decls.size;
+
+    for (int i = first; i < last; ++i)
+        memory.source_tokens -= decls.buf[i].tokens_end - decls.buf[i].tokens_begin;
+
+    if (decls_shift > 0)
+        decls.resize(old_decls_size + decls_shift);
+    memmove(decls.buf + last + decls_shift, decls.buf + last, (old_decls_size - last) * sizeof(ic_source_decl));
+    decls.resize(old_decls_size + decls_shift);
+
+    for (int i = 0; i < new_decls.size; ++i)
+    {
+        ic_source_decl& decl = new_decls.buf[i];
+        decl.function += functions_begin;
+        memory.source_tokens += decl.tokens_end - decl.tokens_begin;
+        decls.buf[first + i] = decl;
+    }
+
+    for (int i = first + new_decls.size; i < decls.size && (shift || delta); ++i)
+    {
+        ic_source_decl& decl = decls.buf[i];
+        decl.text_begin += delta;
+        decl.text_end += delta;
+
+        if (decl.function != -1)
+            decl.function += shift;
+
+        for (int t = decl.tokens_begin; t < decl.tokens_end; ++t)
+            memory.token_positions.buf[t] += delta;
+    }
+    functions.free();
+    new_decls.free();
+    int strings_size = memory.source_strings.size;
+    memory.source_strings.resize(memory.bytecode.size);
+    memcpy(memory.source_strings.buf + strings_size, memory.bytecode.buf + strings_size, memory.bytecode.size - strings_size);
+    program.strings_byte_size = memory.bytecode.size;
+    program.global_data_byte_size = 0;
+
+    for (ic_var& var : memory.global_vars)
+        place_global_var(program, var);
+    return true;
+}
+
+// rows of a line table that a patched program keeps would have lines of the previous source, all functions are linked then
+static bool can_patch_program(ic_edit& edit, ic_memory& memory)
+{
+    if (!memory.linked || (memory.flags & IC_COMPILE_LINE_TABLE) || !edit.same_signatures || edit.new_strings || edit.replaced.size > IC_MAX_PATCHED_FUNCTIONS ||
+        memory.linked_garbage > memory.linked_bytecode.size / 2)
+        return false;
+
+    for (int i = 0; i < edit.replaced.size; ++i)
+    {
+        // an edited function must have been called, main must stay at the beginning of the bytecode
+        if (edit.replaced.buf[i].chunk == -1 ||
+            memory.active_source_functions.buf[0] == memory.functions.buf + edit.functions_begin + i)
+            return false;
+    }
+    return true;
+}
+
+// a function that is not called by an edited function any more may not be called at all, it must not be in a program
+static bool calls_previous_callees(ic_chunk_store& store, ic_chunk prev_chunk, ic_chunk chunk)
+{
+    for (int i = 0; i < prev_chunk.callees_size; ++i)
+    {
+        int name_id = store.callees.buf[prev_chunk.callees_begin + i].name_id;
+        bool found = false;
+
+        for (int j = 0; !found && j < chunk.callees_size; ++j)
+            found = store.callees.buf[chunk.callees_begin + j].name_id == name_id;
+
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+// appends the edited functions and functions they call for the first time to the previous program and redirects calls
+// of the replaced functions; chunks are saved to memory.chunks, the replaced code and chunks are garbage until all
+// functions are linked again; returns false if all functions must be linked, success is false on an error
+static bool patch_program(ic_program& program, ic_edit& edit, ic_memory& memory, bool& success)
+{
+    ic_chunk_store& store = memory.chunks;
+    memory.bytecode.free();
+    memory.bytecode = memory.linked_bytecode;
+    memory.linked_bytecode.init();
+    memory.linked = false;
+    int active_size = memory.active_source_functions.size;
+    ic_array<int> strings;
+    strings.init();
+    bool patched = true;
+    success = true;
+
+    for (int i = 0; success && patched && i < edit.replaced.size; ++i)
+    {
+        ic_function& function = memory.functions.buf[edit.functions_begin + i];
+        success = compile_function(function, memory, true);
+        patched = !success || (save_chunk(function, store, strings, memory) &&
+            calls_previous_callees(store, store.chunks.buf[edit.replaced.buf[i].chunk], store.chunks.back()));
+    }
+
+    // important, size changes inside a loop
+    for (int i = active_size; success && patched && i < memory.active_source_functions.size; ++i)
+    {
+        ic_function& function = *memory.active_source_functions.buf[i];
+        success = compile_function(function, memory, true);
+
+        if (success)
+            save_chunk(function, store, strings, memory);
+    }
+    strings.free();
+
+    if (!patched)
+        return false;
+
+    if (!success)
+        return true;
+
+    for (int op_idx : memory.linked_call_ops)
+    {
+        int instr_idx;
+        memcpy(&instr_idx, memory.bytecode.buf + op_idx, sizeof(int));
+
+        for (int i = 0; i < edit.replaced.size; ++i)
+        {
+            if (instr_idx == edit.replaced.buf[i].instr_idx)
+            {
+                memcpy(memory.bytecode.buf + op_idx, &memory.functions.buf[edit.functions_begin + i].instr_idx, sizeof(int));
+                break;
+            }
+        }
+    }
+
+    for (ic_function& function : edit.replaced)
+        memory.linked_garbage += store.chunks.buf[function.chunk].code_size;
+    // new call operands are resolved by link_program()
+    int call_ops_size = memory.linked_call_ops.size;
+    memory.linked_call_ops.resize(call_ops_size + memory.call_ops.size);
+    memcpy(memory.linked_call_ops.buf + call_ops_size, memory.call_ops.buf, memory.call_ops.size * sizeof(int));
+    success = compile_unused_functions(memory) && link_program(program, memory);
+    return true;
+}
+
+// compiles or links every active function
+static bool link_functions(ic_program& program, ic_memory& memory)
+{
+    ic_chunk_store& store = memory.chunks;
+    memory.next_chunks.clear();
+    memory.next_chunks.layout_hash = memory.layout_hash;
+    memory.next_chunks.generation = memory.generation;
+    ic_array<int> function_chunks; // chunk index of each function of memory.functions, -1 if there is none
+    ic_array<int> strings;
+    ic_array<ic_function*> callees;
+    function_chunks.init();
+    strings.init();
+    callees.init();
+    function_chunks.resize(memory.functions.size);
+
+    // chunk indices are set again for functions that are compiled or linked
+    for (int i = 0; i < memory.functions.size; ++i)
+    {
+        ic_function& function = memory.functions.buf[i];
+        function_chunks.buf[i] = function.type == IC_FUN_SOURCE ? function.chunk : -1;
+        function.chunk = -1;
+    }
+    bool success = true;
+
+    // important, size changes inside a loop
+    for (int i = 0; i < memory.active_source_functions.size; ++i)
+    {
+        ic_function& function = *memory.active_source_functions.buf[i];
+        int chunk_idx = function_chunks.buf[&function - memory.functions.buf];
+
+        if (chunk_idx != -1 && can_reuse_chunk(store.chunks.buf[chunk_idx], function, callees, memory))
+        {
+            link_chunk(store.chunks.buf[chunk_idx], function, strings, callees, memory);
+            continue;
+        }
+
+        if (!compile_function(function, memory, true))
+        {
+            success = false;
+            break;
+        }
+        save_chunk(function, memory.next_chunks, strings, memory);
+    }
+    function_chunks.free();
+    strings.free();
+    callees.free();
+
+    if (!success)
+        return false;
+    // link_program() consumes call_ops
+    memory.linked_call_ops.resize(memory.call_ops.size);
+    memcpy(memory.linked_call_ops.buf, memory.call_ops.buf, memory.call_ops.size * sizeof(int));
+
+    if (!compile_unused_functions(memory) || !link_program(program, memory))
+        return false;
+
+    // chunks of functions that were not called are dropped
+    ic_chunk_store temp = memory.chunks;
+    memory.chunks = memory.next_chunks;
+    memory.next_chunks = temp;
+    memory.linked_garbage = 0;
+    return true;
+}
+
+bool program_init_compile_incremental_impl(ic_program& program, const char* source, int flags, ic_memory& memory)
+{
+    ic_edit edit;
+    edit.replaced.init();
+    bool success = true;
+
+    if (reparse_edited_functions(program, source, flags, memory, edit))
+    {
+        if (!can_patch_program(edit, memory) || !patch_program(program, edit, memory, success))
+        {
+            // functions that patch_program() has compiled are linked from their chunks
+            memory.deactivate_functions();
+            memory.call_ops.clear();
+            memory.bytecode.resize(program.strings_byte_size);
+            success = activate_main(memory) && link_functions(program, memory);
+        }
+    }
+    else
+        success = parse_source(program, source, flags, memory) && link_functions(program, memory);
+    edit.replaced.free();
+
+    if (!success)
+    {
+        memory.source_decls.clear();
+        memory.linked = false;
+        return false;
+    }
+    memory.linked_bytecode.resize(program.bytecode_size);
+    memcpy(memory.linked_bytecode.buf, program.bytecode, program.bytecode_size);
+    memory.linked = true;
+
+    // an identifier could not be kept
+    if (!memory.own_identifiers)
+        memory.source_decls.clear();
+    return true;
+}
@@ -0,0 +1,1276 @@
+#include <stdio.h>
+#include <limits.h>
+#include "ic_impl.h"
+
+static const ic_opcode_info _opcode_infos[] =
+{
+    {"push_s8", IC_OPERAND_S8, 0, 1, IC_IR_S8, true},
+    {"push_s32", IC_OPERAND_S32, 0, 1, IC_IR_S32, true},
+    {"push_f32", IC_OPERAND_F32, 0, 1, IC_IR_F32, true},
+    {"push_f64", IC_OPERAND_F64, 0, 1, IC_IR_F64, true},
+    {"push_nullptr", IC_OPERAND_NONE, 0, 1, IC_IR_PTR, true},
+    {"push", IC_OPERAND_NONE, 0, 1, IC_IR_SLOT, true},
+    {"push_many", IC_OPERAND_S32, 0, IC_VARIABLE, IC_IR_SLOT, true},
+    {"pop", IC_OPERAND_NONE, 1, 0, IC_IR_SLOT, true},
+    {"pop_many", IC_OPERAND_S32, IC_VARIABLE, 0, IC_IR_SLOT, true},
+    {"swap", IC_OPERAND_NONE, 2, 2, IC_IR_SLOT, true},
+    {"memmove", IC_OPERAND_S32X3, IC_VARIABLE, IC_VARIABLE, IC_IR_SLOT, true},
+    {"clone", IC_OPERAND_NONE, 1, 2, IC_IR_SLOT, true},
+    {"call", IC_OPERAND_S32, IC_VARIABLE, IC_VARIABLE, IC_IR_SLOT, false},
+    {"call_host", IC_OPERAND_S32, IC_VARIABLE, IC_VARIABLE, IC_IR_SLOT, false},
+    {"call_lazy", IC_OPERAND_S32, IC_VARIABLE, IC_VARIABLE, IC_IR_SLOT, false},
+    {"return", IC_OPERAND_NONE, 0, 0, IC_IR_SLOT, false},
+    {"jump_true", IC_OPERAND_S32, 1, 0, IC_IR_SLOT, false},
+    {"jump_false", IC_OPERAND_S32, 1, 0, IC_IR_SLOT, false},
+    {"logical_not", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"jump", IC_OPERAND_S32, 0, 0, IC_IR_SLOT, false},
+    {"address", IC_OPERAND_S32, 0, 1, IC_IR_PTR, true},
+    {"address_global", IC_OPERAND_S32, 0, 1, IC_IR_PTR, true},
+    {"address_string", IC_OPERAND_S32, 0, 1, IC_IR_PTR, true},
+    {"store_1", IC_OPERAND_NONE, 2, 1, IC_IR_SLOT, false},
+    {"store_4", IC_OPERAND_NONE, 2, 1, IC_IR_SLOT, false},
+    {"store_8", IC_OPERAND_NONE, 2, 1, IC_IR_SLOT, false},
+    {"store_struct", IC_OPERAND_S32, IC_VARIABLE, IC_VARIABLE, IC_IR_SLOT, false},
+    {"load_1", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"load_4", IC_OPERAND_NONE, 1, 1, IC_IR_W32, true},
+    {"load_8", IC_OPERAND_NONE, 1, 1, IC_IR_W64, true},
+    {"load_struct", IC_OPERAND_S32, 1, IC_VARIABLE, IC_IR_SLOT, true},
+    {"compare_e_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ne_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_g_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ge_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_l_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_le_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"negate_s32", IC_OPERAND_NONE, 1, 1, IC_IR_S32, true},
+    {"add_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S32, true},
+    {"sub_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S32, true},
+    {"mul_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S32, true},
+    {"div_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S32, true},
+    {"modulo_s32", IC_OPERAND_NONE, 2, 1, IC_IR_S32, true},
+    {"shl_s32", IC_OPERAND_S32, 1, 1, IC_IR_S32, true},
+    {"shr_s32", IC_OPERAND_S32, 1, 1, IC_IR_S32, true},
+    {"compare_e_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ne_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_g_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ge_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_l_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_le_f32", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"negate_f32", IC_OPERAND_NONE, 1, 1, IC_IR_F32, true},
+    {"add_f32", IC_OPERAND_NONE, 2, 1, IC_IR_F32, true},
+    {"sub_f32", IC_OPERAND_NONE, 2, 1, IC_IR_F32, true},
+    {"mul_f32", IC_OPERAND_NONE, 2, 1, IC_IR_F32, true},
+    {"div_f32", IC_OPERAND_NONE, 2, 1, IC_IR_F32, true},
+    {"compare_e_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ne_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_g_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ge_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_l_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_le_f64", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"negate_f64", IC_OPERAND_NONE, 1, 1, IC_IR_F64, true},
+    {"add_f64", IC_OPERAND_NONE, 2, 1, IC_IR_F64, true},
+    {"sub_f64", IC_OPERAND_NONE, 2, 1, IC_IR_F64, true},
+    {"mul_f64", IC_OPERAND_NONE, 2, 1, IC_IR_F64, true},
+    {"div_f64", IC_OPERAND_NONE, 2, 1, IC_IR_F64, true},
+    {"compare_e_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ne_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_g_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_ge_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_l_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"compare_le_ptr", IC_OPERAND_NONE, 2, 1, IC_IR_S8, true},
+    {"sub_ptr_ptr", IC_OPERAND_S32, 2, 1, IC_IR_S32, true},
+    {"add_ptr_s32", IC_OPERAND_S32, 2, 1, IC_IR_PTR, true},
+    {"sub_ptr_s32", IC_OPERAND_S32, 2, 1, IC_IR_PTR, true},
+    {"b_s8", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"b_u8", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"b_s32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"b_f32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"b_f64", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"b_ptr", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"s8_u8", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"s8_s32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"s8_f32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"s8_f64", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"u8_s8", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"u8_s32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"u8_f32", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"u8_f64", IC_OPERAND_NONE, 1, 1, IC_IR_S8, true},
+    {"s32_s8", IC_OPERAND_NONE, 1, 1, IC_IR_S32, true},
+    {"s32_u8", IC_OPERAND_NONE, 1, 1, IC_IR_S32, true},
+    {"s32_f32", IC_OPERAND_NONE, 1, 1, IC_IR_S32, true},
+    {"s32_f64", IC_OPERAND_NONE, 1, 1, IC_IR_S32, true},
+    {"f32_s8", IC_OPERAND_NONE, 1, 1, IC_IR_F32, true},
+    {"f32_u8", IC_OPERAND_NONE, 1, 1, IC_IR_F32, true},
+    {"f32_s32", IC_OPERAND_NONE, 1, 1, IC_IR_F32, true},
+    {"f32_f64", IC_OPERAND_NONE, 1, 1, IC_IR_F32, true},
+    {"f64_s8", IC_OPERAND_NONE, 1, 1, IC_IR_F64, true},
+    {"f64_u8", IC_OPERAND_NONE, 1, 1, IC_IR_F64, true},
+    {"f64_s32", IC_OPERAND_NONE, 1, 1, IC_IR_F64, true},
+    {"f64_f32", IC_OPERAND_NONE, 1, 1, IC_IR_F64, true},
+};
+
+static_assert(sizeof(_opcode_infos) / sizeof(ic_opcode_info) == IC_OPC_COUNT, "_opcode_infos must match ic_opcode");
+
+static const char* _ir_type_names[] = {"s8", "s32", "f32", "f64", "ptr", "w32", "w64", "slot"};
+
+// the order of passes matters, dce should be the last one to clean up after the others
+static ic_ir_pass _passes[] =
+{
+    {"licm", ir_pass_licm},
+    {"ivsr", ir_pass_ivsr},
+    {"cse", ir_pass_cse},
+    {"peephole", ir_pass_peephole},
+    {"dce", ir_pass_dce},
+};
+
+const ic_opcode_info& opcode_info(ic_opcode opcode)
+{
+    assert(opcode >= 0 && opcode < IC_OPC_COUNT);
+    return _opcode_infos[opcode];
+}
+
+int operand_byte_size(ic_operand_kind kind)
+{
+    switch (kind)
+    {
+    case IC_OPERAND_NONE:
+        return 0;
+    case IC_OPERAND_S8:
+        return sizeof(char);
+    case IC_OPERAND_S32:
+        return sizeof(int);
+    case IC_OPERAND_F32:
+        return sizeof(float);
+    case IC_OPERAND_F64:
+        return sizeof(double);
+    case IC_OPERAND_S32X3:
+        return 3 * sizeof(int);
+    }
+    assert(false);
+    return {};
+}
+
+int function_param_size(ic_function& function)
+{
+    int size = 0;
+
+    for (int i = 0; i < function.param_count; ++i)
+        size += type_data_size(function.params[i].type);
+    return size;
+}
+
+bool is_jump(ic_opcode opcode)
+{
+    return opcode == IC_OPC_JUMP || opcode == IC_OPC_JUMP_TRUE || opcode == IC_OPC_JUMP_FALSE;
+}
+
+// the number of operand stack slots an instruction pops and pushes
+void stack_effect(ic_ir_function& fn, ic_ir_instr& instr, int* pops, int* pushes)
+{
+    const ic_opcode_info& info = opcode_info(instr.opcode);
+    *pops = info.pops;
+    *pushes = info.pushes;
+
+    switch (instr.opcode)
+    {
+    case IC_OPC_PUSH_MANY:
+        *pushes = instr.operand.s32;
+        break;
+    case IC_OPC_POP_MANY:
+        *pops = instr.operand.s32;
+        break;
+    case IC_OPC_MEMMOVE:
+    {
+        int byte_size = instr.operand.s32x3[0] > instr.operand.s32x3[1] ? instr.operand.s32x3[0] : instr.operand.s32x3[1];
+        *pops = bytes_to_data_size(byte_size);
+        *pushes = *pops;
+        break;
+    }
+    case IC_OPC_CALL:
+    case IC_OPC_CALL_HOST:
+    {
+        // return value and arguments; callee writes a return value and may modify its parameters
+        ic_array<ic_function*>& functions = instr.opcode == IC_OPC_CALL ? fn.memory->active_source_functions : fn.memory->active_host_functions;
+        ic_function& function = *functions.buf[instr.operand.s32];
+        *pops = type_data_size(function.return_type) + function_param_size(function);
+        *pushes = *pops;
+        break;
+    }
+    case IC_OPC_STORE_STRUCT:
+        *pushes = bytes_to_data_size(instr.operand.s32);
+        *pops = *pushes + 1;
+        break;
+    case IC_OPC_LOAD_STRUCT:
+        *pushes = bytes_to_data_size(instr.operand.s32);
+        break;
+    }
+}
+
+ic_ir_instr make_instr(ic_opcode opcode)
+{
+    ic_ir_instr instr;
+    memset(&instr, 0, sizeof(instr));
+    instr.opcode = opcode;
+    return instr;
+}
+
+bool decode_function(ic_ir_function& fn, unsigned char* begin, unsigned char* end, int base)
+{
+    assert(*begin == IC_OPC_PUSH_MANY);
+    unsigned char* it = begin + 1;
+    fn.frame_size = read_int(&it);
+    int byte_size = end - begin;
+    // index of a block that starts at a given offset, the extra one is for jumps to the end of a function
+    ic_array<int> block_at;
+    block_at.init();
+    block_at.resize(byte_size + 1);
+
+    for (int& idx : block_at)
+        idx = -1;
+
+    ic_array<ic_ir_instr> instrs;
+    ic_array<int> offsets;
+    instrs.init();
+    offsets.init();
+    // rows of a function are the last ones, lower_function() replaces all but the first one
+    ic_array<ic_line_row>& lines = fn.memory->lines;
+    int lines_begin = lines.size;
+
+    while (lines_begin && lines.buf[lines_begin - 1].offset > base)
+        --lines_begin;
+    int row = lines_begin;
+    int line = row ? lines.buf[row - 1].line : 0;
+
+    while (it < end)
+    {
+        offsets.push_back(it - begin);
+        ic_ir_instr instr = make_instr((ic_opcode)*it);
+
+        for (; row < lines.size && lines.buf[row].offset <= base + (it - begin); ++row)
+            line = lines.buf[row].line;
+        instr.line = line;
+        ++it;
+        int size = operand_byte_size(opcode_info(instr.opcode).operand);
+        memcpy(&instr.operand, it, size);
+        it += size;
+
+        if (is_jump(instr.opcode))
+        {
+            instr.target = instr.operand.s32 - base;
+            assert(instr.target > 0 && instr.target <= byte_size);
+            block_at.buf[instr.target] = 0;
+        }
+
+        if ((is_jump(instr.opcode) || instr.opcode == IC_OPC_RETURN) && it < end)
+            block_at.buf[it - begin] = 0;
+
+        instrs.push_back(instr);
+    }
+    assert(it == end);
+    lines.resize(lines_begin);
+    offsets.push_back(byte_size);
+    fn.initial_instr_count = instrs.size;
+
+    for (int i = 0; i < instrs.size; ++i)
+    {
+        if (!fn.blocks.size || block_at.buf[offsets.buf[i]] != -1)
+        {
+            block_at.buf[offsets.buf[i]] = fn.blocks.size;
+            fn.blocks.push_back();
+            fn.blocks.back().instrs.init();
+        }
+        fn.blocks.back().instrs.push_back(instrs.buf[i]);
+    }
+
+    if (!fn.blocks.size || block_at.buf[byte_size] != -1)
+    {
+        block_at.buf[byte_size] = fn.blocks.size;
+        fn.blocks.push_back();
+        fn.blocks.back().instrs.init();
+    }
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        for (ic_ir_instr& instr : block.instrs)
+        {
+            if (is_jump(instr.opcode))
+                instr.target = block_at.buf[instr.target];
+        }
+    }
+    block_at.free();
+    instrs.free();
+    offsets.free();
+    return true;
+}
+
+void lower_function(ic_ir_function& fn)
+{
+    ic_memory& memory = *fn.memory;
+    int base = fn.function->instr_idx;
+    ic_array<int> block_offsets;
+    block_offsets.init();
+    int offset = 1 + sizeof(int); // push_many
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        block_offsets.push_back(offset);
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+
+            if (instr.opcode == IC_OPC_JUMP && instr.target == b + 1 && i == block.instrs.size - 1)
+                continue;
+            offset += 1 + operand_byte_size(opcode_info(instr.opcode).operand);
+        }
+    }
+    block_offsets.push_back(offset);
+
+    while (memory.call_ops.size && memory.call_ops.back() >= base)
+        memory.call_ops.pop_back();
+
+    memory.bytecode.resize(base + offset);
+    unsigned char* it = memory.bytecode.buf + base;
+    *it = IC_OPC_PUSH_MANY;
+    memcpy(it + 1, &fn.frame_size, sizeof(int));
+    it += 1 + sizeof(int);
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr instr = block.instrs.buf[i];
+
+            if (instr.opcode == IC_OPC_JUMP && instr.target == b + 1 && i == block.instrs.size - 1)
+                continue;
+            if (is_jump(instr.opcode))
+                instr.operand.s32 = base + block_offsets.buf[instr.target];
+            if (instr.opcode == IC_OPC_CALL)
+                memory.call_ops.push_back(it + 1 - memory.bytecode.buf);
+
+            if (instr.line && instr.line != memory.lines.back().line)
+                memory.lines.push_back({ (int)(it - memory.bytecode.buf), instr.line });
+
+            *it = instr.opcode;
+            ++it;
+            int size = operand_byte_size(opcode_info(instr.opcode).operand);
+            memcpy(it, &instr.operand, size);
+            it += size;
+        }
+    }
+    assert(it == memory.bytecode.end());
+    block_offsets.free();
+}
+
+int new_value(ic_ir_function& fn, ic_ir_type type, int block, int instr)
+{
+    ic_ir_value value;
+    value.type = type;
+    value.block = block;
+    value.instr = instr;
+    value.use_count = 0;
+    fn.values.push_back(value);
+    return fn.values.size - 1;
+}
+
+bool ir_build_ssa(ic_ir_function& fn)
+{
+    fn.values.clear();
+    fn.phis.clear();
+    fn.refs.clear();
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+        block.reachable = false;
+        block.succs_size = 0;
+        block.preds_size = 0;
+        block.entry_size = IC_VARIABLE;
+        block.phis_size = 0;
+        ic_opcode last = block.instrs.size ? block.instrs.back().opcode : IC_OPC_POP;
+
+        if (is_jump(last))
+            block.succs[block.succs_size++] = block.instrs.back().target;
+
+        if (last != IC_OPC_JUMP && last != IC_OPC_RETURN && b + 1 < fn.blocks.size)
+            block.succs[block.succs_size++] = b + 1;
+    }
+    // reachability
+    ic_array<int> work;
+    work.init();
+    work.push_back(0);
+    fn.blocks.buf[0].reachable = true;
+
+    while (work.size)
+    {
+        ic_ir_block& block = fn.blocks.buf[work.back()];
+        work.pop_back();
+
+        for (int i = 0; i < block.succs_size; ++i)
+        {
+            ic_ir_block& succ = fn.blocks.buf[block.succs[i]];
+
+            if (!succ.reachable)
+            {
+                succ.reachable = true;
+                work.push_back(block.succs[i]);
+            }
+        }
+    }
+    // predecessors, only reachable blocks are taken into account
+    for (ic_ir_block& block : fn.blocks)
+    {
+        if (!block.reachable)
+            continue;
+        for (int i = 0; i < block.succs_size; ++i)
+            fn.blocks.buf[block.succs[i]].preds_size += 1;
+    }
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        block.preds_begin = fn.refs.size;
+        fn.refs.resize(fn.refs.size + block.preds_size);
+        block.preds_size = 0;
+    }
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (!block.reachable)
+            continue;
+        for (int i = 0; i < block.succs_size; ++i)
+        {
+            ic_ir_block& succ = fn.blocks.buf[block.succs[i]];
+            *fn.ref(succ.preds_begin + succ.preds_size) = b;
+            succ.preds_size += 1;
+        }
+    }
+    // values; operand stack is simulated from the entry block, each block is processed once
+    ic_array<int> stack;
+    stack.init();
+    bool success = true;
+    fn.blocks.buf[0].entry_begin = fn.refs.size;
+    fn.blocks.buf[0].entry_size = 0;
+    work.push_back(0);
+
+    while (work.size && success)
+    {
+        int b = work.back();
+        work.pop_back();
+        ic_ir_block& block = fn.blocks.buf[b];
+        stack.resize(block.entry_size);
+
+        if(block.entry_size)
+            memcpy(stack.buf, fn.ref(block.entry_begin), block.entry_size * sizeof(int));
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+            int pops, pushes;
+            stack_effect(fn, instr, &pops, &pushes);
+
+            if (pops > stack.size)
+            {
+                success = false;
+                break;
+            }
+            instr.args_begin = fn.refs.size;
+            instr.args_size = pops;
+            fn.refs.resize(fn.refs.size + pops);
+
+            if (pops)
+                memcpy(fn.ref(instr.args_begin), stack.end() - pops, pops * sizeof(int));
+            stack.resize(stack.size - pops);
+            int* args = fn.ref(instr.args_begin);
+
+            for (int a = 0; a < pops; ++a)
+                fn.values.buf[args[a]].use_count += 1;
+
+            instr.results_begin = fn.refs.size;
+            instr.results_size = pushes;
+            fn.refs.resize(fn.refs.size + pushes);
+            args = fn.ref(instr.args_begin);
+            int* results = fn.ref(instr.results_begin);
+
+            switch (instr.opcode)
+            {
+            case IC_OPC_SWAP:
+                results[0] = args[1];
+                results[1] = args[0];
+                break;
+            case IC_OPC_CLONE:
+                results[0] = args[0];
+                results[1] = args[0];
+                break;
+            case IC_OPC_STORE_1:
+            case IC_OPC_STORE_4:
+            case IC_OPC_STORE_8:
+            case IC_OPC_STORE_STRUCT:
+                for (int r = 0; r < pushes; ++r)
+                    results[r] = args[r];
+                break;
+            default:
+                for (int r = 0; r < pushes; ++r)
+                {
+                    int value = new_value(fn, opcode_info(instr.opcode).type, b, i);
+                    *fn.ref(instr.results_begin + r) = value;
+                }
+            }
+
+            for (int r = 0; r < pushes; ++r)
+                stack.push_back(*fn.ref(instr.results_begin + r));
+        }
+
+        for (int s = 0; success && s < block.succs_size; ++s)
+        {
+            ic_ir_block& succ = fn.blocks.buf[block.succs[s]];
+
+            if (succ.entry_size == IC_VARIABLE)
+            {
+                succ.entry_begin = fn.refs.size;
+                succ.entry_size = stack.size;
+                fn.refs.resize(fn.refs.size + stack.size);
+
+                if (succ.preds_size > 1 && stack.size)
+                {
+                    succ.phis_begin = fn.phis.size;
+                    succ.phis_size = stack.size;
+
+                    for (int slot = 0; slot < stack.size; ++slot)
+                    {
+                        ic_ir_phi phi;
+                        phi.value = new_value(fn, fn.values.buf[stack.buf[slot]].type, block.succs[s], IC_VARIABLE);
+                        phi.args_begin = fn.refs.size;
+                        fn.refs.resize(fn.refs.size + succ.preds_size);
+                        *fn.ref(succ.entry_begin + slot) = phi.value;
+                        fn.phis.push_back(phi);
+                    }
+                }
+                else if (stack.size)
+                    memcpy(fn.ref(succ.entry_begin), stack.buf, stack.size * sizeof(int));
+
+                work.push_back(block.succs[s]);
+            }
+            else if (succ.entry_size != stack.size)
+            {
+                success = false;
+                break;
+            }
+
+            for (int p = 0; p < succ.preds_size; ++p)
+            {
+                if (*fn.ref(succ.preds_begin + p) != b)
+                    continue;
+
+                for (int slot = 0; slot < succ.phis_size; ++slot)
+                {
+                    ic_ir_phi& phi = fn.phis.buf[succ.phis_begin + slot];
+                    *fn.ref(phi.args_begin + p) = stack.buf[slot];
+                    fn.values.buf[stack.buf[slot]].use_count += 1;
+                }
+            }
+        }
+    }
+    stack.free();
+    work.free();
+    return success;
+}
+
+ic_ir_block& ir_insert_block(ic_ir_function& fn, int idx)
+{
+    assert(idx >= 0 && idx <= fn.blocks.size);
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        for (ic_ir_instr& instr : block.instrs)
+        {
+            if (is_jump(instr.opcode) && instr.target >= idx)
+                instr.target += 1;
+        }
+    }
+    fn.blocks.push_back();
+    memmove(fn.blocks.buf + idx + 1, fn.blocks.buf + idx, (fn.blocks.size - idx - 1) * sizeof(ic_ir_block));
+    ic_ir_block& block = fn.blocks.buf[idx];
+    memset(&block, 0, sizeof(block));
+    block.instrs.init();
+    return block;
+}
+
+void ir_remove_block(ic_ir_function& fn, int idx)
+{
+    fn.blocks.buf[idx].instrs.free();
+    memmove(fn.blocks.buf + idx, fn.blocks.buf + idx + 1, (fn.blocks.size - idx - 1) * sizeof(ic_ir_block));
+    fn.blocks.pop_back();
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        for (ic_ir_instr& instr : block.instrs)
+        {
+            if (is_jump(instr.opcode) && instr.target > idx)
+                instr.target -= 1;
+        }
+    }
+}
+
+int ir_instr_count(ic_ir_function& fn)
+{
+    int count = 0;
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+        count += block.instrs.size;
+
+        // not emitted by lower_function()
+        if (block.instrs.size && block.instrs.back().opcode == IC_OPC_JUMP && block.instrs.back().target == b + 1)
+            count -= 1;
+    }
+    return count;
+}
+
+void ir_insert_instr(ic_ir_block& block, int idx, ic_ir_instr instr)
+{
+    assert(idx >= 0 && idx <= block.instrs.size);
+    block.instrs.push_back();
+    memmove(block.instrs.buf + idx + 1, block.instrs.buf + idx, (block.instrs.size - idx - 1) * sizeof(ic_ir_instr));
+    block.instrs.buf[idx] = instr;
+}
+
+void ir_remove_instrs(ic_ir_block& block, int idx, int count)
+{
+    assert(idx >= 0 && idx + count <= block.instrs.size);
+    memmove(block.instrs.buf + idx, block.instrs.buf + idx + count, (block.instrs.size - idx - count) * sizeof(ic_ir_instr));
+    block.instrs.resize(block.instrs.size - count);
+}
+
+// a new 8 byte local variable for values computed by passes, returns its byte offset
+int ir_allocate_slot(ic_ir_function& fn)
+{
+    ic_ir_range range;
+    range.begin = fn.frame_size * sizeof(ic_data);
+
+    for (ic_ir_range local : fn.locals)
+        range.begin = local.end > range.begin ? local.end : range.begin;
+
+    range.begin = align(range.begin, sizeof(ic_data));
+    range.end = range.begin + sizeof(ic_data);
+    fn.locals.push_back(range);
+    fn.frame_size = range.end / sizeof(ic_data);
+    return range.begin;
+}
+
+// stores the value on top of the operand stack to a frame slot and pops it
+void ir_insert_slot_store(ic_ir_block& block, int idx, int slot)
+{
+    ic_ir_instr address = make_instr(IC_OPC_ADDRESS);
+    address.operand.s32 = slot;
+    ir_insert_instr(block, idx, address);
+    ir_insert_instr(block, idx + 1, make_instr(IC_OPC_STORE_8));
+    ir_insert_instr(block, idx + 2, make_instr(IC_OPC_POP));
+}
+
+// replaces instructions that compute a value with a load from a frame slot
+void ir_replace_with_slot_load(ic_ir_block& block, ic_ir_span span, int slot)
+{
+    ir_remove_instrs(block, span.begin, span.end - span.begin + 1);
+    ic_ir_instr address = make_instr(IC_OPC_ADDRESS);
+    address.operand.s32 = slot;
+    ir_insert_instr(block, span.begin, address);
+    ir_insert_instr(block, span.begin + 1, make_instr(IC_OPC_LOAD_8));
+}
+
+// a pure instruction that computes exactly one value from a fixed number of operands
+bool ir_is_expression(ic_opcode opcode)
+{
+    const ic_opcode_info& info = opcode_info(opcode);
+    return info.pure && info.pops != IC_VARIABLE && info.pushes == 1 && opcode != IC_OPC_PUSH;
+}
+
+int intersect_dominators(ic_array<int>& idom, ic_array<int>& order, int lhs, int rhs)
+{
+    while (lhs != rhs)
+    {
+        while (order.buf[lhs] > order.buf[rhs])
+            lhs = idom.buf[lhs];
+        while (order.buf[rhs] > order.buf[lhs])
+            rhs = idom.buf[rhs];
+    }
+    return lhs;
+}
+
+// immediate dominator of each reachable block (Cooper, Harvey, Kennedy), -1 for unreachable blocks; requires ir_build_ssa()
+void ir_compute_dominators(ic_ir_function& fn, ic_array<int>& idom)
+{
+    // reverse postorder
+    ic_array<int> rpo;
+    ic_array<int> order; // position of a block in rpo
+    ic_array<int> work; // pairs of a block and the next successor to visit
+    rpo.init();
+    order.init();
+    work.init();
+    order.resize(fn.blocks.size);
+
+    for (int& o : order)
+        o = -1;
+
+    order.buf[0] = 0;
+    work.push_back(0);
+    work.push_back(0);
+
+    while (work.size)
+    {
+        int b = work.buf[work.size - 2];
+        int& s = work.back();
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (s == block.succs_size)
+        {
+            rpo.push_back(b);
+            work.resize(work.size - 2);
+            continue;
+        }
+        int succ = block.succs[s];
+        s += 1;
+
+        if (order.buf[succ] == -1)
+        {
+            order.buf[succ] = 0;
+            work.push_back(succ);
+            work.push_back(0);
+        }
+    }
+
+    for (int i = 0; i < rpo.size / 2; ++i)
+    {
+        int tmp = rpo.buf[i];
+        rpo.buf[i] = rpo.buf[rpo.size - 1 - i];
+        rpo.buf[rpo.size - 1 - i] = tmp;
+    }
+
+    for (int i = 0; i < rpo.size; ++i)
+        order.buf[rpo.buf[i]] = i;
+
+    idom.resize(fn.blocks.size);
+
+    for (int& d : idom)
+        d = -1;
+
+    idom.buf[0] = 0;
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (int i = 1; i < rpo.size; ++i)
+        {
+            ic_ir_block& block = fn.blocks.buf[rpo.buf[i]];
+            int new_idom = -1;
+
+            for (int p = 0; p < block.preds_size; ++p)
+            {
+                int pred = *fn.ref(block.preds_begin + p);
+
+                if (idom.buf[pred] == -1)
+                    continue;
+                new_idom = new_idom == -1 ? pred : intersect_dominators(idom, order, pred, new_idom);
+            }
+
+            if (idom.buf[rpo.buf[i]] != new_idom)
+            {
+                idom.buf[rpo.buf[i]] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    rpo.free();
+    order.free();
+    work.free();
+}
+
+bool ir_dominates(ic_array<int>& idom, int dominator, int block)
+{
+    if (idom.buf[block] == -1)
+        return false;
+
+    for (;;)
+    {
+        if (block == dominator)
+            return true;
+        if (!block)
+            return false;
+        block = idom.buf[block];
+    }
+}
+
+bool ranges_overlap(ic_ir_range lhs, ic_ir_range rhs)
+{
+    return lhs.begin < rhs.end && rhs.begin < lhs.end;
+}
+
+// extent of a variable at a given offset; variables from different scopes may share an offset, the largest one is taken
+ic_ir_range variable_range(ic_ir_function& fn, ic_ir_base base, int root)
+{
+    ic_ir_range range;
+    range.begin = root;
+    range.end = root;
+
+    if (base == IC_IR_BASE_LOCAL)
+    {
+        for (ic_ir_range local : fn.locals)
+        {
+            if (local.begin == root && local.end > range.end)
+                range.end = local.end;
+        }
+    }
+    else
+    {
+        for (ic_var& var : fn.memory->global_vars)
+        {
+            if (var.byte_idx == root && var.byte_idx + type_byte_size(var.type) > range.end)
+                range.end = var.byte_idx + type_byte_size(var.type);
+        }
+    }
+
+    // e.g. a string literal or a return value; pointer arithmetic may reach anything above
+    if (range.end == range.begin)
+        range.end = INT_MAX;
+    return range;
+}
+
+// address of each value and local memory that escapes through pointers, requires ir_build_ssa()
+void ir_analyze_memory(ic_ir_function& fn)
+{
+    fn.addresses.resize(fn.values.size);
+    fn.escaped.clear();
+
+    // a value is always defined after the values it is computed from
+    for (int v = 0; v < fn.values.size; ++v)
+    {
+        ic_ir_value value = fn.values.buf[v];
+        ic_ir_address& address = fn.addresses.buf[v];
+        address.base = IC_IR_BASE_UNKNOWN;
+        address.known_offset = false;
+        address.root = 0;
+        address.offset = 0;
+
+        if (value.instr == IC_VARIABLE)
+            continue;
+
+        ic_ir_instr& instr = fn.instr(value);
+
+        switch (instr.opcode)
+        {
+        case IC_OPC_ADDRESS:
+        case IC_OPC_ADDRESS_GLOBAL:
+            address.base = instr.opcode == IC_OPC_ADDRESS ? IC_IR_BASE_LOCAL : IC_IR_BASE_GLOBAL;
+            address.known_offset = true;
+            address.root = instr.operand.s32;
+            break;
+        case IC_OPC_ADD_PTR_S32:
+        case IC_OPC_SUB_PTR_S32:
+        {
+            int* args = fn.ref(instr.args_begin);
+            address = fn.addresses.buf[args[0]];
+            ic_ir_value idx = fn.values.buf[args[1]];
+
+            if (idx.instr != IC_VARIABLE && fn.instr(idx).opcode == IC_OPC_PUSH_S32)
+            {
+                int bytes = fn.instr(idx).operand.s32 * instr.operand.s32;
+                address.offset += instr.opcode == IC_OPC_ADD_PTR_S32 ? bytes : -bytes;
+            }
+            else
+                address.known_offset = false;
+            break;
+        }
+        }
+    }
+
+    // a local address escapes if it is used for anything else than an access or pointer arithmetic
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (!block.reachable)
+            continue;
+
+        for (int p = 0; p < block.phis_size; ++p)
+        {
+            ic_ir_phi& phi = fn.phis.buf[block.phis_begin + p];
+
+            for (int a = 0; a < block.preds_size; ++a)
+            {
+                ic_ir_address address = fn.addresses.buf[*fn.ref(phi.args_begin + a)];
+
+                if (address.base == IC_IR_BASE_LOCAL)
+                    fn.escaped.push_back(variable_range(fn, address.base, address.root));
+            }
+        }
+
+        for (ic_ir_instr& instr : block.instrs)
+        {
+            int safe_arg = -1;
+
+            switch (instr.opcode)
+            {
+            case IC_OPC_POP:
+            case IC_OPC_POP_MANY:
+            case IC_OPC_SWAP:
+            case IC_OPC_CLONE:
+            case IC_OPC_JUMP_TRUE:
+            case IC_OPC_JUMP_FALSE:
+            case IC_OPC_LOAD_1:
+            case IC_OPC_LOAD_4:
+            case IC_OPC_LOAD_8:
+            case IC_OPC_LOAD_STRUCT:
+            case IC_OPC_ADD_PTR_S32:
+            case IC_OPC_SUB_PTR_S32:
+            case IC_OPC_SUB_PTR_PTR:
+            case IC_OPC_B_PTR:
+            case IC_OPC_COMPARE_E_PTR:
+            case IC_OPC_COMPARE_NE_PTR:
+            case IC_OPC_COMPARE_G_PTR:
+            case IC_OPC_COMPARE_GE_PTR:
+            case IC_OPC_COMPARE_L_PTR:
+            case IC_OPC_COMPARE_LE_PTR:
+                continue;
+            case IC_OPC_STORE_1:
+            case IC_OPC_STORE_4:
+            case IC_OPC_STORE_8:
+            case IC_OPC_STORE_STRUCT:
+                safe_arg = instr.args_size - 1; // destination
+                break;
+            }
+
+            for (int a = 0; a < instr.args_size; ++a)
+            {
+                ic_ir_address address = fn.addresses.buf[*fn.ref(instr.args_begin + a)];
+
+                if (a != safe_arg && address.base == IC_IR_BASE_LOCAL)
+                    fn.escaped.push_back(variable_range(fn, address.base, address.root));
+            }
+        }
+    }
+}
+
+// memory accessed by a load or a store, requires ir_analyze_memory()
+bool ir_access(ic_ir_function& fn, ic_ir_instr& instr, ic_ir_access* access)
+{
+    int size;
+
+    switch (instr.opcode)
+    {
+    case IC_OPC_LOAD_1:
+    case IC_OPC_STORE_1:
+        size = 1;
+        break;
+    case IC_OPC_LOAD_4:
+    case IC_OPC_STORE_4:
+        size = 4;
+        break;
+    case IC_OPC_LOAD_8:
+    case IC_OPC_STORE_8:
+        size = 8;
+        break;
+    case IC_OPC_LOAD_STRUCT:
+    case IC_OPC_STORE_STRUCT:
+        size = instr.operand.s32;
+        break;
+    default:
+        return false;
+    }
+    ic_ir_address address = fn.addresses.buf[*fn.ref(instr.args_begin + instr.args_size - 1)];
+    access->base = address.base;
+
+    if (address.base == IC_IR_BASE_UNKNOWN)
+        access->range = {};
+    else if (address.known_offset)
+    {
+        access->range.begin = address.root + address.offset;
+        access->range.end = access->range.begin + size;
+    }
+    else
+        access->range = variable_range(fn, address.base, address.root);
+    return true;
+}
+
+bool is_escaped(ic_ir_function& fn, ic_ir_range range)
+{
+    for (ic_ir_range escaped : fn.escaped)
+    {
+        if (ranges_overlap(range, escaped))
+            return true;
+    }
+    return false;
+}
+
+bool ir_call_clobbers(ic_ir_function& fn, ic_ir_access access)
+{
+    return access.base != IC_IR_BASE_LOCAL || is_escaped(fn, access.range);
+}
+
+bool ir_may_alias(ic_ir_function& fn, ic_ir_access lhs, ic_ir_access rhs)
+{
+    if (lhs.base == IC_IR_BASE_UNKNOWN)
+        return ir_call_clobbers(fn, rhs);
+    if (rhs.base == IC_IR_BASE_UNKNOWN)
+        return ir_call_clobbers(fn, lhs);
+    return lhs.base == rhs.base && ranges_overlap(lhs.range, rhs.range);
+}
+
+void print_operand(ic_ir_instr& instr)
+{
+    switch (opcode_info(instr.opcode).operand)
+    {
+    case IC_OPERAND_NONE:
+        break;
+    case IC_OPERAND_S8:
+        printf(" %d", instr.operand.s8);
+        break;
+    case IC_OPERAND_S32:
+        if (!is_jump(instr.opcode))
+            printf(" %d", instr.operand.s32);
+        break;
+    case IC_OPERAND_F32:
+        printf(" %f", instr.operand.f32);
+        break;
+    case IC_OPERAND_F64:
+        printf(" %f", instr.operand.f64);
+        break;
+    case IC_OPERAND_S32X3:
+        printf(" %d %d %d", instr.operand.s32x3[0], instr.operand.s32x3[1], instr.operand.s32x3[2]);
+        break;
+    }
+}
+
+void ir_print(ic_ir_function& fn)
+{
+    ic_string name = fn.function->token.string;
+    printf("function %.*s (frame: %d, instructions: %d -> %d)\n", name.len, name.data, fn.frame_size, fn.initial_instr_count,
+        ir_instr_count(fn));
+
+    if (!ir_build_ssa(fn))
+        printf("    ssa construction failed, inconsistent operand stack\n");
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+        printf("bb%d:", b);
+
+        if (!block.reachable)
+            printf(" ; unreachable");
+        else if (block.preds_size)
+        {
+            printf(" ; preds:");
+
+            for (int p = 0; p < block.preds_size; ++p)
+                printf(" bb%d", *fn.ref(block.preds_begin + p));
+        }
+        printf("\n");
+
+        for (int p = 0; p < block.phis_size; ++p)
+        {
+            ic_ir_phi& phi = fn.phis.buf[block.phis_begin + p];
+            printf("    v%d:%s = phi", phi.value, _ir_type_names[fn.values.buf[phi.value].type]);
+
+            for (int a = 0; a < block.preds_size; ++a)
+                printf(" [bb%d v%d]", *fn.ref(block.preds_begin + a), *fn.ref(phi.args_begin + a));
+            printf("\n");
+        }
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+            printf("    ");
+
+            if (block.reachable)
+            {
+                int printed = 0;
+
+                for (int r = 0; r < instr.results_size; ++r)
+                {
+                    int value = *fn.ref(instr.results_begin + r);
+
+                    // swap, clone and store leave already defined values
+                    if (fn.values.buf[value].block != b || fn.values.buf[value].instr != i)
+                        continue;
+                    printf("%sv%d:%s", printed ? " " : "", value, _ir_type_names[fn.values.buf[value].type]);
+                    printed += 1;
+                }
+
+                if (printed)
+                    printf(" = ");
+            }
+            printf("%s", opcode_info(instr.opcode).name);
+            print_operand(instr);
+
+            if (block.reachable)
+            {
+                for (int a = 0; a < instr.args_size; ++a)
+                    printf(" v%d", *fn.ref(instr.args_begin + a));
+            }
+
+            if (is_jump(instr.opcode))
+                printf(" -> bb%d", instr.target);
+            printf("\n");
+        }
+    }
+    printf("\n");
+}
+
+// removes unreachable blocks and operand stack values that are computed only to be popped
+bool ir_pass_dce(ic_ir_function& fn)
+{
+    bool changed = false;
+
+    for (int b = fn.blocks.size - 1; b > 0; --b)
+    {
+        if (!fn.blocks.buf[b].reachable)
+        {
+            ir_remove_block(fn, b);
+            changed = true;
+        }
+    }
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        bool block_changed = true;
+
+        while (block_changed)
+        {
+            block_changed = false;
+
+            for (int i = 0; i < block.instrs.size; ++i)
+            {
+                ic_ir_instr& instr = block.instrs.buf[i];
+
+                if (instr.opcode == IC_OPC_POP_MANY && instr.operand.s32 <= 1)
+                {
+                    if (instr.operand.s32 == 1)
+                        instr.opcode = IC_OPC_POP;
+                    else
+                    {
+                        memmove(&instr, &instr + 1, (block.instrs.size - i - 1) * sizeof(ic_ir_instr));
+                        block.instrs.pop_back();
+                    }
+                    block_changed = true;
+                    break;
+                }
+
+                if (i + 1 == block.instrs.size)
+                    break;
+
+                ic_ir_instr& next = block.instrs.buf[i + 1];
+
+                if (!opcode_info(instr.opcode).pure || (next.opcode != IC_OPC_POP && next.opcode != IC_OPC_POP_MANY))
+                    continue;
+
+                int pops, pushes;
+                stack_effect(fn, instr, &pops, &pushes);
+                int pop_count = next.opcode == IC_OPC_POP ? 1 : next.operand.s32;
+
+                if (pushes > pop_count)
+                    continue;
+                // pure instruction followed by a pop of all its results is the same as popping its arguments
+                next = make_instr(IC_OPC_POP_MANY);
+                next.operand.s32 = pop_count - pushes + pops;
+                memmove(&instr, &instr + 1, (block.instrs.size - i - 1) * sizeof(ic_ir_instr));
+                block.instrs.pop_back();
+                block_changed = true;
+                break;
+            }
+            changed = changed || block_changed;
+        }
+    }
+    return changed;
+}
+
+// multiplications and divisions by a power of two constant are replaced with shifts
+bool ir_pass_peephole(ic_ir_function& fn)
+{
+    bool changed = false;
+
+    for (ic_ir_block& block : fn.blocks)
+    {
+        for (int i = 0; i + 1 < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+            ic_ir_instr& next = block.instrs.buf[i + 1];
+            int value = instr.operand.s32;
+
+            if (instr.opcode != IC_OPC_PUSH_S32 || (next.opcode != IC_OPC_MUL_S32 && next.opcode != IC_OPC_DIV_S32) || value <= 0 ||
+                (value & (value - 1)))
+                continue;
+
+            int count = 0;
+
+            while ((1 << count) != value)
+                count += 1;
+
+            if (count)
+            {
+                next = make_instr(next.opcode == IC_OPC_MUL_S32 ? IC_OPC_SHL_S32 : IC_OPC_SHR_S32);
+                next.operand.s32 = count;
+                ir_remove_instrs(block, i, 1);
+            }
+            else
+                ir_remove_instrs(block, i, 2);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void optimize_function(ic_function& function, ic_memory& memory)
+{
+    assert(function.type == IC_FUN_SOURCE);
+    ic_ir_function fn;
+    fn.function = &function;
+    fn.memory = &memory;
+    fn.blocks.init();
+    fn.values.init();
+    fn.phis.init();
+    fn.refs.init();
+    fn.locals.init();
+    fn.addresses.init();
+    fn.escaped.init();
+
+    for (ic_var& var : memory.frame_vars)
+    {
+        ic_ir_range range;
+        range.begin = var.byte_idx;
+        // non-struct variables are initialized with store_8, see compile_stmt()
+        range.end = var.byte_idx + (is_struct(var.type) ? type_byte_size(var.type) : (int)sizeof(ic_data));
+        fn.locals.push_back(range);
+    }
+    decode_function(fn, memory.bytecode.buf + function.instr_idx, memory.bytecode.end(), function.instr_idx);
+
+    if (memory.flags & IC_COMPILE_OPTIMIZE)
+    {
+        for (ic_ir_pass& pass : _passes)
+        {
+            // if the operand stack can't be modeled, optimizations are not safe; this should not happen for the compiler output
+            if (!ir_build_ssa(fn))
+                break;
+            pass.run(fn);
+        }
+    }
+
+    if (memory.flags & IC_COMPILE_PRINT_IR)
+        ir_print(fn);
+
+    lower_function(fn);
+
+    for (ic_ir_block& block : fn.blocks)
+        block.instrs.free();
+    fn.blocks.free();
+    fn.values.free();
+    fn.phis.free();
+    fn.refs.free();
+    fn.locals.free();
+    fn.addresses.free();
+    fn.escaped.free();
+}
@@ -0,0 +1,216 @@
+#include "ic_impl.h"
+
+// an expression computed earlier in a block
+struct ic_ir_available
+{
+    ic_opcode opcode;
+    ic_ir_operand operand;
+    int args[2]; // value numbers
+    int args_size;
+    int number; // the value that computed it first
+    bool is_load;
+    ic_ir_access access;
+};
+
+// common subexpression elimination within basic blocks; values are numbered by their opcode, operand and operand numbers,
+// a value that recomputes an available one is replaced with a load from a frame slot the first value is saved to
+bool ir_pass_cse(ic_ir_function& fn)
+{
+    ir_analyze_memory(fn);
+    ic_array<int> numbers; // per value
+    ic_array<int> tree_begin; // per value, first instruction of an expression tree that computes it, -1 if it is not a tree
+    ic_array<char> interior; // per value, an operand of a redundant tree
+    ic_array<ic_ir_available> available;
+    ic_array<int> savings; // per instruction of a block that computes a first value
+    ic_array<int> slots; // per instruction of a block that computes a first value, -1 if it is not saved
+    ic_array<int> pool; // slots live only within a block and are shared by all blocks
+    numbers.init();
+    tree_begin.init();
+    interior.init();
+    available.init();
+    savings.init();
+    slots.init();
+    pool.init();
+    numbers.resize(fn.values.size);
+    tree_begin.resize(fn.values.size);
+    interior.resize(fn.values.size);
+    memset(interior.buf, 0, interior.size);
+
+    for (int v = 0; v < fn.values.size; ++v)
+    {
+        numbers.buf[v] = v;
+        tree_begin.buf[v] = -1;
+    }
+    bool changed = false;
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (!block.reachable)
+            continue;
+
+        available.clear();
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+            ic_ir_access access;
+            bool is_call = instr.opcode == IC_OPC_CALL || instr.opcode == IC_OPC_CALL_HOST;
+            bool is_store = !opcode_info(instr.opcode).pure && ir_access(fn, instr, &access);
+
+            if (is_call || is_store)
+            {
+                for (int a = available.size - 1; a >= 0; --a)
+                {
+                    ic_ir_available& expr = available.buf[a];
+
+                    if (expr.is_load && (is_call ? ir_call_clobbers(fn, expr.access) : ir_may_alias(fn, access, expr.access)))
+                    {
+                        expr = available.back();
+                        available.pop_back();
+                    }
+                }
+                continue;
+            }
+
+            if (!ir_is_expression(instr.opcode) || instr.results_size != 1)
+                continue;
+
+            int value = *fn.ref(instr.results_begin);
+            int* args = fn.ref(instr.args_begin);
+            assert(instr.args_size <= 2);
+            ic_ir_available expr;
+            memset(&expr, 0, sizeof(expr));
+            expr.opcode = instr.opcode;
+            expr.operand = instr.operand;
+            expr.args_size = instr.args_size;
+            expr.number = value;
+            expr.is_load = ir_access(fn, instr, &expr.access);
+
+            for (int a = 0; a < instr.args_size; ++a)
+                expr.args[a] = numbers.buf[args[a]];
+
+            for (ic_ir_available& other : available)
+            {
+                if (other.opcode == expr.opcode && !memcmp(&other.operand, &expr.operand, sizeof(ic_ir_operand)) &&
+                    !memcmp(other.args, expr.args, expr.args_size * sizeof(int)))
+                {
+                    numbers.buf[value] = other.number;
+                    break;
+                }
+            }
+
+            if (numbers.buf[value] == value)
+                available.push_back(expr);
+
+            int begin = i;
+
+            // operands of a tree are computed by the directly preceding instructions and used only once
+            for (int a = instr.args_size - 1; a >= 0; --a)
+            {
+                ic_ir_value arg = fn.values.buf[args[a]];
+
+                if (arg.block != b || arg.instr != begin - 1 || arg.use_count != 1 || tree_begin.buf[args[a]] == -1)
+                {
+                    begin = -1;
+                    break;
+                }
+                begin = tree_begin.buf[args[a]];
+            }
+            tree_begin.buf[value] = begin;
+
+            // operands of a redundant tree are redundant as well, only the whole tree is replaced
+            if (begin != -1 && numbers.buf[value] != value)
+            {
+                for (int a = 0; a < instr.args_size; ++a)
+                    interior.buf[args[a]] = true;
+            }
+        }
+
+        // saving a first value costs 4 instructions, replacing a redundant tree saves its size minus 2
+        savings.resize(block.instrs.size);
+        slots.resize(block.instrs.size);
+        memset(savings.buf, 0, savings.size * sizeof(int));
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int i = 0; i < block.instrs.size; ++i)
+            {
+                ic_ir_instr& instr = block.instrs.buf[i];
+                slots.buf[i] = pass ? slots.buf[i] : -1;
+
+                if (!ir_is_expression(instr.opcode) || instr.results_size != 1)
+                    continue;
+
+                int value = *fn.ref(instr.results_begin);
+                int first = numbers.buf[value];
+
+                if (first == value || interior.buf[value] || tree_begin.buf[value] == -1)
+                    continue;
+
+                int first_instr = fn.values.buf[first].instr;
+
+                if (!pass)
+                    savings.buf[first_instr] += i - tree_begin.buf[value] + 1 - 2;
+                else if (savings.buf[first_instr] > 4)
+                    slots.buf[first_instr] = 0;
+            }
+        }
+        int pool_used = 0;
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            if (slots.buf[i] == -1)
+                continue;
+
+            if (pool_used == pool.size)
+                pool.push_back(ir_allocate_slot(fn));
+            slots.buf[i] = pool.buf[pool_used];
+            pool_used += 1;
+        }
+
+        // from the end of a block, so pending instruction indices stay valid
+        for (int i = block.instrs.size - 1; i >= 0; --i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+
+            if (slots.buf[i] != -1)
+            {
+                ir_insert_instr(block, i + 1, make_instr(IC_OPC_CLONE));
+                ir_insert_slot_store(block, i + 2, slots.buf[i]);
+                changed = true;
+                continue;
+            }
+
+            if (!ir_is_expression(instr.opcode) || instr.results_size != 1)
+                continue;
+
+            int value = *fn.ref(instr.results_begin);
+            int first = numbers.buf[value];
+
+            if (first == value || interior.buf[value] || tree_begin.buf[value] == -1)
+                continue;
+
+            int slot = slots.buf[fn.values.buf[first].instr];
+
+            if (slot == -1)
+                continue;
+
+            ic_ir_span span;
+            span.block = b;
+            span.begin = tree_begin.buf[value];
+            span.end = i;
+            ir_replace_with_slot_load(block, span, slot);
+            i = span.begin; // instructions after the span were already processed and have moved
+        }
+    }
+    numbers.free();
+    tree_begin.free();
+    interior.free();
+    available.free();
+    savings.free();
+    slots.free();
+    pool.free();
+    return changed;
+}
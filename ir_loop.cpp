@@ -0,0 +1,756 @@
+#include "ic_impl.h"
+
+// natural loop, all blocks that can reach a back edge without passing through the header
+struct ic_ir_loop
+{
+    int header;
+    int size;
+    ic_array<bool> body;
+};
+
+void find_loops(ic_ir_function& fn, ic_array<int>& idom, ic_array<ic_ir_loop>& loops)
+{
+    ic_array<int> work;
+    work.init();
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (!block.reachable)
+            continue;
+
+        for (int s = 0; s < block.succs_size; ++s)
+        {
+            int header = block.succs[s];
+
+            if (!ir_dominates(idom, header, b))
+                continue;
+
+            ic_ir_loop* loop = nullptr;
+
+            for (ic_ir_loop& l : loops)
+            {
+                if (l.header == header)
+                    loop = &l;
+            }
+
+            if (!loop)
+            {
+                loops.push_back();
+                loop = &loops.back();
+                loop->header = header;
+                loop->size = 1;
+                loop->body.init();
+                loop->body.resize(fn.blocks.size);
+                memset(loop->body.buf, 0, loop->body.size * sizeof(bool));
+                loop->body.buf[header] = true;
+            }
+
+            if (!loop->body.buf[b])
+            {
+                loop->body.buf[b] = true;
+                loop->size += 1;
+                work.push_back(b);
+            }
+
+            while (work.size)
+            {
+                ic_ir_block& member = fn.blocks.buf[work.back()];
+                work.pop_back();
+
+                for (int p = 0; p < member.preds_size; ++p)
+                {
+                    int pred = *fn.ref(member.preds_begin + p);
+
+                    if (!loop->body.buf[pred])
+                    {
+                        loop->body.buf[pred] = true;
+                        loop->size += 1;
+                        work.push_back(pred);
+                    }
+                }
+            }
+        }
+    }
+    work.free();
+}
+
+bool falls_through(ic_ir_block& block)
+{
+    if (!block.instrs.size)
+        return true;
+    ic_opcode last = block.instrs.back().opcode;
+    return last != IC_OPC_JUMP && last != IC_OPC_RETURN;
+}
+
+// inserts an empty block that is executed once before a loop is entered, returns false if the block layout doesn't allow it
+bool insert_preheader(ic_ir_function& fn, ic_ir_loop& loop)
+{
+    int header = loop.header;
+
+    // the preheader is placed right before the header, a loop block can't fall through into it
+    if (header && loop.body.buf[header - 1] && falls_through(fn.blocks.buf[header - 1]))
+        return false;
+
+    ic_array<int> entries; // blocks outside of the loop that jump to the header
+    entries.init();
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        if (!loop.body.buf[b] && block.instrs.size && is_jump(block.instrs.back().opcode) && block.instrs.back().target == header)
+            entries.push_back(b);
+    }
+    ir_insert_block(fn, header);
+
+    for (int b : entries)
+    {
+        ic_ir_block& block = fn.blocks.buf[b < header ? b : b + 1];
+        block.instrs.back().target = header;
+    }
+    entries.free();
+    return true;
+}
+
+// an invariant instruction that could trap may be executed before the loop only if the loop would execute it anyway
+bool may_trap(ic_ir_function& fn, ic_ir_instr& instr)
+{
+    switch (instr.opcode)
+    {
+    case IC_OPC_LOAD_1:
+    case IC_OPC_LOAD_4:
+    case IC_OPC_LOAD_8:
+    {
+        ic_ir_address address = fn.addresses.buf[*fn.ref(instr.args_begin)];
+        return address.base == IC_IR_BASE_UNKNOWN || !address.known_offset;
+    }
+    case IC_LOGICAL_NOT:
+    case IC_OPC_PUSH_S8:
+    case IC_OPC_PUSH_S32:
+    case IC_OPC_PUSH_F32:
+    case IC_OPC_PUSH_F64:
+    case IC_OPC_PUSH_NULLPTR:
+    case IC_OPC_ADDRESS:
+    case IC_OPC_ADDRESS_GLOBAL:
+    case IC_OPC_ADDRESS_STRING:
+    case IC_OPC_COMPARE_E_S32:
+    case IC_OPC_COMPARE_NE_S32:
+    case IC_OPC_COMPARE_G_S32:
+    case IC_OPC_COMPARE_GE_S32:
+    case IC_OPC_COMPARE_L_S32:
+    case IC_OPC_COMPARE_LE_S32:
+    case IC_OPC_NEGATE_S32:
+    case IC_OPC_ADD_S32:
+    case IC_OPC_SUB_S32:
+    case IC_OPC_MUL_S32:
+    case IC_OPC_SHL_S32:
+    case IC_OPC_SHR_S32:
+    case IC_OPC_COMPARE_E_F32:
+    case IC_OPC_COMPARE_NE_F32:
+    case IC_OPC_COMPARE_G_F32:
+    case IC_OPC_COMPARE_GE_F32:
+    case IC_OPC_COMPARE_L_F32:
+    case IC_OPC_COMPARE_LE_F32:
+    case IC_OPC_NEGATE_F32:
+    case IC_OPC_ADD_F32:
+    case IC_OPC_SUB_F32:
+    case IC_OPC_MUL_F32:
+    case IC_OPC_DIV_F32:
+    case IC_OPC_COMPARE_E_F64:
+    case IC_OPC_COMPARE_NE_F64:
+    case IC_OPC_COMPARE_G_F64:
+    case IC_OPC_COMPARE_GE_F64:
+    case IC_OPC_COMPARE_L_F64:
+    case IC_OPC_COMPARE_LE_F64:
+    case IC_OPC_NEGATE_F64:
+    case IC_OPC_ADD_F64:
+    case IC_OPC_SUB_F64:
+    case IC_OPC_MUL_F64:
+    case IC_OPC_DIV_F64:
+    case IC_OPC_COMPARE_E_PTR:
+    case IC_OPC_COMPARE_NE_PTR:
+    case IC_OPC_COMPARE_G_PTR:
+    case IC_OPC_COMPARE_GE_PTR:
+    case IC_OPC_COMPARE_L_PTR:
+    case IC_OPC_COMPARE_LE_PTR:
+    case IC_OPC_SUB_PTR_PTR:
+    case IC_OPC_ADD_PTR_S32:
+    case IC_OPC_SUB_PTR_S32:
+    case IC_OPC_B_S8:
+    case IC_OPC_B_U8:
+    case IC_OPC_B_S32:
+    case IC_OPC_B_F32:
+    case IC_OPC_B_F64:
+    case IC_OPC_B_PTR:
+    case IC_OPC_S8_U8:
+    case IC_OPC_S8_S32:
+    case IC_OPC_S8_F32:
+    case IC_OPC_S8_F64:
+    case IC_OPC_U8_S8:
+    case IC_OPC_U8_S32:
+    case IC_OPC_U8_F32:
+    case IC_OPC_U8_F64:
+    case IC_OPC_S32_S8:
+    case IC_OPC_S32_U8:
+    case IC_OPC_S32_F32:
+    case IC_OPC_S32_F64:
+    case IC_OPC_F32_S8:
+    case IC_OPC_F32_U8:
+    case IC_OPC_F32_S32:
+    case IC_OPC_F32_F64:
+    case IC_OPC_F64_S8:
+    case IC_OPC_F64_U8:
+    case IC_OPC_F64_S32:
+    case IC_OPC_F64_F32:
+        return false;
+    default: // division and modulo by zero, and anything not listed
+        return true;
+    }
+}
+
+struct ic_ir_loop_analysis
+{
+    ic_array<ic_ir_access> writes; // stores in a loop
+    bool calls;
+    ic_array<char> invariant; // per value
+    ic_array<int> tree_begin; // per value, first instruction of an invariant expression tree that computes it, -1 if it is not a tree
+    ic_array<char> interior; // per value, an operand of a bigger tree
+
+    void init()
+    {
+        writes.init();
+        invariant.init();
+        tree_begin.init();
+        interior.init();
+    }
+
+    void free()
+    {
+        writes.free();
+        invariant.free();
+        tree_begin.free();
+        interior.free();
+    }
+};
+
+void analyze_loop(ic_ir_function& fn, ic_ir_loop& loop, ic_ir_loop_analysis& la)
+{
+    la.invariant.resize(fn.values.size);
+    la.tree_begin.resize(fn.values.size);
+    la.interior.resize(fn.values.size);
+    memset(la.invariant.buf, 0, la.invariant.size);
+    memset(la.interior.buf, 0, la.interior.size);
+
+    for (int& begin : la.tree_begin)
+        begin = -1;
+
+    la.writes.clear();
+    la.calls = false;
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        if (!loop.body.buf[b])
+            continue;
+
+        for (ic_ir_instr& instr : fn.blocks.buf[b].instrs)
+        {
+            ic_ir_access access;
+
+            if (instr.opcode == IC_OPC_CALL || instr.opcode == IC_OPC_CALL_HOST)
+                la.calls = true;
+            else if (!opcode_info(instr.opcode).pure && ir_access(fn, instr, &access))
+                la.writes.push_back(access);
+        }
+    }
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        if (!loop.body.buf[b])
+            continue;
+
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+
+            if (!ir_is_expression(instr.opcode) || instr.results_size != 1)
+                continue;
+
+            int value = *fn.ref(instr.results_begin);
+            int* args = fn.ref(instr.args_begin);
+            bool is_invariant = true;
+
+            for (int a = 0; a < instr.args_size; ++a)
+                is_invariant = is_invariant && la.invariant.buf[args[a]];
+
+            ic_ir_access access;
+
+            if (is_invariant && ir_access(fn, instr, &access))
+            {
+                if (la.calls && ir_call_clobbers(fn, access))
+                    is_invariant = false;
+
+                for (ic_ir_access write : la.writes)
+                    is_invariant = is_invariant && !ir_may_alias(fn, write, access);
+            }
+
+            if (!is_invariant || (b != loop.header && may_trap(fn, instr)))
+                continue;
+
+            la.invariant.buf[value] = true;
+            int begin = i;
+
+            // operands of a tree are computed by the directly preceding instructions and used only once
+            for (int a = instr.args_size - 1; a >= 0; --a)
+            {
+                ic_ir_value arg = fn.values.buf[args[a]];
+
+                if (arg.block != b || arg.instr != begin - 1 || arg.use_count != 1 || la.tree_begin.buf[args[a]] == -1)
+                {
+                    begin = -1;
+                    break;
+                }
+                begin = la.tree_begin.buf[args[a]];
+            }
+            la.tree_begin.buf[value] = begin;
+
+            if (begin == -1)
+                continue;
+
+            for (int a = 0; a < instr.args_size; ++a)
+                la.interior.buf[args[a]] = true;
+        }
+    }
+}
+
+// moves invariant expression trees of a loop to its preheader, each computed value is kept in a new frame slot
+bool hoist_invariants(ic_ir_function& fn, ic_ir_loop& loop, ic_ir_loop_analysis& la)
+{
+    ic_array<ic_ir_span> hoists;
+    hoists.init();
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        if (!loop.body.buf[b])
+            continue;
+
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+
+            if (!ir_is_expression(instr.opcode) || instr.results_size != 1)
+                continue;
+
+            int value = *fn.ref(instr.results_begin);
+
+            if (!la.invariant.buf[value] || la.interior.buf[value] || la.tree_begin.buf[value] == -1)
+                continue;
+
+            ic_ir_span hoist;
+            hoist.block = b;
+            hoist.begin = la.tree_begin.buf[value];
+            hoist.end = i;
+
+            // a frame slot load is two instructions, shorter expressions are not worth it
+            if (hoist.end - hoist.begin + 1 > 2)
+                hoists.push_back(hoist);
+        }
+    }
+
+    bool changed = hoists.size && insert_preheader(fn, loop);
+
+    if (changed)
+    {
+        int preheader = loop.header;
+
+        for (ic_ir_span& hoist : hoists)
+        {
+            if (hoist.block >= preheader)
+                hoist.block += 1;
+        }
+
+        // in reverse, so the instruction indices of earlier trees in the same block stay valid
+        for (int h = hoists.size - 1; h >= 0; --h)
+        {
+            ic_ir_span hoist = hoists.buf[h];
+            ic_ir_block& block = fn.blocks.buf[hoist.block];
+            ic_ir_block& pre = fn.blocks.buf[preheader];
+            int slot = ir_allocate_slot(fn);
+            int count = hoist.end - hoist.begin + 1;
+
+            for (int i = 0; i < count; ++i)
+                ir_insert_instr(pre, i, block.instrs.buf[hoist.begin + i]);
+
+            ir_insert_slot_store(pre, count, slot);
+            ir_replace_with_slot_load(block, hoist, slot);
+        }
+    }
+    hoists.free();
+    return changed;
+}
+
+// an array subscript base[i] where i is an induction variable
+struct ic_ir_subscript
+{
+    ic_ir_span span; // base expression tree, index load and add_ptr_s32
+    int iv; // offset of the induction variable
+    int byte_size; // element size
+    int group; // subscripts with the same base, element size and induction variable share a pointer
+};
+
+// i = i + step, i is a local s32
+struct ic_ir_increment
+{
+    int block;
+    int instr; // store_4
+    int iv;
+    int step;
+};
+
+bool same_instrs(ic_ir_function& fn, ic_ir_span lhs, ic_ir_span rhs)
+{
+    if (lhs.end - lhs.begin != rhs.end - rhs.begin)
+        return false;
+
+    for (int i = 0; i <= lhs.end - lhs.begin; ++i)
+    {
+        ic_ir_instr& l = fn.blocks.buf[lhs.block].instrs.buf[lhs.begin + i];
+        ic_ir_instr& r = fn.blocks.buf[rhs.block].instrs.buf[rhs.begin + i];
+
+        if (l.opcode != r.opcode || memcmp(&l.operand, &r.operand, sizeof(ic_ir_operand)))
+            return false;
+    }
+    return true;
+}
+
+bool is_iv_access(ic_ir_access access, int iv)
+{
+    return access.base == IC_IR_BASE_LOCAL && access.range.begin == iv && access.range.end == iv + (int)sizeof(int);
+}
+
+// loads of i used by an increment must not be separated from its store by another store
+bool find_increment(ic_ir_function& fn, ic_ir_block& block, int b, int i, ic_ir_increment* increment)
+{
+    ic_ir_instr& store = block.instrs.buf[i];
+    ic_ir_access access;
+
+    if (store.opcode != IC_OPC_STORE_4 || !ir_access(fn, store, &access) || access.base != IC_IR_BASE_LOCAL)
+        return false;
+
+    ic_ir_value data = fn.values.buf[*fn.ref(store.args_begin)];
+
+    if (data.instr == IC_VARIABLE || data.block != b)
+        return false;
+
+    ic_ir_instr& add = fn.instr(data);
+
+    if (add.opcode != IC_OPC_ADD_S32 && add.opcode != IC_OPC_SUB_S32)
+        return false;
+
+    int* args = fn.ref(add.args_begin);
+    ic_ir_value lhs = fn.values.buf[args[0]];
+    ic_ir_value rhs = fn.values.buf[args[1]];
+
+    if (lhs.instr == IC_VARIABLE || rhs.instr == IC_VARIABLE || lhs.block != b || fn.instr(rhs).opcode != IC_OPC_PUSH_S32)
+        return false;
+
+    ic_ir_instr& load = fn.instr(lhs);
+    ic_ir_access load_access;
+
+    if (load.opcode != IC_OPC_LOAD_4 || !ir_access(fn, load, &load_access) || !is_iv_access(load_access, access.range.begin))
+        return false;
+
+    for (int j = lhs.instr + 1; j < i; ++j)
+    {
+        if (!opcode_info(block.instrs.buf[j].opcode).pure)
+            return false;
+    }
+    increment->block = b;
+    increment->instr = i;
+    increment->iv = access.range.begin;
+    increment->step = add.opcode == IC_OPC_ADD_S32 ? fn.instr(rhs).operand.s32 : -fn.instr(rhs).operand.s32;
+    return true;
+}
+
+// replaces base[i] with a pointer that is advanced together with i
+bool reduce_subscripts(ic_ir_function& fn, ic_ir_loop& loop, ic_ir_loop_analysis& la)
+{
+    ic_array<ic_ir_increment> increments;
+    ic_array<ic_ir_subscript> subscripts;
+    increments.init();
+    subscripts.init();
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        if (!loop.body.buf[b])
+            continue;
+
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 0; i < block.instrs.size; ++i)
+        {
+            ic_ir_increment increment;
+
+            if (find_increment(fn, block, b, i, &increment))
+                increments.push_back(increment);
+        }
+    }
+
+    for (int b = 0; b < fn.blocks.size; ++b)
+    {
+        if (!loop.body.buf[b])
+            continue;
+
+        ic_ir_block& block = fn.blocks.buf[b];
+
+        for (int i = 2; i < block.instrs.size; ++i)
+        {
+            ic_ir_instr& instr = block.instrs.buf[i];
+
+            if (instr.opcode != IC_OPC_ADD_PTR_S32)
+                continue;
+
+            int* args = fn.ref(instr.args_begin);
+            ic_ir_value idx = fn.values.buf[args[1]];
+            ic_ir_instr& load = block.instrs.buf[i - 1];
+            ic_ir_instr& address = block.instrs.buf[i - 2];
+
+            // base expression, address i, load_4, add_ptr_s32
+            if (idx.block != b || idx.instr != i - 1 || idx.use_count != 1 || load.opcode != IC_OPC_LOAD_4 || address.opcode != IC_OPC_ADDRESS ||
+                fn.values.buf[*fn.ref(load.args_begin)].use_count != 1)
+                continue;
+
+            ic_ir_value base = fn.values.buf[args[0]];
+            int begin = la.tree_begin.buf[args[0]];
+
+            if (base.block != b || base.instr != i - 3 || base.use_count != 1 || !la.invariant.buf[args[0]] || begin == -1)
+                continue;
+
+            ic_ir_subscript subscript;
+            subscript.span.block = b;
+            subscript.span.begin = begin;
+            subscript.span.end = i;
+            subscript.iv = address.operand.s32;
+            subscript.byte_size = instr.operand.s32;
+            subscript.group = subscripts.size;
+
+            for (ic_ir_subscript& other : subscripts)
+            {
+                ic_ir_span lhs = {b, begin, i - 3};
+                ic_ir_span rhs = {other.span.block, other.span.begin, other.span.end - 3};
+
+                if (other.iv == subscript.iv && other.byte_size == subscript.byte_size && same_instrs(fn, lhs, rhs))
+                {
+                    subscript.group = other.group;
+                    break;
+                }
+            }
+            subscripts.push_back(subscript);
+        }
+    }
+
+    // a pointer update costs 7 instructions per increment, a subscript replaced by a pointer load saves its size minus 2
+    ic_array<int> slots; // per group, 0 if a group is not reduced
+    slots.init();
+    slots.resize(subscripts.size);
+    bool any = false;
+
+    for (int g = 0; g < subscripts.size; ++g)
+    {
+        slots.buf[g] = 0;
+
+        if (subscripts.buf[g].group != g)
+            continue;
+
+        int iv = subscripts.buf[g].iv;
+        ic_ir_access iv_access;
+        iv_access.base = IC_IR_BASE_LOCAL;
+        iv_access.range.begin = iv;
+        iv_access.range.end = iv + sizeof(int);
+        int increment_count = 0;
+        int write_count = 0;
+
+        // i may be modified only by recognized increments
+        if (ir_call_clobbers(fn, iv_access))
+            continue;
+
+        for (ic_ir_increment& increment : increments)
+            increment_count += increment.iv == iv;
+
+        for (ic_ir_access write : la.writes)
+            write_count += ir_may_alias(fn, write, iv_access);
+
+        if (!increment_count || write_count != increment_count)
+            continue;
+
+        int saved = 0;
+
+        for (ic_ir_subscript& subscript : subscripts)
+        {
+            if (subscript.group == g)
+                saved += subscript.span.end - subscript.span.begin + 1 - 2;
+        }
+
+        if (saved > 7 * increment_count)
+        {
+            slots.buf[g] = 1;
+            any = true;
+        }
+    }
+
+    bool changed = any && insert_preheader(fn, loop);
+
+    if (changed)
+    {
+        int preheader = loop.header;
+
+        for (ic_ir_subscript& subscript : subscripts)
+        {
+            if (subscript.span.block >= preheader)
+                subscript.span.block += 1;
+        }
+
+        for (ic_ir_increment& increment : increments)
+        {
+            if (increment.block >= preheader)
+                increment.block += 1;
+        }
+
+        for (int g = 0; g < subscripts.size; ++g)
+        {
+            if (!slots.buf[g])
+                continue;
+
+            ic_ir_subscript& first = subscripts.buf[g];
+            ic_ir_block& pre = fn.blocks.buf[preheader];
+            slots.buf[g] = ir_allocate_slot(fn);
+
+            // pointer = base + i
+            for (int i = first.span.begin; i <= first.span.end; ++i)
+                pre.instrs.push_back(fn.blocks.buf[first.span.block].instrs.buf[i]);
+            ir_insert_slot_store(pre, pre.instrs.size, slots.buf[g]);
+        }
+
+        // edits are applied from the end of a block so pending instruction indices stay valid
+        for (int b = fn.blocks.size - 1; b >= 0; --b)
+        {
+            ic_ir_block& block = fn.blocks.buf[b];
+
+            for (int i = block.instrs.size - 1; i >= 0; --i)
+            {
+                for (ic_ir_increment& increment : increments)
+                {
+                    if (increment.block != b || increment.instr != i)
+                        continue;
+
+                    for (int g = 0; g < subscripts.size; ++g)
+                    {
+                        ic_ir_subscript& subscript = subscripts.buf[g];
+
+                        if (!slots.buf[g] || subscript.group != g || subscript.iv != increment.iv)
+                            continue;
+
+                        // pointer += step
+                        ic_ir_instr address = make_instr(IC_OPC_ADDRESS);
+                        address.operand.s32 = slots.buf[g];
+                        ic_ir_instr step = make_instr(IC_OPC_PUSH_S32);
+                        step.operand.s32 = increment.step;
+                        ic_ir_instr add = make_instr(IC_OPC_ADD_PTR_S32);
+                        add.operand.s32 = subscript.byte_size;
+                        ir_insert_instr(block, i + 1, address);
+                        ir_insert_instr(block, i + 2, make_instr(IC_OPC_LOAD_8));
+                        ir_insert_instr(block, i + 3, step);
+                        ir_insert_instr(block, i + 4, add);
+                        ir_insert_slot_store(block, i + 5, slots.buf[g]);
+                    }
+                }
+
+                for (ic_ir_subscript& subscript : subscripts)
+                {
+                    if (subscript.span.block == b && subscript.span.end == i && slots.buf[subscript.group])
+                        ir_replace_with_slot_load(block, subscript.span, slots.buf[subscript.group]);
+                }
+            }
+        }
+    }
+    increments.free();
+    subscripts.free();
+    slots.free();
+    return changed;
+}
+
+// applies a transformation to one loop at a time, until none of the loops changes;
+// loops are processed from the outermost, an inner loop is smaller than a loop that contains it
+bool transform_loops(ic_ir_function& fn, bool (*transform)(ic_ir_function& fn, ic_ir_loop& loop, ic_ir_loop_analysis& la))
+{
+    bool changed = false;
+    ic_array<int> idom;
+    ic_array<ic_ir_loop> loops;
+    ic_ir_loop_analysis la;
+    idom.init();
+    loops.init();
+    la.init();
+
+    for (;;)
+    {
+        ir_analyze_memory(fn);
+        ir_compute_dominators(fn, idom);
+        find_loops(fn, idom, loops);
+
+        for (int i = 1; i < loops.size; ++i)
+        {
+            for (int j = i; j > 0 && loops.buf[j].size > loops.buf[j - 1].size; --j)
+            {
+                ic_ir_loop tmp = loops.buf[j];
+                loops.buf[j] = loops.buf[j - 1];
+                loops.buf[j - 1] = tmp;
+            }
+        }
+        bool loop_changed = false;
+
+        for (ic_ir_loop& loop : loops)
+        {
+            analyze_loop(fn, loop, la);
+
+            if (transform(fn, loop, la))
+            {
+                loop_changed = true;
+                break;
+            }
+        }
+
+        for (ic_ir_loop& loop : loops)
+            loop.body.free();
+        loops.clear();
+
+        // every transformation removes instructions it could apply to, this terminates
+        if (!loop_changed)
+            break;
+        changed = true;
+
+        if (!ir_build_ssa(fn))
+            break;
+    }
+    idom.free();
+    loops.free();
+    la.free();
+    return changed;
+}
+
+// loop-invariant code motion; an expression is hoisted directly to the outermost loop it is invariant in,
+// what remains may still be invariant in an inner loop
+bool ir_pass_licm(ic_ir_function& fn)
+{
+    return transform_loops(fn, hoist_invariants);
+}
+
+// strength reduction of array subscripts indexed by induction variables
+bool ir_pass_ivsr(ic_ir_function& fn)
+{
+    return transform_loops(fn, reduce_subscripts);
+}
@@ -0,0 +1,186 @@
+#include "ic_impl.h"
+
+// line tables; the compiler records a row when it starts to emit code of a statement on another line, a table encodes
+// rows with functions of a program:
+// - ic_line_table_header
+// - ic_line_function entries in the order of offsets
+// - rows, each is an unsigned LEB128 offset delta and a zigzag LEB128 line delta from the previous row; the first row is
+//   relative to the code begin and line 0
+// - null terminated function names
+// a table is a separate section of a program file, the VM never reads it; ic_line_map decodes it for lookups
+
+struct ic_line_table_header
+{
+    int functions_size;
+    int rows_size;
+    int rows_byte_size;
+    int names_byte_size;
+};
+
+static void write_leb(ic_array<unsigned char>& buf, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        buf.push_back((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buf.push_back(value);
+}
+
+static bool read_leb(const unsigned char*& it, const unsigned char* end, unsigned int* value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 35 && it < end; shift += 7)
+    {
+        unsigned char byte = *it;
+        ++it;
+        *value |= (unsigned int)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// called by link_program() with rows and functions of a compilation
+void build_line_table(ic_program& program, ic_memory& memory)
+{
+    ic_array<unsigned char> rows;
+    ic_array<ic_line_function> functions;
+    ic_array<char> names;
+    rows.init();
+    functions.init();
+    names.init();
+    int prev_offset = program.strings_byte_size;
+    int prev_line = 0;
+
+    for (ic_line_row row : memory.lines)
+    {
+        assert(row.offset >= prev_offset);
+        int line_delta = row.line - prev_line;
+        write_leb(rows, row.offset - prev_offset);
+        write_leb(rows, ((unsigned int)line_delta << 1) ^ (unsigned int)(line_delta >> 31));
+        prev_offset = row.offset;
+        prev_line = row.line;
+    }
+
+    for (ic_function* function : memory.active_source_functions)
+    {
+        assert(!functions.size || function->instr_idx > functions.back().offset);
+        ic_string name = function->token.string;
+        functions.push_back({ function->instr_idx, names.size });
+        names.resize(names.size + name.len + 1);
+        memcpy(names.end() - name.len - 1, name.data, name.len);
+        names.back() = '\0';
+    }
+    ic_line_table_header header;
+    header.functions_size = functions.size;
+    header.rows_size = memory.lines.size;
+    header.rows_byte_size = rows.size;
+    header.names_byte_size = names.size;
+    int functions_byte_size = functions.size * sizeof(ic_line_function);
+    program.line_table_size = sizeof(header) + functions_byte_size + rows.size + names.size;
+    program.line_table = (unsigned char*)malloc(program.line_table_size);
+    unsigned char* it = program.line_table;
+    memcpy(it, &header, sizeof(header));
+    it += sizeof(header);
+    memcpy(it, functions.buf, functions_byte_size);
+    it += functions_byte_size;
+    memcpy(it, rows.buf, rows.size);
+    it += rows.size;
+    memcpy(it, names.buf, names.size);
+    rows.free();
+    functions.free();
+    names.free();
+}
+
+bool ic_line_map::build(ic_program& program)
+{
+    rows.clear();
+    functions.clear();
+    names = nullptr;
+    ic_line_table_header header;
+
+    if (!program.line_table || program.line_table_size < (int)sizeof(header))
+        return false;
+    memcpy(&header, program.line_table, sizeof(header));
+    int size = program.line_table_size - sizeof(header);
+
+    if (header.functions_size < 0 || header.rows_size < 0 || header.rows_byte_size < 0 || header.names_byte_size <= 0 ||
+        header.functions_size > size / (int)sizeof(ic_line_function))
+        return false;
+    size -= header.functions_size * sizeof(ic_line_function);
+
+    if (header.rows_byte_size > size || header.names_byte_size != size - header.rows_byte_size ||
+        header.rows_size > header.rows_byte_size / 2)
+        return false;
+    const unsigned char* it = program.line_table + sizeof(header);
+    functions.resize(header.functions_size);
+    memcpy(functions.buf, it, header.functions_size * sizeof(ic_line_function));
+    it += header.functions_size * sizeof(ic_line_function);
+    const unsigned char* rows_end = it + header.rows_byte_size;
+    names = (const char*)rows_end;
+
+    if (names[header.names_byte_size - 1])
+        return false;
+    int prev_offset = program.strings_byte_size;
+
+    for (ic_line_function function : functions)
+    {
+        if (function.offset < prev_offset || function.offset >= program.bytecode_size || function.name < 0 ||
+            function.name >= header.names_byte_size)
+            return false;
+        prev_offset = function.offset + 1;
+    }
+    ic_line_row row = { program.strings_byte_size, 0 };
+    rows.resize(header.rows_size);
+
+    for (int i = 0; i < rows.size; ++i)
+    {
+        unsigned int offset_delta, line_delta;
+
+        if (!read_leb(it, rows_end, &offset_delta) || !read_leb(it, rows_end, &line_delta) ||
+            offset_delta > (unsigned int)(program.bytecode_size - row.offset))
+            return false;
+        row.offset += offset_delta;
+        row.line = (int)((unsigned int)row.line + ((line_delta >> 1) ^ (0u - (line_delta & 1))));
+        rows.buf[i] = row;
+    }
+    return it == rows_end;
+}
+
+int ic_line_map::line_at(int offset)
+{
+    // the last row at or before offset
+    int first = 0;
+    int last = rows.size;
+
+    while (first < last)
+    {
+        int mid = (first + last) / 2;
+
+        if (rows.buf[mid].offset <= offset)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first ? rows.buf[first - 1].line : 0;
+}
+
+int ic_line_map::function_at(int offset)
+{
+    int first = 0;
+    int last = functions.size;
+
+    while (first < last)
+    {
+        int mid = (first + last) / 2;
+
+        if (functions.buf[mid].offset <= offset)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first - 1;
+}
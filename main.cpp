@@ -27,6 +27,23 @@ void host_write_ppm6(ic_data* argv, ic_data*, void*)
 }
 
 std::vector<unsigned char> load_file(const char* name);
+void bench_expr(int max_terms);
+void bench_symbols(int max_symbols);
+void bench_stress(int max_functions);
+void bench_lex(const char* source);
+void bench_context(int compiles);
+void bench_incremental(int max_functions);
+void bench_lazy(int max_functions);
+void bench_parallel(int max_functions);
+void bench_host_binding(int max_functions);
+void bench_verify(int max_functions);
+void bench_programs(int runs, int warmup, bool json);
+struct perf_counters;
+perf_counters* perf_open();
+void perf_begin(perf_counters* counters);
+void perf_end(perf_counters* counters);
+void perf_print(perf_counters* counters, const char* phase, unsigned long long bytecode_instructions);
+void perf_close(perf_counters* counters);
 
 void host_read_file(ic_data* argv, ic_data*, void*)
 {
@@ -100,6 +117,31 @@ s32 main()
 }
 )";
 
+// a literal is held across the first call of grow(), bytecode of a lazy program is reallocated when grow() is compiled
+static const char* test_lazy_program = R"(
+s32 grow(s32 x)
+{
+    for (s32 i = 0; i < 3; ++i) { x = x * 3 + i; x = x - i * 2; x = x / 2 + i; x = x * 5 - i; }
+    for (s32 i = 0; i < 3; ++i) { x = x * 3 + i; x = x - i * 2; x = x / 2 + i; x = x * 5 - i; }
+    for (s32 i = 0; i < 3; ++i) { x = x * 3 + i; x = x - i * 2; x = x / 2 + i; x = x * 5 - i; }
+    for (s32 i = 0; i < 3; ++i) { x = x * 3 + i; x = x - i * 2; x = x / 2 + i; x = x * 5 - i; }
+    return x;
+}
+
+s32 main()
+{
+    const s8* str = "held across a first call";
+    grow(1);
+    prints(str);
+    return host_test_string(str);
+}
+)";
+
+void host_test_string(ic_data* argv, ic_data* retv, void*)
+{
+    retv->s32 = strcmp((const char*)argv[0].pointer, "held across a first call") == 0;
+}
+
 void host_test_value(ic_data*, ic_data* retv, void*)
 {
     test_struct t;
@@ -168,6 +210,52 @@ std::vector<unsigned char> load_file(const char* name)
     return data;
 }
 
+// prints cache counters if cache_dir is not nullptr
+bool compile(ic_program& program, const char* source, ic_host_function* functions, const char* cache_dir)
+{
+    ic_compiler_context context;
+
+    if (!ic_compiler_context_init(context, IC_LIB_CORE, functions, nullptr))
+        return false;
+    context.cache_dir = cache_dir;
+    bool success = ic_program_init_compile(program, context, source, IC_COMPILE_OPTIMIZE | IC_COMPILE_LINE_TABLE);
+
+    if (cache_dir)
+        printf("cache hits: %d  misses: %d\n", context.cache_hits, context.cache_misses);
+    ic_compiler_context_free(context);
+    return success;
+}
+
+void write_profile(ic_vm& vm, ic_program& program, const char* path, const char* source_path)
+{
+    ic_vm_print_profile(vm, program);
+
+    if (ic_vm_write_profile(vm, program, path, source_path))
+        printf("profile written to %s\n", path);
+    else
+        printf("error: can't write %s\n", path);
+}
+
+void write_samples(ic_vm& vm, ic_program& program, const char* path)
+{
+    int samples = ic_vm_write_samples(vm, program, path);
+
+    if (samples == -1)
+        printf("error: can't write %s\n", path);
+    else
+        printf("%d samples written to %s\n", samples, path);
+}
+
+void print_usage()
+{
+    printf("usage: ic <command> <file or number> [options]\n"
+        "commands: run_source, run_bytecode, compile, dump_ir, disassemble, test, bench, bench_expr, bench_symbols,\n"
+        "    bench_stress, bench_lex, bench_context, bench_incremental, bench_lazy, bench_parallel, bench_host_binding,\n"
+        "    bench_verify\n"
+        "options: --cache-dir <dir>, --stats, --counts, --stats-json, --profile <file>, --sample <file>, --perf,\n"
+        "    --warmup <runs>, --json; only one of --stats, --profile and --sample can be used\n");
+}
+
 int main(int argc, const char** argv)
 {
     ic_host_function functions[] =
@@ -178,7 +266,62 @@ int main(int argc, const char** argv)
         nullptr
     };
 
-    assert(argc == 3);
+    const char* cache_dir = nullptr;
+    // --stats and --stats-json print execution counters after run_source and run_bytecode, --counts runs a program before
+    // disassemble and prints how many times each instruction was executed
+    bool stats = false;
+    bool stats_json = false;
+    // --profile prints a function profile after run_source and run_bytecode and writes it to a callgrind file
+    const char* profile_path = nullptr;
+    // --sample writes collapsed stacks sampled at 1 kHz after run_source and run_bytecode
+    const char* samples_path = nullptr;
+    // --perf reads hardware counters around compilation and execution of run_source and execution of run_bytecode; with
+    // --stats also rates per executed bytecode instruction, the counters then measure the counting interpreter loop
+    bool perf = false;
+    // options of bench, --json prints results as JSON
+    int warmup = 1;
+    bool json = false;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--counts") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--stats-json") == 0)
+            stats = stats_json = true;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profile_path = argv[++i];
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+            samples_path = argv[++i];
+        else if (strcmp(argv[i], "--perf") == 0)
+            perf = true;
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else
+        {
+            printf("error: unknown option or a missing argument: %s\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+    }
+
+    // a vm runs with a single of these modes, see ic_vm_run()
+    if ((int)stats + (profile_path != nullptr) + (samples_path != nullptr) > 1)
+    {
+        printf("error: --stats, --profile and --sample can't be used together\n");
+        return 1;
+    }
+
+    if (argc < 3)
+    {
+        print_usage();
+        return 1;
+    }
+
+    perf_counters* counters = perf ? perf_open() : nullptr;
 
     if (strcmp(argv[1], "run_source") == 0)
     {
@@ -190,32 +333,95 @@ int main(int argc, const char** argv)
             ic_program program;
             {
                 auto t1 = std::chrono::high_resolution_clock::now();
-                bool success = ic_program_init_compile(program, (char*)file_data.data(), IC_LIB_CORE, functions, nullptr);
+
+                if (counters)
+                    perf_begin(counters);
+                bool success = compile(program, (char*)file_data.data(), functions, cache_dir);
+
+                if (counters)
+                    perf_end(counters);
                 assert(success);
                 auto t2 = std::chrono::high_resolution_clock::now();
                 printf("compilation time: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
+
+                if (counters)
+                    perf_print(counters, "compilation", 0);
             }
+            if (stats)
+                ic_vm_enable_stats(vm);
+            if (profile_path)
+                ic_vm_enable_profile(vm);
+            if (samples_path && !ic_vm_enable_sampling(vm, 1000))
+                printf("error: sampling is not supported\n");
             {
                 auto t1 = std::chrono::high_resolution_clock::now();
-                ic_vm_run(vm, program);
+
+                if (counters)
+                    perf_begin(counters);
+                int ret;
+
+                // the VM has printed an error, e.g. a stack overflow
+                if (!ic_vm_run(vm, program, ret))
+                    return 1;
+
+                if (counters)
+                    perf_end(counters);
                 auto t2 = std::chrono::high_resolution_clock::now();
                 printf("execution time: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
             }
+
+            if (counters)
+                perf_print(counters, "execution", stats ? ic_vm_executed_instructions(vm) : 0);
+            if (stats)
+                ic_vm_print_stats(vm, program, stats_json);
+            if (profile_path)
+                write_profile(vm, program, profile_path, argv[2]);
+            if (vm.sampler)
+                write_samples(vm, program, samples_path);
             ic_program_free(program);
             ic_vm_free(vm);
         }
         auto t2 = std::chrono::high_resolution_clock::now();
         printf("total time: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count());
+
+        if (counters)
+            perf_close(counters);
         return 0;
     }
     else if (strcmp(argv[1], "run_bytecode") == 0)
     {
-        std::vector<unsigned char> file_data = load_file(argv[2]);
         ic_vm vm;
         ic_vm_init(vm);
         ic_program program;
-        ic_program_init_load(program, file_data.data(), IC_LIB_CORE, functions);
-        ic_vm_run(vm, program);
+        bool success = ic_program_init_map(program, argv[2], IC_LIB_CORE, functions);
+        assert(success);
+
+        if (stats)
+            ic_vm_enable_stats(vm);
+        if (profile_path)
+            ic_vm_enable_profile(vm);
+        if (samples_path && !ic_vm_enable_sampling(vm, 1000))
+            printf("error: sampling is not supported\n");
+        if (counters)
+            perf_begin(counters);
+        int ret;
+
+        if (!ic_vm_run(vm, program, ret))
+            return 1;
+
+        if (counters)
+        {
+            perf_end(counters);
+            perf_print(counters, "execution", stats ? ic_vm_executed_instructions(vm) : 0);
+        }
+        if (stats)
+            ic_vm_print_stats(vm, program, stats_json);
+        if (profile_path)
+            write_profile(vm, program, profile_path, nullptr);
+        if (vm.sampler)
+            write_samples(vm, program, samples_path);
+        if (counters)
+            perf_close(counters);
         ic_program_free(program);
         ic_vm_free(vm);
         return 0;
@@ -224,7 +430,7 @@ int main(int argc, const char** argv)
     {
         std::vector<unsigned char> file_data = load_file(argv[2]);
         ic_program program;
-        bool success = ic_program_init_compile(program, (char*)file_data.data(), IC_LIB_CORE, functions, nullptr);
+        bool success = compile(program, (char*)file_data.data(), functions, cache_dir);
         assert(success);
         unsigned char* buf;
         int size;
@@ -234,12 +440,33 @@ int main(int argc, const char** argv)
         ic_program_free(program);
         return 0;
     }
-    else if (strcmp(argv[1], "disassemble") == 0)
+    else if (strcmp(argv[1], "dump_ir") == 0)
     {
         std::vector<unsigned char> file_data = load_file(argv[2]);
         ic_program program;
-        ic_program_init_load(program, file_data.data(), IC_LIB_CORE, functions);
-        ic_program_print_disassembly(program);
+        bool success = ic_program_init_compile(program, (char*)file_data.data(), IC_LIB_CORE, functions, nullptr,
+            IC_COMPILE_OPTIMIZE | IC_COMPILE_PRINT_IR);
+        assert(success);
+        ic_program_free(program);
+        return 0;
+    }
+    else if (strcmp(argv[1], "disassemble") == 0)
+    {
+        ic_program program;
+        bool success = ic_program_init_map(program, argv[2], IC_LIB_CORE, functions);
+        assert(success);
+        ic_vm vm;
+        ic_vm_init(vm);
+
+        if (stats)
+        {
+            ic_vm_enable_stats(vm);
+            int ret;
+            success = ic_vm_run(vm, program, ret);
+            assert(success);
+        }
+        ic_program_print_disassembly(program, vm.stats);
+        ic_vm_free(vm);
         ic_program_free(program);
         return 0;
     }
@@ -259,13 +486,82 @@ int main(int argc, const char** argv)
         assert(success);
         ic_vm vm;
         ic_vm_init(vm);
-        int ret = ic_vm_run(vm, program);
+        int ret;
+        success = ic_vm_run(vm, program, ret);
+        assert(success);
         printf("main() returned %d\n", ret);
+        ic_program_free(program);
+
+        ic_host_function lazy_functions[] = { {"s32 host_test_string(const s8*)", host_test_string}, nullptr };
+        ic_compiler_context context;
+        success = ic_compiler_context_init(context, IC_LIB_CORE, lazy_functions, nullptr);
+        assert(success);
+        success = ic_program_init_compile(program, context, test_lazy_program, IC_COMPILE_OPTIMIZE | IC_COMPILE_LAZY);
+        assert(success);
+        success = ic_vm_run(vm, program, ret) && ret == 1;
+        printf("lazy string literal: %s\n", success ? "ok" : "WRONG RESULT");
         ic_vm_free(vm);
         ic_program_free(program);
+        ic_compiler_context_free(context);
+        return success ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "bench_expr") == 0)
+    {
+        bench_expr(atoi(argv[2]));
         return 0;
     }
-    else
-        assert(false);
-    return -1;
+    else if (strcmp(argv[1], "bench_symbols") == 0)
+    {
+        bench_symbols(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_stress") == 0)
+    {
+        bench_stress(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_lex") == 0)
+    {
+        std::vector<unsigned char> file_data = load_file(argv[2]);
+        bench_lex((char*)file_data.data());
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_context") == 0)
+    {
+        bench_context(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_incremental") == 0)
+    {
+        bench_incremental(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_lazy") == 0)
+    {
+        bench_lazy(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_parallel") == 0)
+    {
+        bench_parallel(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_host_binding") == 0)
+    {
+        bench_host_binding(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench_verify") == 0)
+    {
+        bench_verify(atoi(argv[2]));
+        return 0;
+    }
+    else if (strcmp(argv[1], "bench") == 0)
+    {
+        bench_programs(atoi(argv[2]), warmup, json);
+        return 0;
+    }
+    printf("error: unknown command: %s\n", argv[1]);
+    print_usage();
+    return 1;
 }
@@ -0,0 +1,352 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "ic_impl.h"
+
+// parallel compilation; threads of a pool compile all source functions, each into a bytecode buffer of its own worker
+// memory; then functions reachable from main() are copied to the compiler memory in the order the serial compiler would
+// compile them, their jumps and calls are relocated and deferred messages are printed in the same order, so the output
+// doesn't depend on the number of threads; unused functions are compiled with code generation too, their bytecode is
+// dropped
+
+struct ic_compiled_function
+{
+    int worker;
+    int code_begin;
+    int code_end;
+    int messages_begin;
+    int messages_end;
+    int activations_begin;
+    int activations_end;
+    int lines_begin;
+    int lines_end;
+    bool success;
+};
+
+// a worker memory shares the parsed program with the compiler memory and owns the arrays compile_function() modifies;
+// symbols are copied because they hold local variables and active functions
+struct ic_worker
+{
+    ic_memory memory;
+    std::thread thread; // the calling thread uses the first worker
+};
+
+struct ic_compile_pool
+{
+    ic_array<ic_worker*> workers;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    int job; // a new job is started by incrementing this
+    int running; // threads that have not finished the current job
+    bool quit;
+    // the current job
+    ic_memory* memory;
+    std::atomic<int> next_function; // an index into ic_memory::functions
+    ic_array<ic_compiled_function> compiled; // indexed like ic_memory::functions
+};
+
+static void init_worker_memory(ic_memory& worker)
+{
+    worker.bytecode.init();
+    worker.scopes.init();
+    worker.vars.init();
+    worker.break_ops.init();
+    worker.cont_ops.init();
+    worker.call_ops.init();
+    worker.frame_vars.init();
+    worker.lines.init();
+    worker.active_source_functions.init();
+    worker.active_host_functions.init();
+    worker.symbols.init();
+    worker.messages.init();
+    worker.activations.init();
+}
+
+static void free_worker_memory(ic_memory& worker)
+{
+    worker.bytecode.free();
+    worker.scopes.free();
+    worker.vars.free();
+    worker.break_ops.free();
+    worker.cont_ops.free();
+    worker.call_ops.free();
+    worker.frame_vars.free();
+    worker.lines.free();
+    worker.active_source_functions.free();
+    worker.active_host_functions.free();
+    worker.symbols.free();
+    worker.messages.free();
+    worker.activations.free();
+}
+
+// local variables of a function that failed to compile may be left in scopes
+static void reset_worker_symbols(ic_memory& worker, ic_memory& memory)
+{
+    worker.scopes.clear();
+    worker.vars.clear();
+    worker.break_ops.clear();
+    worker.cont_ops.clear();
+    worker.symbols.resize(memory.symbols.size);
+    memcpy(worker.symbols.buf, memory.symbols.buf, memory.symbols.size * sizeof(ic_symbol));
+}
+
+static void begin_worker_memory(ic_memory& worker, ic_memory& memory)
+{
+    ic_memory owned = worker;
+    worker = memory;
+    worker.bytecode = owned.bytecode;
+    worker.scopes = owned.scopes;
+    worker.vars = owned.vars;
+    worker.break_ops = owned.break_ops;
+    worker.cont_ops = owned.cont_ops;
+    worker.call_ops = owned.call_ops;
+    worker.frame_vars = owned.frame_vars;
+    worker.lines = owned.lines;
+    worker.active_source_functions = owned.active_source_functions;
+    worker.active_host_functions = owned.active_host_functions;
+    worker.symbols = owned.symbols;
+    worker.messages = owned.messages;
+    worker.activations = owned.activations;
+    worker.bytecode.clear();
+    worker.call_ops.clear();
+    worker.frame_vars.clear();
+    worker.lines.clear();
+    worker.active_source_functions.clear();
+    worker.active_host_functions.clear();
+    worker.messages.clear();
+    worker.activations.clear();
+    worker.worker = true;
+    worker.threads = 1;
+    worker.pool = nullptr;
+    reset_worker_symbols(worker, memory);
+}
+
+static void compile_functions(ic_compile_pool& pool, int worker_idx)
+{
+    ic_memory& memory = *pool.memory;
+    ic_memory& worker = pool.workers.buf[worker_idx]->memory;
+
+    for (;;)
+    {
+        int idx = pool.next_function.fetch_add(1);
+
+        if (idx >= memory.functions.size)
+            return;
+        ic_function& function = memory.functions.buf[idx];
+
+        if (function.type == IC_FUN_HOST)
+            continue;
+        ic_compiled_function& compiled = pool.compiled.buf[idx];
+        compiled.worker = worker_idx;
+        compiled.code_begin = worker.bytecode.size;
+        compiled.messages_begin = worker.messages.size;
+        compiled.activations_begin = worker.activations.size;
+        compiled.lines_begin = worker.lines.size;
+        compiled.success = compile_function(function, worker, true);
+        compiled.code_end = worker.bytecode.size;
+        compiled.messages_end = worker.messages.size;
+        compiled.activations_end = worker.activations.size;
+        compiled.lines_end = worker.lines.size;
+        worker.call_ops.clear(); // calls are found by decoding the bytecode
+
+        if (!compiled.success)
+            reset_worker_symbols(worker, memory);
+    }
+}
+
+static void worker_main(ic_compile_pool* pool, int worker_idx)
+{
+    int job = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->start.wait(lock, [&] { return pool->quit || pool->job != job; });
+
+            if (pool->quit)
+                return;
+            job = pool->job;
+        }
+        compile_functions(*pool, worker_idx);
+        std::lock_guard<std::mutex> lock(pool->mutex);
+
+        if (--pool->running == 0)
+            pool->done.notify_one();
+    }
+}
+
+static ic_compile_pool* create_compile_pool(int threads)
+{
+    ic_compile_pool* pool = new ic_compile_pool;
+    pool->workers.init();
+    pool->compiled.init();
+    pool->job = 0;
+    pool->running = 0;
+    pool->quit = false;
+    pool->memory = nullptr;
+
+    for (int i = 0; i < threads; ++i)
+    {
+        ic_worker* worker = new ic_worker;
+        init_worker_memory(worker->memory);
+        pool->workers.push_back(worker);
+
+        if (i)
+            worker->thread = std::thread(worker_main, pool, i);
+    }
+    return pool;
+}
+
+void free_compile_pool(ic_compile_pool* pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->quit = true;
+    }
+    pool->start.notify_all();
+
+    for (ic_worker* worker : pool->workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+        free_worker_memory(worker->memory);
+        delete worker;
+    }
+    pool->workers.free();
+    pool->compiled.free();
+    delete pool;
+}
+
+static void print_messages(ic_compiled_function& compiled, ic_compile_pool& pool, ic_memory& memory)
+{
+    ic_memory& worker = pool.workers.buf[compiled.worker]->memory;
+
+    for (int i = compiled.messages_begin; i < compiled.messages_end; ++i)
+    {
+        ic_message message = worker.messages.buf[i];
+        print(message.type, message.pos, memory.source_lines, message.text);
+    }
+}
+
+// appends the bytecode of a function to the compiler memory; callees are activated in the order compile_function()
+// activated them, an argument is compiled after its call is resolved, so the order of calls in the bytecode differs
+static void link_function(ic_function& function, ic_compiled_function& compiled, ic_compile_pool& pool, ic_memory& memory)
+{
+    ic_memory& worker = pool.workers.buf[compiled.worker]->memory;
+
+    for (int i = compiled.activations_begin; i < compiled.activations_end; ++i)
+        memory.activate_function(worker.activations.buf[i]);
+
+    int base = memory.bytecode.size;
+    int code_size = compiled.code_end - compiled.code_begin;
+    function.instr_idx = base;
+    memory.bytecode.resize(base + code_size);
+    unsigned char* code = memory.bytecode.buf + base;
+    memcpy(code, worker.bytecode.buf + compiled.code_begin, code_size);
+
+    for (int i = compiled.lines_begin; i < compiled.lines_end; ++i)
+    {
+        ic_line_row row = worker.lines.buf[i];
+        row.offset += base - compiled.code_begin;
+        memory.lines.push_back(row);
+    }
+    int offset = 0;
+
+    while (offset < code_size)
+    {
+        ic_opcode opcode = (ic_opcode)code[offset];
+        int operand_offset = offset + 1;
+        offset = operand_offset + operand_byte_size(opcode_info(opcode).operand);
+        int operand;
+
+        switch (opcode)
+        {
+        case IC_OPC_JUMP:
+        case IC_OPC_JUMP_TRUE:
+        case IC_OPC_JUMP_FALSE:
+            memcpy(&operand, code + operand_offset, sizeof(int));
+            operand += base - compiled.code_begin;
+            break;
+        case IC_OPC_CALL:
+            memcpy(&operand, code + operand_offset, sizeof(int));
+            operand = memory.activate_function(worker.active_source_functions.buf[operand]);
+            memory.call_ops.push_back(base + operand_offset);
+            break;
+        case IC_OPC_CALL_HOST:
+            memcpy(&operand, code + operand_offset, sizeof(int));
+            operand = memory.activate_function(worker.active_host_functions.buf[operand]);
+            break;
+        default:
+            continue;
+        }
+        memcpy(code + operand_offset, &operand, sizeof(int));
+    }
+    assert(offset == code_size);
+}
+
+// compiles functions like the serial loop of program_init_compile_impl() and compile_unused_functions()
+bool compile_functions_parallel(ic_memory& memory)
+{
+    if (memory.pool && memory.pool->workers.size != memory.threads)
+    {
+        free_compile_pool(memory.pool);
+        memory.pool = nullptr;
+    }
+
+    if (!memory.pool)
+        memory.pool = create_compile_pool(memory.threads);
+
+    ic_compile_pool& pool = *memory.pool;
+    pool.memory = &memory;
+    pool.next_function = 0;
+    pool.compiled.resize(memory.functions.size);
+
+    for (ic_worker* worker : pool.workers)
+        begin_worker_memory(worker->memory, memory);
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.job += 1;
+        pool.running = pool.workers.size - 1;
+    }
+    pool.start.notify_all();
+    compile_functions(pool, 0);
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.done.wait(lock, [&] { return pool.running == 0; });
+    }
+
+    for (ic_function& function : memory.functions)
+    {
+        if (function.type == IC_FUN_SOURCE)
+            function.instr_idx = -1;
+    }
+
+    // important, size changes inside a loop
+    for (int i = 0; i < memory.active_source_functions.size; ++i)
+    {
+        ic_function& function = *memory.active_source_functions.buf[i];
+        ic_compiled_function& compiled = pool.compiled.buf[&function - memory.functions.buf];
+        print_messages(compiled, pool, memory);
+
+        if (!compiled.success)
+            return false;
+        link_function(function, compiled, pool, memory);
+    }
+
+    for (int i = 0; i < memory.functions.size; ++i)
+    {
+        ic_function& function = memory.functions.buf[i];
+
+        if (function.type == IC_FUN_HOST || function.instr_idx != -1)
+            continue;
+        print(IC_PWARNING, function.token.pos, memory.source_lines, "function defined but not used");
+        print_messages(pool.compiled.buf[i], pool, memory);
+
+        if (!pool.compiled.buf[i].success)
+            return false;
+    }
+    return true;
+}
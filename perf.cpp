@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// hardware performance counters of the calling thread for the driver, see --perf in main.cpp; user space only, so these
+// work with the default perf_event_paranoid; a counter that can't be opened is reported as not available
+
+enum perf_counter_type
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_COUNTER_COUNT,
+};
+
+static const char* _perf_counter_names[] = { "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses" };
+
+struct perf_counters
+{
+    int fds[PERF_COUNTER_COUNT]; // -1 if a counter is not available
+    unsigned long long values[PERF_COUNTER_COUNT]; // of the last measurement, scaled if counters were multiplexed
+};
+
+#ifdef __linux__
+
+static int open_counter(unsigned int type, unsigned long long config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// prints why if no counter can be opened and returns nullptr
+perf_counters* perf_open()
+{
+    perf_counters* counters = (perf_counters*)malloc(sizeof(perf_counters));
+    unsigned long long l1d = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    counters->fds[PERF_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fds[PERF_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fds[PERF_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counters->fds[PERF_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, l1d);
+    counters->fds[PERF_LLC_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int error = errno;
+
+    for (int fd : counters->fds)
+    {
+        if (fd != -1)
+            return counters;
+    }
+    printf("perf counters are not available: %s\n", strerror(error));
+    free(counters);
+    return nullptr;
+}
+
+void perf_begin(perf_counters* counters)
+{
+    for (int fd : counters->fds)
+    {
+        if (fd != -1)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_end(perf_counters* counters)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+    {
+        int fd = counters->fds[i];
+        counters->values[i] = 0;
+
+        if (fd == -1)
+            continue;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long data[3]; // a value, time enabled and time running
+
+        if (read(fd, data, sizeof(data)) != sizeof(data) || !data[2])
+            continue;
+        counters->values[i] = data[2] < data[1] ? (unsigned long long)((double)data[0] * data[1] / data[2]) : data[0];
+    }
+}
+
+void perf_close(perf_counters* counters)
+{
+    for (int fd : counters->fds)
+    {
+        if (fd != -1)
+            close(fd);
+    }
+    free(counters);
+}
+
+#else
+
+perf_counters* perf_open()
+{
+    printf("perf counters are not available on this platform\n");
+    return nullptr;
+}
+
+void perf_begin(perf_counters*) {}
+void perf_end(perf_counters*) {}
+void perf_close(perf_counters*) {}
+
+#endif
+
+// bytecode_instructions is the number of executed VM instructions, 0 if it is not known
+void perf_print(perf_counters* counters, const char* phase, unsigned long long bytecode_instructions)
+{
+    printf("perf %s:", phase);
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+    {
+        if (counters->fds[i] == -1)
+            printf(" %s n/a", _perf_counter_names[i]);
+        else
+            printf(" %s %llu", _perf_counter_names[i], counters->values[i]);
+    }
+    unsigned long long cycles = counters->values[PERF_CYCLES];
+    unsigned long long instructions = counters->values[PERF_INSTRUCTIONS];
+
+    if (counters->fds[PERF_CYCLES] != -1 && counters->fds[PERF_INSTRUCTIONS] != -1 && cycles)
+        printf(" IPC %.2f", (double)instructions / cycles);
+    printf("\n");
+
+    if (!bytecode_instructions)
+        return;
+    printf("perf %s per bytecode instruction (%llu):", phase, bytecode_instructions);
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+    {
+        if (counters->fds[i] != -1)
+            printf(" %s %.3f", _perf_counter_names[i], (double)counters->values[i] / bytecode_instructions);
+    }
+    printf("\n");
+}
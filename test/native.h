@@ -0,0 +1,97 @@
+#pragma once
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// compiles the test programs as C++ for a baseline of the interpreter, see bench_programs(); a program is included into
+// a struct that derives from ic_native_lib, so its functions can be called before they are declared, like in ic, and
+// calls resolve to the functions below, that do what the core library and the host functions of main.cpp do
+
+typedef signed char s8;
+typedef unsigned char u8;
+typedef int s32;
+typedef float f32;
+typedef double f64;
+
+struct ic_native_lib
+{
+    static const char* output_dir; // of files written by write_ppm6(), defined by a translation unit that uses the header
+
+    static void prints(const char* str)
+    {
+        ::printf("prints: %s\n", str);
+    }
+
+    static void printf(f64 number)
+    {
+        ::printf("printf: %f\n", number);
+    }
+
+    static void printp(const void* ptr)
+    {
+        ::printf("printp: %p\n", ptr);
+    }
+
+    static void* malloc(s32 size)
+    {
+        return ::malloc(size);
+    }
+
+    static f64 tan(f64 x)
+    {
+        return ::tan(x);
+    }
+
+    static f64 sqrt(f64 x)
+    {
+        return ::sqrt(x);
+    }
+
+    static f64 pow(f64 x, f64 y)
+    {
+        return ::pow(x, y);
+    }
+
+    static void exit()
+    {
+        ::exit(0);
+    }
+
+    static f64 random01()
+    {
+        return (double)rand() / RAND_MAX;
+    }
+
+    // a file name has a "native_" prefix
+    static void write_ppm6(const char* filename, s32 width, s32 height, const u8* data)
+    {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/native_%s", output_dir, filename);
+        FILE* file = fopen(path, "wb");
+
+        if (!file)
+            return;
+        fprintf(file, "P6 %d %d 255 ", width, height);
+        fwrite(data, 1, width * height * 3, file);
+        fclose(file);
+    }
+
+    // like load_file() of main.cpp, data ends with a null character that is counted in size
+    static void read_file(const char* filename, u8** data, s32* size)
+    {
+        FILE* file = fopen(filename, "rb");
+        *data = nullptr;
+        *size = 0;
+
+        if (!file)
+            return;
+        fseek(file, 0, SEEK_END);
+        *size = ftell(file);
+        rewind(file);
+        *data = (u8*)::malloc(*size + 1);
+        *size = fread(*data, 1, *size, file);
+        (*data)[*size] = '\0';
+        *size += 1;
+        fclose(file);
+    }
+};
@@ -0,0 +1,269 @@
+#include "ic_impl.h"
+
+// bytecode verification; a program that passes it runs on the VM without runtime checks: every reachable instruction is
+// valid and is decoded from its first byte, operands are in bounds, jumps stay in a function and calls land on a function
+// entry, the operand stack of a function never drops below its base pointer and has the same height on every path to an
+// instruction, so the stack needs to be checked once per call only; local addresses stay in a frame and the arguments of
+// its callers; pointers that a program loads and stores through are not checked, same as in C
+
+#define IC_NOT_INSTR -2 // a byte inside an instruction
+#define IC_NOT_VISITED -1
+
+struct ic_verified_function
+{
+    int entry; // code offset of PUSH_MANY
+    int locals; // stack slots that PUSH_MANY allocates
+    int caller_height; // the smallest operand stack height of a caller at a call, main() is called with its return value
+    int min_address; // the smallest byte offset from a base pointer that ADDRESS takes
+    int max_height;
+};
+
+// heights are relative to a base pointer, a function is entered with 0; an instruction can be reached from one function only
+static bool enter(ic_array<int>& heights, ic_array<int>& owners, ic_array<int>& work, int offset, int height, int owner)
+{
+    if (offset < 0 || offset >= heights.size || heights.buf[offset] == IC_NOT_INSTR)
+        return false;
+
+    if (heights.buf[offset] == IC_NOT_VISITED)
+    {
+        heights.buf[offset] = height;
+        owners.buf[offset] = owner;
+        work.push_back(offset);
+        return true;
+    }
+    return heights.buf[offset] == height && owners.buf[offset] == owner;
+}
+
+// a callee is created on its first call, its entry must be PUSH_MANY that no jump reaches
+static bool enter_call(ic_array<int>& heights, ic_array<int>& owners, ic_array<int>& work,
+    ic_array<ic_verified_function>& functions, unsigned char* code, int offset, int caller_height)
+{
+    if (offset < 0 || offset >= heights.size || heights.buf[offset] == IC_NOT_INSTR || code[offset] != IC_OPC_PUSH_MANY)
+        return false;
+
+    if (heights.buf[offset] != IC_NOT_VISITED)
+    {
+        ic_verified_function& callee = functions.buf[owners.buf[offset]];
+
+        if (callee.entry != offset)
+            return false;
+        callee.caller_height = caller_height < callee.caller_height ? caller_height : callee.caller_height;
+        return true;
+    }
+    ic_verified_function callee;
+    callee.entry = offset;
+    memcpy(&callee.locals, code + offset + 1, sizeof(int));
+    callee.caller_height = caller_height;
+    callee.min_address = 0;
+    callee.max_height = 0;
+    functions.push_back(callee);
+    return enter(heights, owners, work, offset, 0, functions.size - 1);
+}
+
+// struct sizes and memmove offsets are in bytes
+static bool valid_byte_size(int byte_size)
+{
+    return byte_size > 0 && byte_size <= IC_STACK_SIZE * (int)sizeof(ic_data);
+}
+
+// checks an instruction and sets its stack effect
+static bool verify_instr(ic_program& program, ic_verified_function& function, ic_opcode opcode, unsigned char* operand,
+    int height, int* pops, int* pushes)
+{
+    int s32 = 0;
+
+    if (opcode_info(opcode).operand == IC_OPERAND_S32)
+        memcpy(&s32, operand, sizeof(int));
+    *pops = opcode_info(opcode).pops;
+    *pushes = opcode_info(opcode).pushes;
+
+    switch (opcode)
+    {
+    case IC_OPC_PUSH_MANY:
+        *pushes = s32;
+        return s32 >= 0 && s32 <= IC_STACK_SIZE;
+    case IC_OPC_POP_MANY:
+        *pops = s32;
+        return s32 >= 0 && s32 <= IC_STACK_SIZE;
+    case IC_OPC_MEMMOVE:
+    {
+        // destination and source are byte offsets from sp
+        int args[3];
+        memcpy(args, operand, sizeof(args));
+        *pops = 0;
+        *pushes = 0;
+        long long stack_bytes = (long long)height * sizeof(ic_data);
+        return args[0] >= 0 && args[1] >= 0 && args[2] >= 0 && args[2] <= args[0] && args[2] <= args[1] &&
+            args[0] <= stack_bytes && args[1] <= stack_bytes;
+    }
+    case IC_OPC_CALL:
+        // a callee returns with sp restored, the frame it pushes is checked by the VM
+        *pops = 0;
+        *pushes = 0;
+        return true;
+    case IC_OPC_CALL_HOST:
+    {
+        if (s32 < 0 || s32 >= program.host_functions_size)
+            return false;
+        ic_host_function& fun = program.host_functions[s32];
+
+        if (fun.return_size < 0 || fun.param_size < 0 || fun.return_size > IC_STACK_SIZE || fun.param_size > IC_STACK_SIZE)
+            return false;
+        *pops = fun.return_size + fun.param_size;
+        *pushes = *pops;
+        return true;
+    }
+    case IC_OPC_CALL_LAZY:
+        return false; // a lazy program is not verified
+    case IC_OPC_ADDRESS:
+        // a lower bound depends on callers, see verify_program()
+        function.min_address = s32 < function.min_address ? s32 : function.min_address;
+        return s32 < function.locals * (int)sizeof(ic_data);
+    case IC_OPC_ADDRESS_GLOBAL:
+        return s32 >= 0 && s32 <= program.global_data_byte_size;
+    case IC_OPC_ADDRESS_STRING:
+        return s32 >= 0 && s32 <= program.strings_byte_size;
+    case IC_OPC_STORE_STRUCT:
+        *pushes = bytes_to_data_size(s32);
+        *pops = *pushes + 1;
+        return valid_byte_size(s32);
+    case IC_OPC_LOAD_STRUCT:
+        *pushes = bytes_to_data_size(s32);
+        return valid_byte_size(s32);
+    case IC_OPC_SHL_S32:
+    case IC_OPC_SHR_S32:
+        return s32 >= 0 && s32 < 32;
+    case IC_OPC_SUB_PTR_PTR:
+    case IC_OPC_ADD_PTR_S32:
+    case IC_OPC_SUB_PTR_S32:
+        return s32 > 0;
+    default:
+        return true;
+    }
+}
+
+// sets program.frame_sizes on success
+bool verify_program(ic_program& program)
+{
+    int code_begin = program.strings_byte_size;
+    int code_size = program.bytecode_size - code_begin;
+
+    if (code_begin < 0 || code_size <= 0 || program.global_data_byte_size < 0 ||
+        bytes_to_data_size(program.global_data_byte_size) > IC_STACK_SIZE)
+        return false;
+    unsigned char* code = program.bytecode + code_begin;
+    ic_array<int> heights; // indexed by a code offset
+    ic_array<int> owners; // same, an index of a function that reaches an instruction
+    ic_array<int> work;
+    ic_array<ic_verified_function> functions;
+    heights.init();
+    owners.init();
+    work.init();
+    functions.init();
+    heights.resize(code_size);
+    owners.resize(code_size);
+    bool valid = true;
+
+    for (int offset = 0; offset < code_size;)
+    {
+        ic_opcode opcode = (ic_opcode)code[offset];
+
+        if (opcode >= IC_OPC_COUNT)
+        {
+            valid = false;
+            break;
+        }
+        int next_offset = offset + 1 + operand_byte_size(opcode_info(opcode).operand);
+        heights.buf[offset] = IC_NOT_VISITED;
+
+        for (int i = offset + 1; i < next_offset && i < code_size; ++i)
+            heights.buf[i] = IC_NOT_INSTR;
+        offset = next_offset;
+        valid = offset <= code_size;
+    }
+    // main() is the first function
+    valid = valid && enter_call(heights, owners, work, functions, code, 0, 1);
+
+    while (valid && work.size)
+    {
+        int offset = work.back();
+        work.pop_back();
+        int height = heights.buf[offset];
+        int owner = owners.buf[offset];
+        ic_opcode opcode = (ic_opcode)code[offset];
+        unsigned char* operand = code + offset + 1;
+        int next_offset = offset + 1 + operand_byte_size(opcode_info(opcode).operand);
+        int pops, pushes;
+
+        if (!verify_instr(program, functions.buf[owner], opcode, operand, height, &pops, &pushes) || height < pops)
+        {
+            valid = false;
+            break;
+        }
+        height += pushes - pops;
+
+        if (height > IC_STACK_SIZE)
+        {
+            valid = false;
+            break;
+        }
+        ic_verified_function& function = functions.buf[owner]; // enter_call() may reallocate functions
+        function.max_height = height > function.max_height ? height : function.max_height;
+        int target = -1;
+
+        if (is_jump(opcode) || opcode == IC_OPC_CALL)
+        {
+            memcpy(&target, operand, sizeof(int));
+            target = target >= code_begin ? target - code_begin : -1;
+        }
+
+        switch (opcode)
+        {
+        case IC_OPC_RETURN:
+            break;
+        case IC_OPC_JUMP:
+            valid = enter(heights, owners, work, target, height, owner);
+            break;
+        case IC_OPC_JUMP_TRUE:
+        case IC_OPC_JUMP_FALSE:
+            valid = enter(heights, owners, work, target, height, owner) && enter(heights, owners, work, next_offset, height, owner);
+            break;
+        case IC_OPC_CALL:
+            valid = enter_call(heights, owners, work, functions, code, target, height) &&
+                enter(heights, owners, work, next_offset, height, owner);
+            break;
+        default:
+            valid = enter(heights, owners, work, next_offset, height, owner);
+        }
+    }
+    int* frame_sizes = nullptr;
+
+    if (valid)
+    {
+        frame_sizes = (int*)malloc(((code_size >> IC_FRAME_SIZES_SHIFT) + 1) * sizeof(int));
+        memset(frame_sizes, 0, ((code_size >> IC_FRAME_SIZES_SHIFT) + 1) * sizeof(int));
+    }
+
+    for (int i = 0; valid && i < functions.size; ++i)
+    {
+        ic_verified_function& function = functions.buf[i];
+        // a frame begins after a saved bp and ip, below them are arguments and a return value that callers pushed
+        valid = function.min_address >= -(function.caller_height + 2) * (int)sizeof(ic_data);
+        int frame_size = function.max_height + 2;
+        int& entry_size = frame_sizes[function.entry >> IC_FRAME_SIZES_SHIFT];
+        entry_size = frame_size > entry_size ? frame_size : entry_size;
+    }
+    heights.free();
+    owners.free();
+    work.free();
+    functions.free();
+
+    if (!valid)
+    {
+        free(frame_sizes);
+        return false;
+    }
+    free(program.frame_sizes);
+    program.frame_sizes = frame_sizes;
+    return true;
+}
@@ -1,27 +1,77 @@
+#include <stdio.h>
+#include <chrono>
 #include "ic_impl.h"
 
-#define IC_STACK_SIZE (1024 * 1024)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define IC_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define IC_RDTSC
+#endif
 
 void ic_vm_init(ic_vm& vm)
 {
     vm.stack = (ic_data*)malloc(IC_STACK_SIZE * sizeof(ic_data));
+    vm.stats = nullptr;
+    vm.profile = nullptr;
+    vm.sampler = nullptr;
 }
 
 void ic_vm_free(ic_vm& vm)
 {
     free(vm.stack);
+
+    if (vm.stats)
+    {
+        vm.stats->offsets.free();
+        free(vm.stats);
+    }
+
+    if (vm.profile)
+    {
+        vm.profile->nodes.free();
+        vm.profile->edges.free();
+        vm.profile->edge_table.free();
+        vm.profile->source_nodes.free();
+        vm.profile->host_nodes.free();
+        vm.profile->frames.free();
+        free(vm.profile);
+    }
+
+    if (vm.sampler)
+        sampler_free(vm.sampler);
+}
+
+// time stamp counter ticks, nanoseconds where there is none
+static unsigned long long read_cycles()
+{
+#ifdef IC_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// a verified program doesn't check the stack on every push, see ic_program::frame_sizes
+template<bool checked>
+static void push_slots(ic_vm& vm, int size)
+{
+    vm.sp += size;
+
+    if (checked)
+        assert(vm.sp <= vm.stack + IC_STACK_SIZE);
 }
 
 void ic_vm::push()
 {
-    ++sp;
-    assert(sp <= stack + IC_STACK_SIZE);
+    push_slots<true>(*this, 1);
 }
 
 void ic_vm::push_many(int size)
 {
-    sp += size;
-    assert(sp <= stack + IC_STACK_SIZE);
+    push_slots<true>(*this, size);
 }
 
 ic_data ic_vm::pop()
@@ -40,57 +90,136 @@ ic_data& ic_vm::top()
     return *(sp - 1);
 }
 
-int ic_vm_run(ic_vm& _vm, ic_program& program)
+// bytecode of a lazy program was reallocated, moves instruction pointers to the new buffer
+static void rebase_instruction_pointers(ic_vm& vm, unsigned char* old_bytecode, unsigned char* bytecode)
+{
+    vm.ip = bytecode + (vm.ip - old_bytecode);
+
+    // each frame has a saved bp and ip below its base pointer, main() returns to nullptr
+    for (ic_data* bp = vm.bp; bp[-1].pointer; bp = (ic_data*)bp[-2].pointer)
+        bp[-1].pointer = bytecode + ((unsigned char*)bp[-1].pointer - old_bytecode);
+}
+
+// instr is the call that overflows, the line table is decoded only here
+static void stack_overflow(ic_program& program, unsigned char* instr)
+{
+    ic_line_map lines;
+    lines.init();
+
+    if (lines.build(program))
+    {
+        int offset = instr - program.bytecode;
+        int function = lines.function_at(offset);
+        printf("error (line: %d, function: %s): stack overflow\n", lines.line_at(offset),
+            function == -1 ? "?" : lines.name(function));
+    }
+    else
+        printf("error: stack overflow\n");
+    lines.free();
+}
+
+// a frame of a verified program fits the stack if it is checked before the call pushes a bp and an ip, instr_idx is the
+// first instruction of a called function and instr is the call
+static bool check_frame(ic_vm& vm, ic_program& program, int instr_idx, unsigned char* instr)
+{
+    int frame_size = program.frame_sizes[(instr_idx - program.strings_byte_size) >> IC_FRAME_SIZES_SHIFT];
+
+    if (vm.sp + frame_size <= vm.stack + IC_STACK_SIZE)
+        return true;
+    stack_overflow(program, instr);
+    return false;
+}
+
+#ifdef _MSC_VER
+#define IC_UNREACHABLE() __assume(0)
+#else
+#define IC_UNREACHABLE() __builtin_unreachable()
+#endif
+
+// each mode is a separate instantiation of the interpreter loop, the default one doesn't pay for the others
+enum ic_run_mode
+{
+    IC_RUN_DEFAULT,
+    IC_RUN_STATS, // see ic_vm_enable_stats()
+    IC_RUN_PROFILE, // see ic_vm_enable_profile()
+    IC_RUN_SAMPLE, // see ic_vm_enable_sampling()
+};
+
+template<bool checked, ic_run_mode mode>
+static bool run(ic_vm& _vm, ic_program& program, int& main_return)
 {
     ic_vm vm = _vm; // 20% perf gain in visual studio; but there is no gain if a parameter is passed by value, why?
     assert(bytes_to_data_size(program.global_data_byte_size) <= IC_STACK_SIZE);
-    memcpy(vm.stack, program.bytecode, program.strings_byte_size);
-    // set global non-string data to 0
-    memset(vm.stack + program.strings_byte_size, 0, program.global_data_byte_size - program.strings_byte_size);
+    memset(vm.stack, 0, program.global_data_byte_size);
     vm.sp = vm.stack + bytes_to_data_size(program.global_data_byte_size);
-    vm.push_many(3); // main() return value, bp, ip
+    push_slots<checked>(vm, 1); // main() return value
+
+    if (!checked && !check_frame(vm, program, program.strings_byte_size, program.bytecode + program.strings_byte_size))
+        return false;
+    push_slots<checked>(vm, 2); // bp, ip
     vm.top().pointer = nullptr; // set a return address, see IC_OPC_RETURN for an explanation
     vm.bp = vm.sp;
     vm.ip = program.bytecode + program.strings_byte_size;
 
+    if (mode == IC_RUN_STATS)
+    {
+        vm.stats->grow(program.bytecode_size > vm.stats->offsets.size ? program.bytecode_size : vm.stats->offsets.size);
+        vm.stats->prev_opcode = -1;
+    }
+
+    if (mode == IC_RUN_PROFILE)
+    {
+        vm.profile->frames.clear();
+        profile_enter(*vm.profile, profile_source_node(*vm.profile, program.strings_byte_size), -1, read_cycles());
+    }
+
+    if (mode == IC_RUN_SAMPLE)
+    {
+        vm.sampler->publish(vm.ip, vm.bp);
+        sampler_start(*vm.sampler, program);
+    }
+
     for(;;)
     {
         ic_opcode opcode = (ic_opcode)*vm.ip;
+
+        if (mode == IC_RUN_STATS)
+            vm.stats->count(vm.ip - program.bytecode, opcode);
         ++vm.ip;
 
         switch (opcode)
         {
         case IC_OPC_PUSH_S8:
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().s8 = *(char*)vm.ip;
             ++vm.ip;
             break;
         case IC_OPC_PUSH_S32:
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().s32 = read_int(&vm.ip);
             break;
         case IC_OPC_PUSH_F32:
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().f32 = read_float(&vm.ip);
             break;
         case IC_OPC_PUSH_F64:
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().f64 = read_double(&vm.ip);
             break;
         case IC_OPC_PUSH_NULLPTR:
         {
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().pointer = nullptr;
             break;
         }
         case IC_OPC_PUSH:
         {
-            vm.push();
+            push_slots<checked>(vm, 1);
             break;
         }
         case IC_OPC_PUSH_MANY:
         {
-            vm.push_many(read_int(&vm.ip));
+            push_slots<checked>(vm, read_int(&vm.ip));
             break;
         }
         case IC_OPC_POP:
@@ -121,19 +250,73 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
         }
         case IC_OPC_CLONE:
         {
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top() = *(vm.sp - 2);
             break;
         }
         case IC_OPC_CALL:
         {
             int idx = read_int(&vm.ip);
-            vm.push();
+            unsigned char* instr = vm.ip - 1 - sizeof(int);
+
+            if (!checked && !check_frame(vm, program, idx, instr))
+            {
+                if (mode == IC_RUN_SAMPLE)
+                    sampler_stop(*vm.sampler);
+                return false;
+            }
+            push_slots<checked>(vm, 1);
             vm.top().pointer = vm.bp;
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().pointer = vm.ip;
             vm.bp = vm.sp;
             vm.ip = program.bytecode + idx;
+
+            if (mode == IC_RUN_PROFILE)
+                profile_enter(*vm.profile, profile_source_node(*vm.profile, idx), instr - program.bytecode, read_cycles());
+            if (mode == IC_RUN_SAMPLE)
+                vm.sampler->publish(vm.ip, vm.bp);
+            break;
+        }
+        case IC_OPC_CALL_LAZY:
+        {
+            int call_idx = vm.ip - 1 - program.bytecode;
+            unsigned char* bytecode = program.bytecode;
+
+            // saved instruction pointers are not valid while they are rebased
+            if (mode == IC_RUN_SAMPLE)
+                vm.sampler->bp = nullptr;
+            int idx = lazy_compile_function(program, read_int(&vm.ip));
+
+            if (idx == -1)
+            {
+                if (mode == IC_RUN_SAMPLE)
+                    sampler_stop(*vm.sampler);
+                return false;
+            }
+
+            if (program.bytecode != bytecode)
+                rebase_instruction_pointers(vm, bytecode, program.bytecode);
+
+            // patch the call site, next calls don't trap
+            program.bytecode[call_idx] = IC_OPC_CALL;
+            memcpy(program.bytecode + call_idx + 1, &idx, sizeof(int));
+            push_slots<checked>(vm, 1);
+            vm.top().pointer = vm.bp;
+            push_slots<checked>(vm, 1);
+            vm.top().pointer = vm.ip;
+            vm.bp = vm.sp;
+            vm.ip = program.bytecode + idx;
+
+            // the compilation is not included
+            if (mode == IC_RUN_PROFILE)
+                profile_enter(*vm.profile, profile_source_node(*vm.profile, idx), call_idx, read_cycles());
+            if (mode == IC_RUN_SAMPLE)
+            {
+                vm.sampler->bytecode = program.bytecode;
+                vm.sampler->bytecode_size = program.bytecode_size;
+                vm.sampler->publish(vm.ip, vm.bp);
+            }
             break;
         }
         case IC_OPC_CALL_HOST:
@@ -142,17 +325,41 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
             ic_host_function& fun = program.host_functions[idx];
             ic_data* argv = vm.sp - fun.param_size;
             ic_data* retv = argv - fun.return_size;
+
+            if (mode == IC_RUN_PROFILE)
+                profile_enter(*vm.profile, profile_host_node(*vm.profile, idx), vm.ip - 1 - sizeof(int) - program.bytecode,
+                    read_cycles());
+            if (mode == IC_RUN_SAMPLE)
+                vm.sampler->host_function = idx;
             fun.callback(argv, retv, fun.host_data);
+
+            if (mode == IC_RUN_PROFILE)
+                profile_leave(*vm.profile, read_cycles());
+            if (mode == IC_RUN_SAMPLE)
+                vm.sampler->host_function = -1;
             break;
         }
         case IC_OPC_RETURN:
         {
+            if (mode == IC_RUN_PROFILE)
+                profile_leave(*vm.profile, read_cycles());
             vm.sp = vm.bp;
             vm.ip = (unsigned char*)vm.pop().pointer;
             vm.bp = (ic_data*)vm.pop().pointer;
 
+            if (mode == IC_RUN_SAMPLE)
+            {
+                if (vm.ip)
+                    vm.sampler->publish(vm.ip, vm.bp);
+                else
+                    sampler_stop(*vm.sampler);
+            }
+
             if (!vm.ip)
-                return vm.top().s32;
+            {
+                main_return = vm.top().s32;
+                return true;
+            }
             break;
         }
         case IC_OPC_JUMP_TRUE:
@@ -183,17 +390,24 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
         case IC_OPC_ADDRESS:
         {
             int byte_offset = read_int(&vm.ip);
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().pointer = (char*)vm.bp + byte_offset;
             break;
         }
         case IC_OPC_ADDRESS_GLOBAL:
         {
             int byte_offset = read_int(&vm.ip);
-            vm.push();
+            push_slots<checked>(vm, 1);
             vm.top().pointer = (char*)vm.stack + byte_offset;
             break;
         }
+        case IC_OPC_ADDRESS_STRING:
+        {
+            int byte_offset = read_int(&vm.ip);
+            push_slots<checked>(vm, 1);
+            vm.top().pointer = program.strings + byte_offset;
+            break;
+        }
         case IC_OPC_STORE_1:
         {
             void* ptr = vm.pop().pointer;
@@ -243,7 +457,7 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
             void* ptr = vm.pop().pointer;
             int byte_size = read_int(&vm.ip);
             int data_size = bytes_to_data_size(byte_size);
-            vm.push_many(data_size);
+            push_slots<checked>(vm, data_size);
             memcpy(vm.sp - data_size, ptr, byte_size);
             break;
         }
@@ -318,6 +532,21 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
             vm.top().s32 = vm.top().s32 % rhs;
             break;
         }
+        case IC_OPC_SHL_S32:
+        {
+            int count = read_int(&vm.ip);
+            vm.top().s32 = (unsigned)vm.top().s32 << count;
+            break;
+        }
+        case IC_OPC_SHR_S32:
+        {
+            int count = read_int(&vm.ip);
+            int value = vm.top().s32;
+            // negative values are biased, so the result is rounded toward zero
+            value += (value >> 31) & ((1 << count) - 1);
+            vm.top().s32 = value >> count;
+            break;
+        }
         case IC_OPC_COMPARE_E_F32:
         {
             float rhs = vm.pop().f32;
@@ -487,7 +716,9 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
         case IC_OPC_SUB_PTR_PTR:
         {
             int type_byte_size = read_int(&vm.ip);
-            assert(type_byte_size);
+
+            if (checked)
+                assert(type_byte_size);
             void* rhs = vm.pop().pointer;
             vm.top().s32 = ((char*)vm.top().pointer - (char*)rhs) / type_byte_size;
             break;
@@ -495,7 +726,9 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
         case IC_OPC_ADD_PTR_S32:
         {
             int type_byte_size = read_int(&vm.ip);
-            assert(type_byte_size);
+
+            if (checked)
+                assert(type_byte_size);
             int bytes = vm.pop().s32 * type_byte_size;
             vm.top().pointer = (char*)vm.top().pointer + bytes;
             break;
@@ -503,7 +736,9 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
         case IC_OPC_SUB_PTR_S32:
         {
             int type_byte_size = read_int(&vm.ip);
-            assert(type_byte_size);
+
+            if (checked)
+                assert(type_byte_size);
             int bytes = vm.pop().s32 * type_byte_size;
             vm.top().pointer = (char*)vm.top().pointer - bytes;
             break;
@@ -587,7 +822,25 @@ int ic_vm_run(ic_vm& _vm, ic_program& program)
             vm.top().f64 = vm.top().f32;
             break;
         default:
+            if (!checked)
+                IC_UNREACHABLE();
             assert(false);
         }
     } // while
 }
+
+bool ic_vm_run(ic_vm& vm, ic_program& program, int& main_return)
+{
+    if (vm.stats)
+        return program.frame_sizes ? run<false, IC_RUN_STATS>(vm, program, main_return) :
+            run<true, IC_RUN_STATS>(vm, program, main_return);
+    if (vm.profile)
+        return program.frame_sizes ? run<false, IC_RUN_PROFILE>(vm, program, main_return) :
+            run<true, IC_RUN_PROFILE>(vm, program, main_return);
+    if (vm.sampler)
+        return program.frame_sizes ? run<false, IC_RUN_SAMPLE>(vm, program, main_return) :
+            run<true, IC_RUN_SAMPLE>(vm, program, main_return);
+    if (program.frame_sizes)
+        return run<false, IC_RUN_DEFAULT>(vm, program, main_return);
+    return run<true, IC_RUN_DEFAULT>(vm, program, main_return);
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include "ic_impl.h"
+
+// a function profile; the interpreter loop calls profile_enter() when a function or a host function is called and
+// profile_leave() when it returns, cycles are read by the loop, see read_cycles()
+
+#define IC_PROFILE_TEXT_ROWS 30
+
+void ic_vm_enable_profile(ic_vm& vm)
+{
+    if (vm.profile)
+        return;
+    vm.profile = (ic_vm_profile*)malloc(sizeof(ic_vm_profile));
+    ic_vm_profile& profile = *vm.profile;
+    profile.nodes.init();
+    profile.edges.init();
+    profile.edge_table.init();
+    profile.source_nodes.init();
+    profile.host_nodes.init();
+    profile.frames.init();
+}
+
+static int add_node(ic_vm_profile& profile, int function, bool host)
+{
+    ic_profile_node node;
+    node.function = function;
+    node.host = host;
+    node.active = 0;
+    node.calls = 0;
+    node.inclusive = 0;
+    node.exclusive = 0;
+    profile.nodes.push_back(node);
+    return profile.nodes.size - 1;
+}
+
+// nodes of all arrays are created on the first call, so a lazy program that appends code is handled too
+static int& node_slot(ic_array<int>& nodes, int idx)
+{
+    if (idx >= nodes.size)
+    {
+        int begin = nodes.size;
+        nodes.resize(idx + 1);
+
+        for (int i = begin; i < nodes.size; ++i)
+            nodes.buf[i] = -1;
+    }
+    return nodes.buf[idx];
+}
+
+int profile_source_node(ic_vm_profile& profile, int offset)
+{
+    int& node = node_slot(profile.source_nodes, offset);
+
+    if (node == -1)
+        node = add_node(profile, offset, false);
+    return node;
+}
+
+int profile_host_node(ic_vm_profile& profile, int host_function)
+{
+    int& node = node_slot(profile.host_nodes, host_function);
+
+    if (node == -1)
+        node = add_node(profile, host_function, true);
+    return node;
+}
+
+static unsigned int edge_hash(int caller, int callee, int call)
+{
+    return ((((unsigned int)caller * 2654435761u) ^ (unsigned int)callee) * 2654435761u) ^ (unsigned int)call;
+}
+
+static int get_edge(ic_vm_profile& profile, int caller, int callee, int call)
+{
+    ic_array<int>& table = profile.edge_table;
+
+    if (profile.edges.size * 2 >= table.size)
+    {
+        int size = table.size ? table.size * 2 : 64;
+        table.resize(size);
+
+        for (int& slot : table)
+            slot = 0;
+
+        for (int i = 0; i < profile.edges.size; ++i)
+        {
+            ic_profile_edge& edge = profile.edges.buf[i];
+            unsigned int slot = edge_hash(edge.caller, edge.callee, edge.call) & (size - 1);
+
+            while (table.buf[slot])
+                slot = (slot + 1) & (size - 1);
+            table.buf[slot] = i + 1;
+        }
+    }
+    unsigned int mask = table.size - 1;
+
+    for (unsigned int slot = edge_hash(caller, callee, call) & mask;; slot = (slot + 1) & mask)
+    {
+        int idx = table.buf[slot] - 1;
+
+        if (idx == -1)
+        {
+            table.buf[slot] = profile.edges.size + 1;
+            profile.edges.push_back({ caller, callee, call, 0, 0 });
+            return profile.edges.size - 1;
+        }
+        ic_profile_edge& edge = profile.edges.buf[idx];
+
+        if (edge.caller == caller && edge.callee == callee && edge.call == call)
+            return idx;
+    }
+}
+
+void profile_enter(ic_vm_profile& profile, int node, int call, unsigned long long cycles)
+{
+    ic_profile_frame frame;
+    frame.node = node;
+    frame.edge = profile.frames.size ? get_edge(profile, profile.frames.back().node, node, call) : -1;
+    frame.begin = cycles;
+    frame.callees = 0;
+    profile.nodes.buf[node].calls += 1;
+    profile.nodes.buf[node].active += 1;
+
+    if (frame.edge != -1)
+        profile.edges.buf[frame.edge].calls += 1;
+    profile.frames.push_back(frame);
+}
+
+void profile_leave(ic_vm_profile& profile, unsigned long long cycles)
+{
+    ic_profile_frame frame = profile.frames.back();
+    profile.frames.pop_back();
+    ic_profile_node& node = profile.nodes.buf[frame.node];
+    unsigned long long inclusive = cycles - frame.begin;
+    node.exclusive += inclusive - frame.callees;
+    node.active -= 1;
+
+    // the outermost frame of a recursion adds its cycles to an edge too, otherwise they would be counted more than once
+    if (!node.active)
+    {
+        node.inclusive += inclusive;
+
+        if (frame.edge != -1)
+            profile.edges.buf[frame.edge].inclusive += inclusive;
+    }
+
+    if (profile.frames.size)
+        profile.frames.back().callees += inclusive;
+}
+
+// the name of a host function is its prototype
+struct ic_profile_names
+{
+    ic_line_map lines;
+    bool has_lines;
+    char buf[32];
+
+    const char* name(ic_program& program, ic_profile_node& node)
+    {
+        if (node.host)
+            return program.host_functions[node.function].prototype_str;
+        int function = has_lines ? lines.function_at(node.function) : -1;
+
+        if (function != -1 && lines.functions.buf[function].offset == node.function)
+            return lines.name(function);
+        snprintf(buf, sizeof(buf), "function_%d", node.function);
+        return buf;
+    }
+
+    // 0 for host functions
+    int line(ic_profile_node& node)
+    {
+        return has_lines && !node.host ? lines.line_at(node.function) : 0;
+    }
+
+    // a line of a call site, the line of a caller if there is no line table
+    int call_line(ic_profile_edge& edge, int caller_line)
+    {
+        return has_lines ? lines.line_at(edge.call) : caller_line;
+    }
+};
+
+static int compare_nodes(const void* lhs, const void* rhs)
+{
+    const ic_profile_node& a = **(ic_profile_node* const*)lhs;
+    const ic_profile_node& b = **(ic_profile_node* const*)rhs;
+
+    if (a.exclusive != b.exclusive)
+        return a.exclusive < b.exclusive ? 1 : -1;
+    return a.function < b.function ? -1 : (a.function > b.function);
+}
+
+void ic_vm_print_profile(ic_vm& vm, ic_program& program)
+{
+    assert(vm.profile);
+    ic_vm_profile& profile = *vm.profile;
+    ic_profile_names names;
+    names.lines.init();
+    names.has_lines = names.lines.build(program);
+    ic_array<ic_profile_node*> nodes;
+    nodes.init();
+    unsigned long long total = 0;
+
+    for (ic_profile_node& node : profile.nodes)
+    {
+        nodes.push_back(&node);
+        total += node.exclusive;
+    }
+    qsort(nodes.buf, nodes.size, sizeof(ic_profile_node*), compare_nodes);
+    printf("profile, cycles: %llu\n%12s %16s %16s %7s  %s\n", total, "calls", "inclusive", "exclusive", "self", "function");
+
+    for (int i = 0; i < nodes.size && i < IC_PROFILE_TEXT_ROWS; ++i)
+    {
+        ic_profile_node& node = *nodes.buf[i];
+        printf("%12llu %16llu %16llu %6.2f%%  %s\n", node.calls, node.inclusive, node.exclusive,
+            total ? 100.0 * node.exclusive / total : 0, names.name(program, node));
+    }
+    nodes.free();
+    names.lines.free();
+}
+
+// https://valgrind.org/docs/manual/cl-format.html, every function is defined by its first line, callers by their names, the
+// cost of a call is at the line of its call site
+bool ic_vm_write_profile(ic_vm& vm, ic_program& program, const char* path, const char* source_path)
+{
+    assert(vm.profile);
+    FILE* file = fopen(path, "w");
+
+    if (!file)
+        return false;
+    ic_vm_profile& profile = *vm.profile;
+    ic_profile_names names;
+    names.lines.init();
+    names.has_lines = names.lines.build(program);
+    unsigned long long total = 0;
+
+    for (ic_profile_node& node : profile.nodes)
+        total += node.exclusive;
+
+    fprintf(file, "# callgrind format\nversion: 1\ncreator: ic\npositions: line\nevents: Cycles\nsummary: %llu\n\n", total);
+    fprintf(file, "fl=(1) %s\n", source_path ? source_path : "?");
+    ic_array<bool> named; // compressed names are defined once
+    named.init();
+    named.resize(profile.nodes.size);
+
+    for (bool& b : named)
+        b = false;
+
+    for (int i = 0; i < profile.nodes.size; ++i)
+    {
+        ic_profile_node& node = profile.nodes.buf[i];
+        int line = names.line(node);
+        fprintf(file, "\nfn=(%d)", i + 1);
+
+        if (!named.buf[i])
+            fprintf(file, " %s", names.name(program, node));
+        named.buf[i] = true;
+        fprintf(file, "\n%d %llu\n", line, node.exclusive);
+
+        for (ic_profile_edge& edge : profile.edges)
+        {
+            if (edge.caller != i)
+                continue;
+            ic_profile_node& callee = profile.nodes.buf[edge.callee];
+            fprintf(file, "cfn=(%d)", edge.callee + 1);
+
+            if (!named.buf[edge.callee])
+                fprintf(file, " %s", names.name(program, callee));
+            named.buf[edge.callee] = true;
+            fprintf(file, "\ncalls=%llu %d\n%d %llu\n", edge.calls, names.line(callee), names.call_line(edge, line),
+                edge.inclusive);
+        }
+    }
+    named.free();
+    names.lines.free();
+    return fclose(file) == 0;
+}
@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include "ic_impl.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// a sampling profiler; a timer sends SIGPROF to the thread that runs a program while it runs, the handler reads
+// the position the interpreter loop publishes on calls and returns and walks saved bp and ip pairs of frames up to main(),
+// it doesn't allocate and doesn't call anything that is not async-signal-safe; samples are resolved to function names
+// after a run
+
+#define IC_SAMPLE_MAX_DEPTH 256 // deeper stacks are cut, main() is lost then
+#define IC_SAMPLES_CAPACITY (4 * 1024 * 1024) // ints, a sample takes its depth + 2
+
+#ifdef __linux__
+
+static ic_vm_sampler* volatile _active_sampler;
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static int sample_offset(unsigned char* ip, unsigned char* bytecode, int bytecode_size)
+{
+    long long offset = ip - bytecode;
+    return offset >= 0 && offset < bytecode_size ? (int)offset : -1;
+}
+
+static void handle_sigprof(int)
+{
+    ic_vm_sampler* active = _active_sampler;
+
+    if (!active)
+        return;
+    ic_vm_sampler& sampler = *active;
+    ic_data* bp = sampler.bp;
+    unsigned char* ip = sampler.ip;
+    unsigned char* bytecode = sampler.bytecode;
+    int bytecode_size = sampler.bytecode_size;
+    int begin = sampler.samples_size;
+
+    if (!bp || begin + IC_SAMPLE_MAX_DEPTH + 2 > sampler.samples_capacity)
+    {
+        sampler.lost += 1;
+        return;
+    }
+    int* sample = sampler.samples + begin;
+    sample[1] = sampler.host_function;
+    int depth = 0;
+    int offset = sample_offset(ip, bytecode, bytecode_size);
+
+    while (offset != -1 && depth < IC_SAMPLE_MAX_DEPTH)
+    {
+        sample[2 + depth] = offset;
+        depth += 1;
+
+        // a frame has a saved bp and ip below its base pointer
+        if (bp < sampler.stack + 2 || bp > sampler.stack + IC_STACK_SIZE)
+        {
+            depth = 0;
+            break;
+        }
+        ip = (unsigned char*)bp[-1].pointer;
+
+        if (!ip)
+            break; // main()
+        bp = (ic_data*)bp[-2].pointer;
+        offset = sample_offset(ip, bytecode, bytecode_size);
+    }
+
+    if (!depth || offset == -1)
+    {
+        sampler.lost += 1;
+        return;
+    }
+    sample[0] = depth;
+    sampler.samples_size = begin + 2 + depth;
+}
+
+bool ic_vm_enable_sampling(ic_vm& vm, int frequency)
+{
+    if (vm.sampler)
+        return true;
+    assert(frequency > 0);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_sigprof;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGPROF, &action, nullptr) != 0)
+        return false;
+    sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+    timer_t* timer = (timer_t*)malloc(sizeof(timer_t));
+
+    // timers of the CPU time of a thread fire on scheduler ticks, that can be less often than the frequency
+    if (timer_create(CLOCK_MONOTONIC, &event, timer) != 0)
+    {
+        free(timer);
+        return false;
+    }
+    ic_vm_sampler& sampler = *(ic_vm_sampler*)malloc(sizeof(ic_vm_sampler));
+    sampler.ip = nullptr;
+    sampler.bp = nullptr;
+    sampler.host_function = -1;
+    sampler.bytecode = nullptr;
+    sampler.bytecode_size = 0;
+    sampler.stack = vm.stack;
+    sampler.samples = (int*)malloc(IC_SAMPLES_CAPACITY * sizeof(int));
+    sampler.samples_capacity = IC_SAMPLES_CAPACITY;
+    sampler.samples_size = 0;
+    sampler.lost = 0;
+    sampler.frequency = frequency;
+    sampler.timer = timer;
+    vm.sampler = &sampler;
+    return true;
+}
+
+static void set_timer(ic_vm_sampler& sampler, long interval_ns)
+{
+    itimerspec spec;
+    spec.it_interval.tv_sec = interval_ns / 1000000000;
+    spec.it_interval.tv_nsec = interval_ns % 1000000000;
+    spec.it_value = spec.it_interval;
+    timer_settime(*(timer_t*)sampler.timer, 0, &spec, nullptr);
+}
+
+void sampler_start(ic_vm_sampler& sampler, ic_program& program)
+{
+    sampler.bytecode = program.bytecode;
+    sampler.bytecode_size = program.bytecode_size;
+    sampler.host_function = -1;
+    _active_sampler = &sampler;
+    set_timer(sampler, 1000000000 / sampler.frequency);
+}
+
+void sampler_stop(ic_vm_sampler& sampler)
+{
+    set_timer(sampler, 0);
+    _active_sampler = nullptr;
+}
+
+void sampler_free(ic_vm_sampler* sampler)
+{
+    timer_delete(*(timer_t*)sampler->timer);
+    free(sampler->timer);
+    free(sampler->samples);
+    free(sampler);
+}
+
+#else
+
+bool ic_vm_enable_sampling(ic_vm&, int)
+{
+    return false;
+}
+
+void sampler_start(ic_vm_sampler&, ic_program&) {}
+void sampler_stop(ic_vm_sampler&) {}
+void sampler_free(ic_vm_sampler*) {}
+
+#endif
+
+// entries of functions; from a line table if there is one, otherwise call targets and main()
+struct ic_sample_functions
+{
+    ic_line_map lines;
+    bool has_lines;
+    ic_array<int> entries; // sorted
+    char buf[32];
+
+    void init(ic_program& program)
+    {
+        lines.init();
+        entries.init();
+        has_lines = lines.build(program);
+
+        if (has_lines)
+        {
+            for (ic_line_function function : lines.functions)
+                entries.push_back(function.offset);
+            return;
+        }
+        entries.push_back(program.strings_byte_size);
+        unsigned char* it = program.bytecode + program.strings_byte_size;
+        unsigned char* end = program.bytecode + program.bytecode_size;
+
+        while (it < end)
+        {
+            ic_opcode opcode = (ic_opcode)*it;
+            ++it;
+
+            if (opcode == IC_OPC_CALL)
+            {
+                unsigned char* operand = it;
+                entries.push_back(read_int(&operand));
+            }
+            it += operand_byte_size(opcode_info(opcode).operand);
+        }
+        qsort(entries.buf, entries.size, sizeof(int), compare_ints);
+    }
+
+    void free()
+    {
+        lines.free();
+        entries.free();
+    }
+
+    // an index into entries, -1 for an offset before the first function
+    int function_at(int offset)
+    {
+        int first = 0;
+        int last = entries.size;
+
+        while (first < last)
+        {
+            int mid = (first + last) / 2;
+
+            if (entries.buf[mid] <= offset)
+                first = mid + 1;
+            else
+                last = mid;
+        }
+        return first - 1;
+    }
+
+    const char* name(int function)
+    {
+        if (has_lines)
+            return lines.name(function);
+        snprintf(buf, sizeof(buf), "function_%d", entries.buf[function]);
+        return buf;
+    }
+
+    static int compare_ints(const void* lhs, const void* rhs)
+    {
+        int a = *(const int*)lhs;
+        int b = *(const int*)rhs;
+        return a < b ? -1 : (a > b);
+    }
+};
+
+// a sample resolved to functions: a stack size, a host function and functions from main() to the current one
+static int compare_stacks(const void* lhs, const void* rhs)
+{
+    const int* a = *(const int* const*)lhs;
+    const int* b = *(const int* const*)rhs;
+    int size = a[0] < b[0] ? a[0] : b[0];
+
+    for (int i = 1; i < size + 2; ++i)
+    {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return a[0] < b[0] ? -1 : (a[0] > b[0]);
+}
+
+int ic_vm_write_samples(ic_vm& vm, ic_program& program, const char* path)
+{
+    assert(vm.sampler);
+    ic_vm_sampler& sampler = *vm.sampler;
+    FILE* file = fopen(path, "w");
+
+    if (!file)
+        return -1;
+    ic_sample_functions functions;
+    functions.init(program);
+    ic_array<int> stacks;
+    ic_array<int*> begins; // of stacks
+    stacks.init();
+    begins.init();
+    // samples and stacks have the same sizes
+    stacks.resize(sampler.samples_size);
+
+    for (int i = 0; i < sampler.samples_size;)
+    {
+        int* sample = sampler.samples + i;
+        int* stack = stacks.buf + i;
+        begins.push_back(stack);
+        stack[0] = sample[0];
+        stack[1] = sample[1];
+
+        for (int k = 0; k < sample[0]; ++k)
+            stack[2 + k] = functions.function_at(sample[2 + sample[0] - 1 - k]);
+        i += 2 + sample[0];
+    }
+    qsort(begins.buf, begins.size, sizeof(int*), compare_stacks);
+
+    for (int i = 0; i < begins.size;)
+    {
+        int* stack = begins.buf[i];
+        int count = 1;
+
+        while (i + count < begins.size && compare_stacks(&begins.buf[i], &begins.buf[i + count]) == 0)
+            count += 1;
+
+        for (int k = 0; k < stack[0]; ++k)
+        {
+            int function = stack[2 + k];
+            fprintf(file, "%s%s", k ? ";" : "", function == -1 ? "?" : functions.name(function));
+        }
+
+        if (stack[1] != -1)
+            fprintf(file, ";%s", program.host_functions[stack[1]].prototype_str);
+        fprintf(file, " %d\n", count);
+        i += count;
+    }
+    int samples = begins.size;
+    stacks.free();
+    begins.free();
+    functions.free();
+    return fclose(file) == 0 ? samples : -1;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include "ic_impl.h"
+
+// reports of execution counters, the counting is done by the interpreter loop, see ic_vm_stats::count()
+
+#define IC_STATS_TEXT_ROWS 30 // of pairs and offsets, the text report lists all opcodes
+
+struct ic_stats_entry
+{
+    unsigned long long count;
+    int first; // an opcode or an offset
+    int second; // the next opcode of a pair
+};
+
+static int compare_entries(const void* lhs, const void* rhs)
+{
+    const ic_stats_entry& a = *(const ic_stats_entry*)lhs;
+    const ic_stats_entry& b = *(const ic_stats_entry*)rhs;
+
+    // by count descending, then by position for a stable output
+    if (a.count != b.count)
+        return a.count < b.count ? 1 : -1;
+    if (a.first != b.first)
+        return a.first < b.first ? -1 : 1;
+    return a.second < b.second ? -1 : (a.second > b.second);
+}
+
+static void sort_entries(ic_array<ic_stats_entry>& entries)
+{
+    qsort(entries.buf, entries.size, sizeof(ic_stats_entry), compare_entries);
+}
+
+static const char* opcode_name(int opcode)
+{
+    return opcode_info((ic_opcode)opcode).name;
+}
+
+static double percent(unsigned long long count, unsigned long long total)
+{
+    return total ? 100.0 * count / total : 0;
+}
+
+void ic_vm_enable_stats(ic_vm& vm)
+{
+    if (vm.stats)
+        return;
+    vm.stats = (ic_vm_stats*)malloc(sizeof(ic_vm_stats));
+    memset(vm.stats, 0, sizeof(ic_vm_stats));
+    vm.stats->offsets.init();
+    vm.stats->prev_opcode = -1;
+}
+
+unsigned long long ic_vm_executed_instructions(ic_vm& vm)
+{
+    assert(vm.stats);
+    unsigned long long total = 0;
+
+    for (unsigned long long count : vm.stats->opcodes)
+        total += count;
+    return total;
+}
+
+void ic_vm_print_stats(ic_vm& vm, ic_program& program, bool json)
+{
+    assert(vm.stats);
+    ic_vm_stats& stats = *vm.stats;
+    ic_array<ic_stats_entry> opcodes;
+    ic_array<ic_stats_entry> pairs;
+    ic_array<ic_stats_entry> offsets;
+    opcodes.init();
+    pairs.init();
+    offsets.init();
+    unsigned long long total = 0;
+
+    for (int i = 0; i < IC_OPC_COUNT; ++i)
+    {
+        total += stats.opcodes[i];
+
+        if (stats.opcodes[i])
+            opcodes.push_back({ stats.opcodes[i], i, 0 });
+
+        for (int k = 0; k < IC_OPC_COUNT; ++k)
+        {
+            if (stats.pairs[i][k])
+                pairs.push_back({ stats.pairs[i][k], i, k });
+        }
+    }
+
+    for (int i = 0; i < stats.offsets.size && i < program.bytecode_size; ++i)
+    {
+        if (stats.offsets.buf[i])
+            offsets.push_back({ stats.offsets.buf[i], i, 0 });
+    }
+    sort_entries(opcodes);
+    sort_entries(pairs);
+    sort_entries(offsets);
+    ic_line_map lines;
+    lines.init();
+    bool has_lines = lines.build(program);
+
+    if (json)
+    {
+        printf("{\n  \"instructions\": %llu,\n  \"opcodes\": [", total);
+
+        for (int i = 0; i < opcodes.size; ++i)
+        {
+            ic_stats_entry& e = opcodes.buf[i];
+            printf("%s\n    {\"opcode\": \"%s\", \"count\": %llu}", i ? "," : "", opcode_name(e.first), e.count);
+        }
+        printf("\n  ],\n  \"pairs\": [");
+
+        for (int i = 0; i < pairs.size; ++i)
+        {
+            ic_stats_entry& e = pairs.buf[i];
+            printf("%s\n    {\"first\": \"%s\", \"second\": \"%s\", \"count\": %llu}", i ? "," : "", opcode_name(e.first),
+                opcode_name(e.second), e.count);
+        }
+        printf("\n  ],\n  \"offsets\": [");
+
+        for (int i = 0; i < offsets.size; ++i)
+        {
+            ic_stats_entry& e = offsets.buf[i];
+            printf("%s\n    {\"offset\": %d, \"opcode\": \"%s\", \"count\": %llu", i ? "," : "", e.first,
+                opcode_name(program.bytecode[e.first]), e.count);
+
+            if (has_lines)
+            {
+                int function = lines.function_at(e.first);
+                printf(", \"line\": %d, \"function\": \"%s\"", lines.line_at(e.first), function == -1 ? "" :
+                    lines.name(function));
+            }
+            printf("}");
+        }
+        printf("\n  ]\n}\n");
+    }
+    else
+    {
+        printf("executed instructions: %llu\n\nopcodes:\n", total);
+
+        for (ic_stats_entry& e : opcodes)
+            printf("%14llu %6.2f%%  %s\n", e.count, percent(e.count, total), opcode_name(e.first));
+
+        printf("\nopcode pairs:\n");
+
+        for (int i = 0; i < pairs.size && i < IC_STATS_TEXT_ROWS; ++i)
+        {
+            ic_stats_entry& e = pairs.buf[i];
+            printf("%14llu %6.2f%%  %s, %s\n", e.count, percent(e.count, total), opcode_name(e.first),
+                opcode_name(e.second));
+        }
+        printf("\noffsets:\n");
+
+        for (int i = 0; i < offsets.size && i < IC_STATS_TEXT_ROWS; ++i)
+        {
+            ic_stats_entry& e = offsets.buf[i];
+            printf("%14llu %6.2f%%  %-8d%-16s", e.count, percent(e.count, total), e.first,
+                opcode_name(program.bytecode[e.first]));
+
+            if (has_lines)
+            {
+                int function = lines.function_at(e.first);
+                printf(" line %d, %s", lines.line_at(e.first), function == -1 ? "?" : lines.name(function));
+            }
+            printf("\n");
+        }
+    }
+    opcodes.free();
+    pairs.free();
+    offsets.free();
+    lines.free();
+}